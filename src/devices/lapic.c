@@ -0,0 +1,265 @@
+/*! \file lapic.c
+ *
+ * Local APIC, the interrupt controller built into each CPU.  See [IA32-v3a]
+ * chapter 8 "Advanced Programmable Interrupt Controller (APIC)".
+ *
+ * Pintos uses the local APIC only to run more than one CPU, or to stop
+ * timer interrupts on idle CPUs.  Device interrupts still come through the
+ * 8259A PICs, which the bootstrap processor's local APIC passes along in
+ * "virtual wire" mode, so only the bootstrap processor ever sees them.  The
+ * application processors (APs) get their timer interrupts from their own
+ * local APIC timers instead, and the CPUs signal each other with
+ * interprocessor interrupts (IPIs).  A local APIC timer can also interrupt
+ * just once, which is what lets an idle CPU sleep until its next deadline.
+ */
+
+#include "devices/lapic.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/*! Kernel virtual address at which the local APIC's registers are mapped:
+    the last page of the address space, well above the kernel's mapping of
+    RAM.  Every CPU finds its own local APIC at the same address. */
+#define LAPIC_VADDR ((void *) 0xfffff000)
+
+/*! Local APIC registers, as offsets from the base.  @{ */
+#define LAPIC_ID 0x020          /*!< Local APIC ID. */
+#define LAPIC_TPR 0x080         /*!< Task priority. */
+#define LAPIC_EOI 0x0b0         /*!< End of interrupt. */
+#define LAPIC_SVR 0x0f0         /*!< Spurious interrupt vector. */
+#define LAPIC_ESR 0x280         /*!< Error status. */
+#define LAPIC_ICR_LO 0x300      /*!< Interrupt command, bits 0-31. */
+#define LAPIC_ICR_HI 0x310      /*!< Interrupt command, bits 32-63. */
+#define LAPIC_LVT_TIMER 0x320   /*!< Local vector table: timer. */
+#define LAPIC_LVT_LINT0 0x350   /*!< Local vector table: LINT0 pin. */
+#define LAPIC_LVT_LINT1 0x360   /*!< Local vector table: LINT1 pin. */
+#define LAPIC_LVT_ERROR 0x370   /*!< Local vector table: errors. */
+#define LAPIC_TIMER_INIT 0x380  /*!< Timer initial count. */
+#define LAPIC_TIMER_CUR 0x390   /*!< Timer current count. */
+#define LAPIC_TIMER_DIV 0x3e0   /*!< Timer divide configuration. */
+/*! @} */
+
+/*! Register bits.  @{ */
+#define SVR_ENABLE 0x100        /*!< APIC software enable. */
+#define LVT_MASKED 0x10000      /*!< Interrupt masked. */
+#define LVT_PERIODIC 0x20000    /*!< Timer reloads after each interrupt. */
+#define LVT_EXTINT 0x700        /*!< Deliver as from an 8259A PIC. */
+#define LVT_NMI 0x400           /*!< Deliver as a non-maskable interrupt. */
+#define ICR_INIT 0x500          /*!< INIT IPI. */
+#define ICR_STARTUP 0x600       /*!< STARTUP IPI. */
+#define ICR_PENDING 0x1000      /*!< Not yet delivered. */
+#define ICR_ASSERT 0x4000       /*!< Level assert, as opposed to deassert. */
+#define ICR_LEVEL 0x8000        /*!< Level triggered, as opposed to edge. */
+#define TIMER_DIV_16 0x3        /*!< Timer counts at bus clock / 16. */
+/*! @} */
+
+/*! Timer ticks over which to calibrate the local APIC timer. */
+#define CALIBRATE_TICKS 2
+
+/*! Local APIC registers. */
+static volatile uint32_t *lapic;
+
+/*! Local APIC timer counts per timer tick. */
+static uint32_t lapic_timer_count;
+
+static intr_handler_func spurious_interrupt;
+static void setup(bool bsp);
+static uint32_t lapic_read(int reg);
+static void lapic_write(int reg, uint32_t value);
+static void send_icr(uint8_t apic_id, uint32_t icr);
+
+/*! Maps the local APIC registers, which are at physical address PADDR, and
+    sets up the bootstrap processor's local APIC.  Returns true if
+    successful, false if memory allocation failed. */
+bool lapic_init(uintptr_t paddr) {
+    uint32_t *pde = init_page_dir + pd_no(LAPIC_VADDR);
+    uint32_t *pt;
+
+    /* Page directories created from now on share this page table. */
+    if (*pde == 0) {
+        pt = palloc_get_page(PAL_ZERO);
+        if (pt == NULL)
+            return false;
+        *pde = pde_create(pt);
+    }
+    pt = pde_get_pt(*pde);
+    pt[pt_no(LAPIC_VADDR)] = ((paddr & PTE_ADDR) | PTE_PCD | PTE_PWT
+                              | PTE_W | PTE_P);
+    lapic = LAPIC_VADDR;
+
+    intr_register_ipi(LAPIC_VEC_SPURIOUS, spurious_interrupt,
+                      "APIC spurious");
+    setup(true);
+    return true;
+}
+
+/*! Sets up the local APIC of the application processor we are running on.
+    Its timer interrupts TIMER_FREQ times per second. */
+void lapic_init_ap(void) {
+    setup(false);
+    lapic_timer_start();
+}
+
+/*! Measures the rate of the local APIC timer against the 8254 timer, which
+    must already be running, so that application processors can set their
+    timers to match.  The local APIC timer runs off the bus clock, so every
+    CPU's runs at the same rate. */
+void lapic_timer_calibrate(void) {
+    int64_t start;
+
+    ASSERT(intr_get_level() == INTR_ON);
+    ASSERT(lapic != NULL);
+
+    lapic_write(LAPIC_TIMER_DIV, TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | LAPIC_VEC_TIMER);
+
+    /* Count from the start of a tick. */
+    start = timer_ticks();
+    while (timer_ticks() == start)
+        barrier();
+    lapic_write(LAPIC_TIMER_INIT, UINT32_MAX);
+    start = timer_ticks();
+    while (timer_elapsed(start) < CALIBRATE_TICKS)
+        barrier();
+    lapic_timer_count = ((UINT32_MAX - lapic_read(LAPIC_TIMER_CUR))
+                         / CALIBRATE_TICKS);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+}
+
+/*! Starts the local APIC timer of the CPU we are running on interrupting
+    TIMER_FREQ times per second.  The timer must be calibrated. */
+void lapic_timer_start(void) {
+    ASSERT(lapic_timer_count != 0);
+
+    lapic_write(LAPIC_TIMER_DIV, TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_PERIODIC | LAPIC_VEC_TIMER);
+    lapic_write(LAPIC_TIMER_INIT, lapic_timer_count);
+}
+
+/*! Makes the local APIC timer of the CPU we are running on interrupt just
+    once, TICKS timer ticks from now, or as far off as it can if that is
+    further. */
+void lapic_timer_oneshot(int64_t ticks) {
+    uint32_t count = UINT32_MAX;
+
+    ASSERT(ticks > 0);
+    if (ticks < UINT32_MAX / lapic_timer_count)
+        count = ticks * lapic_timer_count;
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_VEC_TIMER);
+    lapic_write(LAPIC_TIMER_INIT, count);
+}
+
+/*! Ends a wait set up by lapic_timer_oneshot() and returns the number of
+    whole timer ticks that it lasted.  The timer goes back to interrupting
+    every tick, in phase with the ticks counted.  If the one-shot interrupt
+    has come due, its interrupt is still to be handled, and it counts as the
+    last tick, not as one of those returned. */
+int64_t lapic_timer_resume(void) {
+    uint32_t initial = lapic_read(LAPIC_TIMER_INIT);
+    uint32_t current = lapic_read(LAPIC_TIMER_CUR);
+    uint32_t elapsed = initial - current;
+
+    if (current == 0) {
+        lapic_timer_start();
+        return elapsed / lapic_timer_count - 1;
+    }
+
+    /* Interrupt once more at the end of the current tick, then let
+       lapic_timer_tick() go back to periodic. */
+    lapic_write(LAPIC_TIMER_INIT,
+                lapic_timer_count - elapsed % lapic_timer_count);
+    return elapsed / lapic_timer_count;
+}
+
+/*! Called at each local APIC timer interrupt.  Goes back to periodic
+    interrupts after the one-shot set up by lapic_timer_resume(). */
+void lapic_timer_tick(void) {
+    if (!(lapic_read(LAPIC_LVT_TIMER) & LVT_PERIODIC))
+        lapic_timer_start();
+}
+
+/*! Returns the ID of the local APIC of the CPU we are running on. */
+uint8_t lapic_id(void) {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+/*! Acknowledges the interrupt being handled.  Must be called for every
+    local APIC interrupt except spurious ones. */
+void lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/*! Sends interrupt VEC to the CPU whose local APIC has ID APIC_ID. */
+void lapic_send_ipi(uint8_t apic_id, uint8_t vec) {
+    send_icr(apic_id, vec);
+}
+
+/*! Starts the application processor whose local APIC has ID APIC_ID running
+    in real mode at PADDR, which must be page-aligned and below 1 MB.  See
+    [MP] B.4 "Application Processor Startup". */
+void lapic_start_ap(uint8_t apic_id, uintptr_t paddr) {
+    int i;
+
+    ASSERT(paddr % PGSIZE == 0 && paddr < 0x100000);
+
+    send_icr(apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+    timer_udelay(200);
+    send_icr(apic_id, ICR_INIT | ICR_LEVEL);
+    timer_mdelay(10);
+
+    /* The STARTUP IPI is not retried on failure, so send it twice. */
+    for (i = 0; i < 2; i++) {
+        send_icr(apic_id, ICR_STARTUP | (paddr >> PGBITS));
+        timer_udelay(200);
+    }
+}
+
+/*! Spurious interrupt handler.  A spurious interrupt needs no EOI. */
+static void spurious_interrupt(struct intr_frame *args UNUSED) {
+}
+
+/*! Enables the local APIC of the CPU we are running on.  BSP is true for
+    the bootstrap processor, whose LINT0 pin brings in interrupts from the
+    PICs and whose LINT1 pin brings in NMIs; the others ignore both pins. */
+static void setup(bool bsp) {
+    lapic_write(LAPIC_SVR, SVR_ENABLE | LAPIC_VEC_SPURIOUS);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | LAPIC_VEC_TIMER);
+    lapic_write(LAPIC_LVT_LINT0, bsp ? LVT_EXTINT : LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, bsp ? LVT_NMI : LVT_MASKED);
+    lapic_write(LAPIC_LVT_ERROR, LVT_MASKED | LAPIC_VEC_SPURIOUS);
+
+    /* Clear errors, which takes back-to-back writes, and any interrupt
+       left unacknowledged. */
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_eoi();
+
+    /* Accept interrupts of every priority. */
+    lapic_write(LAPIC_TPR, 0);
+}
+
+/*! Returns the value of local APIC register REG. */
+static uint32_t lapic_read(int reg) {
+    return lapic[reg / sizeof *lapic];
+}
+
+/*! Writes VALUE to local APIC register REG. */
+static void lapic_write(int reg, uint32_t value) {
+    lapic[reg / sizeof *lapic] = value;
+}
+
+/*! Sends the interprocessor interrupt described by ICR, the low word of the
+    interrupt command register, to the CPU whose local APIC has ID APIC_ID,
+    and waits for it to be delivered. */
+static void send_icr(uint8_t apic_id, uint32_t icr) {
+    lapic_write(LAPIC_ICR_HI, (uint32_t) apic_id << 24);
+    lapic_write(LAPIC_ICR_LO, icr);
+    while (lapic_read(LAPIC_ICR_LO) & ICR_PENDING)
+        asm volatile ("pause");
+}
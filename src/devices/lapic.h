@@ -0,0 +1,27 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*! Interrupt vectors delivered by the local APIC.  Those that are not IPIs
+    count as external interrupts.  @{ */
+#define LAPIC_VEC_TIMER 0xf0    /*!< Local APIC timer. */
+#define LAPIC_VEC_CALL 0xf1     /*!< IPI: run smp_call() function. */
+#define LAPIC_VEC_WAKE 0xf2     /*!< IPI: leave the idle loop. */
+#define LAPIC_VEC_SPURIOUS 0xff /*!< Spurious interrupt. */
+/*! @} */
+
+bool lapic_init(uintptr_t paddr);
+void lapic_init_ap(void);
+void lapic_timer_calibrate(void);
+void lapic_timer_start(void);
+void lapic_timer_oneshot(int64_t ticks);
+int64_t lapic_timer_resume(void);
+void lapic_timer_tick(void);
+uint8_t lapic_id(void);
+void lapic_eoi(void);
+void lapic_send_ipi(uint8_t apic_id, uint8_t vec);
+void lapic_start_ap(uint8_t apic_id, uintptr_t paddr);
+
+#endif /* devices/lapic.h */
@@ -4,15 +4,24 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/init.h"
 #include "threads/io.h"
 #include "threads/thread.h"
 #ifdef USERPROG
+#include "userprog/elfcache.h"
 #include "userprog/exception.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 
 /*! Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -105,6 +114,7 @@ void shutdown_power_off(void) {
 /*! Print statistics about Pintos execution. */
 static void print_stats(void) {
     timer_print_stats();
+    init_print_stats();
     thread_print_stats();
 #ifdef FILESYS
     block_print_stats();
@@ -113,6 +123,14 @@ static void print_stats(void) {
     kbd_print_stats();
 #ifdef USERPROG
     exception_print_stats();
+    pagedir_print_stats();
+    syscall_print_stats();
+    elf_cache_print_stats();
+#endif
+#ifdef VM
+    frame_print_stats();
+    page_print_stats();
+    swap_print_stats();
 #endif
 }
 
@@ -1,6 +1,24 @@
 /*! \file timer.c
  *
  * See [8254] for hardware details of the 8254 timer chip.
+ *
+ * The bootstrap processor ticks from the 8254, and the other CPUs from
+ * their local APIC timers.  With "-tickless", the bootstrap processor also
+ * ticks from its local APIC timer, which idle CPUs set to interrupt just
+ * once, when the next sleeping thread is due, instead of every tick.  When
+ * such a CPU is interrupted, it accounts for the ticks it slept through as
+ * if it had been idle for each of them.
+ *
+ * Time finer than a tick comes from the time-stamp counter (TSC), if the
+ * CPU has one: timer_calibrate() measures how fast it counts against the
+ * 8254, and timer_now_ns() and the busy waits go by it from then on.  The
+ * CPUs' TSCs are assumed to count in step, as they do on any machine with
+ * an invariant TSC and in the emulators Pintos runs on.
+ *
+ * Working out loops_per_tick by trial takes a couple of dozen timer ticks,
+ * so timer_calibrate() avoids it when it can: it takes the rate from the
+ * "-loops" option, which utils/pintos caches from earlier boots, or else
+ * times a short loop against the TSC.
  */
 
 #include "devices/timer.h"
@@ -8,8 +26,11 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include "devices/lapic.h"
 #include "devices/pit.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
+#include "threads/smp.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
@@ -26,45 +47,130 @@ static int64_t ticks;
 /*! Alarm for sleeping threads */
 static int64_t alarm;
 
-/*! Number of loops per timer tick.  Initialized by timer_calibrate(). */
+/*! Number of loops per timer tick.  Initialized by timer_calibrate(),
+    unless timer_set_loops() already set it. */
 static unsigned loops_per_tick;
 
+/*! Number of loops that loops_from_tsc() times. */
+#define TSC_LOOPS (1u << 16)
+
+/*! TSC counts per timer tick, or 0 if the CPU has no TSC or it has not
+    been calibrated yet.  Initialized by timer_calibrate(). */
+static uint64_t tsc_per_tick;
+
+/*! A timer tick and the TSC value at its start, from which timer_now_ns()
+    counts. */
+static int64_t tsc_base_tick;
+static uint64_t tsc_base;
+
+/*! If true, idle CPUs stop their timer interrupts until something is due.
+    Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
 static intr_handler_func timer_interrupt;
+static intr_handler_func lapic_timer_interrupt;
+static void calibrate_tsc(void);
+static unsigned loops_from_tsc(void);
+static void calibrate_loops(void);
 static bool too_many_loops(unsigned loops);
 static void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
 static void real_time_delay(int64_t num, int32_t denom);
 
 /*! Sets up the timer to interrupt TIMER_FREQ times per second,
-    and registers the corresponding interrupt. */
+    and registers the corresponding interrupt, as well as that of the
+    local APIC timers, if any. */
 void timer_init(void) {
     pit_configure_channel(0, 2, TIMER_FREQ);
     intr_register_ext(0x20, timer_interrupt, "8254 Timer");
+    intr_register_ext(LAPIC_VEC_TIMER, lapic_timer_interrupt, "APIC timer");
+    intr_register_deferred(0x20, thread_tick_deferred);
+    intr_register_deferred(LAPIC_VEC_TIMER, thread_tick_deferred);
 }
 
-/*! Calibrates loops_per_tick, used to implement brief delays. */
-void timer_calibrate(void) {
-    unsigned high_bit, test_bit;
+/*! Makes the bootstrap processor tick from its local APIC timer, which
+    must be calibrated, instead of the 8254, which cannot be told to
+    interrupt just once at an arbitrary time. */
+void timer_use_lapic(void) {
+    enum intr_level old_level = intr_disable();
+    intr_mask_ext(0x20, true);
+    lapic_timer_start();
+    intr_set_level(old_level);
+}
 
-    ASSERT(intr_get_level() == INTR_ON);
-    printf("Calibrating timer...  ");
+/*! Called by the current CPU's idle thread, with interrupts off, just
+    before it waits for an interrupt.  Under "-tickless", stops the CPU's
+    timer interrupts until the next sleeping thread is due, if there is
+    nothing else for a timer interrupt to do.  The interrupt that ends the
+    wait restarts them, through timer_restart_ticks(). */
+void timer_stop_ticks(void) {
+    struct cpu *c = cpu_current();
+    int64_t wait = INT64_MAX;
+    int i;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (!timer_tickless || c->ticks_stopped)
+        return;
+
+    /* Busy CPUs need the bootstrap processor's ticks to keep time, and
+       idle ones with stopped timers would not steal work from them. */
+    for (i = 0; i < cpu_cnt; i++)
+        if (cpus[i].current != cpus[i].idle || cpus[i].ready_cnt > 0)
+            return;
+
+    /* thread_tick() wakes sleepers at the first tick past their alarm. */
+    if (c->id == 0 && alarm != 0)
+        wait = alarm + 1 - ticks;
+    if (wait <= 1)
+        return;
+
+    lapic_timer_oneshot(wait);
+    c->ticks_stopped = true;
+}
 
-    /* Approximate loops_per_tick as the largest power-of-two
-       still less than one timer tick. */
-    loops_per_tick = 1u << 10;
-    while (!too_many_loops (loops_per_tick << 1)) {
-        loops_per_tick <<= 1;
-        ASSERT(loops_per_tick != 0);
-    }
+/*! Restarts the current CPU's timer interrupts, if timer_stop_ticks()
+    stopped them, and accounts for the ticks missed in the meantime.
+    Interrupts must be off. */
+void timer_restart_ticks(void) {
+    struct cpu *c = cpu_current();
+    int64_t missed;
 
-    /* Refine the next 8 bits of loops_per_tick. */
-    high_bit = loops_per_tick;
-    for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1) {
-        if (!too_many_loops(high_bit | test_bit))
-            loops_per_tick |= test_bit;
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (!c->ticks_stopped)
+        return;
+    c->ticks_stopped = false;
+
+    for (missed = lapic_timer_resume(); missed > 0; missed--) {
+        if (c->id == 0)
+            ticks++;
+        thread_tick_missed();
     }
+}
 
-    printf("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+/*! Sets loops_per_tick to LOOPS, as printed by an earlier
+    timer_calibrate(), so that timer_calibrate() need not measure it.
+    Controlled by kernel command-line option "-loops". */
+void timer_set_loops(unsigned loops) {
+    loops_per_tick = loops;
+}
+
+/*! Calibrates loops_per_tick, used to implement brief delays, and the
+    TSC, if any. */
+void timer_calibrate(void) {
+    ASSERT(intr_get_level() == INTR_ON);
+    printf("Calibrating timer...  ");
+
+    if (cpu_has(CPUID_TSC))
+        calibrate_tsc();
+    if (loops_per_tick == 0 && tsc_per_tick != 0)
+        loops_per_tick = loops_from_tsc();
+    if (loops_per_tick == 0)
+        calibrate_loops();
+
+    printf("%'"PRIu64" loops/s (%u loops/tick).\n",
+           (uint64_t) loops_per_tick * TIMER_FREQ, loops_per_tick);
 }
 
 /*! Get the alarm */
@@ -91,6 +197,27 @@ int64_t timer_elapsed(int64_t then) {
     return timer_ticks() - then;
 }
 
+/*! Returns the number of nanoseconds since the OS booted.  The result is
+    as precise as the TSC allows, once timer_calibrate() has measured it;
+    otherwise, or without a TSC, it only advances a timer tick at a time. */
+int64_t timer_now_ns(void) {
+    if (tsc_per_tick == 0)
+        return timer_ticks() * TIMER_NS_PER_TICK;
+    return (tsc_base_tick * TIMER_NS_PER_TICK
+            + timer_tsc_to_ns(rdtsc() - tsc_base));
+}
+
+/*! Returns the number of nanoseconds that the TSC takes to count COUNTS,
+    or -1 if timer_calibrate() has not measured its rate. */
+int64_t timer_tsc_to_ns(uint64_t counts) {
+    if (tsc_per_tick == 0)
+        return -1;
+
+    /* Convert whole ticks and the rest separately to avoid overflow. */
+    return (counts / tsc_per_tick * TIMER_NS_PER_TICK
+            + counts % tsc_per_tick * TIMER_NS_PER_TICK / tsc_per_tick);
+}
+
 /*! Sleeps for approximately TICKS timer ticks.  Interrupts must
     be turned on. */
 void timer_sleep(int64_t ticks) {
@@ -152,13 +279,87 @@ void timer_ndelay(int64_t ns) {
 
 /*! Prints timer statistics. */
 void timer_print_stats(void) {
-    printf("Timer: %"PRId64" ticks\n", timer_ticks());
+    int64_t now = timer_now_ns();
+
+    printf("Timer: %"PRId64" ticks, %"PRId64".%06"PRId64" s since boot\n",
+           timer_ticks(), now / 1000000000, now / 1000 % 1000000);
 }
 
-/*! Timer interrupt handler. */
-static void timer_interrupt(struct intr_frame *args UNUSED) {
+/*! Timer interrupt handler.  Waking sleeping threads and the like is
+    left to deferred work, thread_tick_deferred(). */
+static void timer_interrupt(struct intr_frame *args) {
     ticks++;
     thread_tick();
+    intr_defer(args->vec_no);
+}
+
+/*! Local APIC timer interrupt handler.  The bootstrap processor takes
+    these only under "-tickless". */
+static void lapic_timer_interrupt(struct intr_frame *args) {
+    lapic_timer_tick();
+    if (cpu_current()->id == 0)
+        ticks++;
+    thread_tick();
+    intr_defer(args->vec_no);
+}
+
+/*! Measures tsc_per_tick over one timer tick. */
+static void calibrate_tsc(void) {
+    int64_t start = ticks;
+    uint64_t tsc;
+
+    /* Start counting at the start of a tick. */
+    while (ticks == start)
+        barrier();
+    tsc = rdtsc();
+    start = ticks;
+    while (ticks == start)
+        barrier();
+
+    tsc_base = rdtsc();
+    tsc_base_tick = ticks;
+    tsc_per_tick = tsc_base - tsc;
+}
+
+/*! Returns the number of loops per timer tick, going by how many TSC
+    counts TSC_LOOPS loops take.  The TSC must be calibrated. */
+static unsigned loops_from_tsc(void) {
+    enum intr_level old_level;
+    uint64_t start, counts, best = UINT64_MAX;
+    int i;
+
+    /* Take the fastest of a few tries, none of them interrupted. */
+    old_level = intr_disable();
+    for (i = 0; i < 3; i++) {
+        start = rdtsc();
+        busy_wait(TSC_LOOPS);
+        counts = rdtsc() - start;
+        if (counts < best)
+            best = counts;
+    }
+    intr_set_level(old_level);
+
+    return TSC_LOOPS * tsc_per_tick / (best != 0 ? best : 1);
+}
+
+/*! Calibrates loops_per_tick by trial, against the timer tick. */
+static void calibrate_loops(void) {
+    unsigned high_bit, test_bit;
+
+    /* Approximate loops_per_tick as the largest power-of-two
+       still less than one timer tick. */
+    loops_per_tick = 1u << 10;
+    while (!too_many_loops (loops_per_tick << 1)) {
+        loops_per_tick <<= 1;
+        ASSERT(loops_per_tick != 0);
+    }
+
+    /* Refine the next 8 bits of loops_per_tick. */
+    high_bit = loops_per_tick;
+    for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1) {
+        if (!too_many_loops(high_bit | test_bit))
+            loops_per_tick |= test_bit;
+    }
 }
 
 /*! Returns true if LOOPS iterations waits for more than one timer tick,
@@ -215,6 +416,14 @@ static void real_time_delay(int64_t num, int32_t denom) {
     /* Scale the numerator and denominator down by 1000 to avoid
        the possibility of overflow. */
     ASSERT(denom % 1000 == 0);
-    busy_wait(loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
+    if (tsc_per_tick != 0) {
+        uint64_t start = rdtsc();
+        uint64_t counts = tsc_per_tick * num / 1000 * TIMER_FREQ
+                          / (denom / 1000);
+        while (rdtsc() - start < counts)
+            asm volatile ("pause");
+    }
+    else
+        busy_wait(loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
 }
 
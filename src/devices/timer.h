@@ -2,16 +2,32 @@
 #define DEVICES_TIMER_H
 
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /*! Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/*! Nanoseconds per timer tick. */
+#define TIMER_NS_PER_TICK (1000 * 1000 * 1000 / TIMER_FREQ)
+
+/*! If true, idle CPUs stop their timer interrupts until something is
+    due.  Controlled by kernel command-line option "-tickless". */
+extern bool timer_tickless;
+
 void timer_init(void);
+void timer_set_loops(unsigned loops);
 void timer_calibrate(void);
+void timer_use_lapic(void);
+
+/* Stopping the timer on idle CPUs. */
+void timer_stop_ticks(void);
+void timer_restart_ticks(void);
 
 int64_t timer_ticks(void);
 int64_t timer_elapsed(int64_t);
+int64_t timer_now_ns(void);
+int64_t timer_tsc_to_ns(uint64_t counts);
 
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep(int64_t ticks);
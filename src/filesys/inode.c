@@ -6,6 +6,12 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#ifdef USERPROG
+#include "userprog/elfcache.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /*! Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -276,6 +282,18 @@ off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size, off_t
     }
     free(bounce);
 
+#ifdef USERPROG
+    /* Any parsed image of this executable is now stale. */
+    if (bytes_written > 0)
+        elf_cache_invalidate(inode);
+#endif
+#ifdef VM
+    /* Keep mapped and prefetched copies of the data current. */
+    if (bytes_written > 0)
+        frame_inode_write(inode, buffer, bytes_written,
+                          offset - bytes_written);
+#endif
+
     return bytes_written;
 }
 
@@ -295,6 +313,11 @@ void inode_allow_write (struct inode *inode) {
     inode->deny_write_cnt--;
 }
 
+/*! Returns true if writes to INODE are denied. */
+bool inode_is_write_denied(const struct inode *inode) {
+    return inode->deny_write_cnt > 0;
+}
+
 /*! Returns the length, in bytes, of INODE's data. */
 off_t inode_length(const struct inode *inode) {
     return inode->data.length;
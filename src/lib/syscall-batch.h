@@ -0,0 +1,40 @@
+/*! \file syscall-batch.h
+ *
+ * Layout of the batch ring, a page shared between a user process and the
+ * kernel through which the process queues system calls to be carried out
+ * together by a single SYS_BATCH call.
+ *
+ * The process fills in the entry at index SQ_TAIL (modulo BATCH_ENTRIES)
+ * and then advances SQ_TAIL.  SYS_BATCH carries out the entries from
+ * SQ_HEAD up to SQ_TAIL in order, storing each call's return value in its
+ * entry's RESULT and advancing SQ_HEAD past it.  An entry's result stays
+ * valid until BATCH_ENTRIES more calls have been queued.
+ */
+
+#ifndef __LIB_SYSCALL_BATCH_H
+#define __LIB_SYSCALL_BATCH_H
+
+#include <stdint.h>
+
+/*! Number of entries in the batch ring. */
+#define BATCH_ENTRIES 128
+
+/*! A queued system call. */
+struct batch_entry {
+    int nr;                     /*!< System call number, a SYS_* value. */
+    uint32_t args[4];           /*!< Arguments. */
+    int result;                 /*!< Return value, once carried out. */
+};
+
+/*! The batch ring. */
+struct batch_ring {
+    unsigned sq_head;           /*!< Next entry to carry out. */
+    unsigned sq_tail;           /*!< Next entry to fill in. */
+    struct batch_entry entries[BATCH_ENTRIES];
+};
+
+/*! User virtual address at which every process finds its batch ring: the
+    page just below the executable. */
+#define BATCH_RING ((struct batch_ring *) 0x08047000)
+
+#endif /* lib/syscall-batch.h */
@@ -34,7 +34,25 @@ enum {
     SYS_MKDIR,                  /*!< Create a directory. */
     SYS_READDIR,                /*!< Reads a directory entry. */
     SYS_ISDIR,                  /*!< Tests if a fd represents a directory. */
-    SYS_INUMBER                 /*!< Returns the inode number for a fd. */
+    SYS_INUMBER,                /*!< Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,                   /*!< Clone this process. */
+    SYS_BATCH,                  /*!< Run the calls queued in the batch ring. */
+    SYS_READV,                  /*!< Read from a file into several buffers. */
+    SYS_WRITEV,                 /*!< Write to a file from several buffers. */
+    SYS_PREAD,                  /*!< Read from a file at a given offset. */
+    SYS_PWRITE,                 /*!< Write to a file at a given offset. */
+    SYS_PIPE,                   /*!< Create a pipe. */
+    SYS_SHM_CREATE,             /*!< Create a shared memory segment. */
+    SYS_SHM_ATTACH,             /*!< Map a shared memory segment. */
+    SYS_SHM_DETACH,             /*!< Unmap a shared memory segment. */
+    SYS_FUTEX_WAIT,             /*!< Sleep on a word of memory. */
+    SYS_FUTEX_WAKE,             /*!< Wake threads sleeping on a word. */
+    SYS_THREAD_CREATE,          /*!< Start a thread in this process. */
+    SYS_THREAD_JOIN,            /*!< Wait for a thread to exit. */
+    SYS_THREAD_EXIT,            /*!< Terminate this thread. */
+    SYS_CLOCK_GETTIME           /*!< Read a clock. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,23 @@
+/*! \file time.h
+ *
+ * Clocks for the clock_gettime() system call, shared by the kernel and
+ * user programs.
+ */
+
+#ifndef __LIB_TIME_H
+#define __LIB_TIME_H
+
+#include <stdint.h>
+
+/*! Clocks.  @{ */
+#define CLOCK_REALTIME 0        /*!< Time since the Unix epoch. */
+#define CLOCK_MONOTONIC 1       /*!< Time since boot. */
+/*! @} */
+
+/*! A time, in seconds and nanoseconds. */
+struct timespec {
+    int64_t tv_sec;             /*!< Seconds. */
+    int32_t tv_nsec;            /*!< Nanoseconds, 0 to 999,999,999. */
+};
+
+#endif /* lib/time.h */
@@ -0,0 +1,21 @@
+/*! \file uio.h
+ *
+ * Buffer descriptors for the vectored I/O system calls, readv() and
+ * writev(), shared by the kernel and user programs.
+ */
+
+#ifndef __LIB_UIO_H
+#define __LIB_UIO_H
+
+#include <stddef.h>
+
+/*! One buffer of a vectored read or write. */
+struct iovec {
+    void *iov_base;             /*!< Start of the buffer. */
+    size_t iov_len;             /*!< Length of the buffer in bytes. */
+};
+
+/*! Maximum number of buffers in one readv() or writev(). */
+#define IOV_MAX 32
+
+#endif /* lib/uio.h */
@@ -4,6 +4,7 @@ int main(int, char *[]);
 void _start(int argc, char *argv[]);
 
 void _start(int argc, char *argv[]) {
+    use_sysenter(true);
     exit(main(argc, argv));
 }
 
@@ -0,0 +1,101 @@
+/*! \file synch.c
+ *
+ * Mutexes and condition variables built on futex_wait() and futex_wake().
+ * An uncontended mutex is taken and released with a single atomic
+ * instruction each, without entering the kernel.  The mutex follows
+ * "mutex3" in Ulrich Drepper's "Futexes Are Tricky".
+ */
+
+#include "synch.h"
+#include <limits.h>
+#include <syscall.h>
+
+/*! Stores NEW in *P if *P equals OLD.  Returns the previous value of
+    *P. */
+static inline int cmpxchg(int *p, int old, int new) {
+    int prev;
+    asm volatile ("lock cmpxchgl %2, %1"
+                  : "=a" (prev), "+m" (*p) : "r" (new), "0" (old)
+                  : "memory");
+    return prev;
+}
+
+/*! Stores NEW in *P and returns the previous value of *P. */
+static inline int xchg(int *p, int new) {
+    asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+    return new;
+}
+
+/*! Adds DELTA to *P and returns the previous value of *P. */
+static inline int fetch_add(int *p, int delta) {
+    asm volatile ("lock xaddl %0, %1" : "+r" (delta), "+m" (*p) : : "memory");
+    return delta;
+}
+
+/*! Initializes M as unlocked. */
+void mutex_init(struct mutex *m) {
+    m->state = 0;
+}
+
+/*! Acquires M, sleeping until it is available if necessary. */
+void mutex_lock(struct mutex *m) {
+    int c = cmpxchg(&m->state, 0, 1);
+
+    if (c != 0) {
+        /* Mark the mutex contended, so that its holder wakes us. */
+        if (c != 2)
+            c = xchg(&m->state, 2);
+        while (c != 0) {
+            futex_wait(&m->state, 2);
+            c = xchg(&m->state, 2);
+        }
+    }
+}
+
+/*! Acquires M if it is available, without sleeping.  Returns true if
+    successful. */
+bool mutex_trylock(struct mutex *m) {
+    return cmpxchg(&m->state, 0, 1) == 0;
+}
+
+/*! Releases M, which the caller must hold, and wakes one of its waiters,
+    if it has any. */
+void mutex_unlock(struct mutex *m) {
+    if (fetch_add(&m->state, -1) != 1) {
+        m->state = 0;
+        futex_wake(&m->state, 1);
+    }
+}
+
+/*! Initializes C. */
+void condvar_init(struct condvar *c) {
+    c->seq = 0;
+}
+
+/*! Atomically releases M, which the caller must hold, and waits for C to
+    be signaled, then reacquires M.  Like any condition variable, C may
+    wake up the caller without being signaled, so the caller must recheck
+    its condition. */
+void condvar_wait(struct condvar *c, struct mutex *m) {
+    int seq = c->seq;
+
+    mutex_unlock(m);
+    futex_wait(&c->seq, seq);
+
+    /* Others may have been woken along with us, so take M as contended
+       to make sure the last of us to release it wakes any waiter. */
+    while (xchg(&m->state, 2) != 0)
+        futex_wait(&m->state, 2);
+}
+
+/*! Wakes one thread waiting on C, if there is one. */
+void condvar_signal(struct condvar *c) {
+    fetch_add(&c->seq, 1);
+    futex_wake(&c->seq, 1);
+}
+
+/*! Wakes all threads waiting on C. */
+void condvar_broadcast(struct condvar *c) {
+    fetch_add(&c->seq, 1);
+    futex_wake(&c->seq, INT_MAX);
+}
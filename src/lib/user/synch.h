@@ -0,0 +1,33 @@
+#ifndef __LIB_USER_SYNCH_H
+#define __LIB_USER_SYNCH_H
+
+#include <stdbool.h>
+
+/*! A mutex that enters the kernel only to wait for it or to hand it to a
+    waiter.  STATE is 0 if unlocked, 1 if locked, and 2 if locked and
+    there may be waiters. */
+struct mutex {
+    int state;
+};
+
+#define MUTEX_INITIALIZER { 0 }
+
+void mutex_init(struct mutex *);
+void mutex_lock(struct mutex *);
+bool mutex_trylock(struct mutex *);
+void mutex_unlock(struct mutex *);
+
+/*! A condition variable for use with struct mutex.  SEQ changes every
+    time the condition is signaled. */
+struct condvar {
+    int seq;
+};
+
+#define CONDVAR_INITIALIZER { 0 }
+
+void condvar_init(struct condvar *);
+void condvar_wait(struct condvar *, struct mutex *);
+void condvar_signal(struct condvar *);
+void condvar_broadcast(struct condvar *);
+
+#endif /* lib/user/synch.h */
@@ -1,26 +1,43 @@
 /*! \file syscall.c
  *
  * User-space wrappers for invoking system calls through the standard UNIX
- * APIs.  Four macros are defined, syscall0(), syscall1(), syscall2(), and
- * syscall3(), to pass the corresponding number of arguments to the system
- * call being invoked.  The remaining functions are wrappers for standard
- * UNIX operations, which simply use the syscall macros to invoke the
- * system call.
+ * APIs.  Five macros are defined, syscall0() through syscall4(), to pass
+ * the corresponding number of arguments to the system call being invoked.
+ * The remaining functions are wrappers for standard UNIX operations, which
+ * simply use the syscall macros to invoke the system call.
  */
 
 #include <syscall.h>
+#include <uio.h>
+#include "../syscall-batch.h"
 #include "../syscall-nr.h"
 
+/*! Whether system calls enter the kernel through SYSENTER rather than
+    `int $0x30'.  See use_sysenter(). */
+static bool fast_syscalls;
+
+/*! Enters the kernel to carry out the system call whose number and
+    arguments have been pushed on the stack, through SYSENTER if
+    fast_syscalls is set, otherwise through `int $0x30'.  SYSENTER takes our
+    stack pointer in %ecx and the address to return to in %edx; SYSEXIT
+    comes back there with neither preserved. */
+#define SYSCALL_ENTER                                           \
+        "cmpb $0, %[fast]; je 1f; "                             \
+        "movl %%esp, %%ecx; movl $2f, %%edx; sysenter; "        \
+        "1: int $0x30; 2: "
+
 /*! Invokes syscall NUMBER, passing no arguments, and returns the
     return value as an `int'. */
 #define syscall0(NUMBER)                                        \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
-            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
+            ("pushl %[number]; " SYSCALL_ENTER                  \
+             "addl $4, %%esp"                                   \
                : "=a" (retval)                                  \
-               : [number] "i" (NUMBER)                          \
-               : "memory");                                     \
+               : [number] "i" (NUMBER),                         \
+                 [fast] "m" (fast_syscalls)                     \
+               : "ecx", "edx", "cc", "memory");                 \
           retval;                                               \
         })
 
@@ -30,11 +47,13 @@
         ({                                                               \
           int retval;                                                    \
           asm volatile                                                   \
-            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
+            ("pushl %[arg0]; pushl %[number]; " SYSCALL_ENTER            \
+             "addl $8, %%esp"                                            \
                : "=a" (retval)                                           \
                : [number] "i" (NUMBER),                                  \
-                 [arg0] "g" (ARG0)                                       \
-               : "memory");                                              \
+                 [arg0] "g" (ARG0),                                      \
+                 [fast] "m" (fast_syscalls)                              \
+               : "ecx", "edx", "cc", "memory");                          \
           retval;                                                        \
         })
 
@@ -45,12 +64,14 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg1]; pushl %[arg0]; "                   \
-             "pushl %[number]; int $0x30; addl $12, %%esp"      \
+             "pushl %[number]; " SYSCALL_ENTER                  \
+             "addl $12, %%esp"                                  \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
-                 [arg1] "r" (ARG1)                              \
-               : "memory");                                     \
+                 [arg1] "r" (ARG1),                             \
+                 [fast] "m" (fast_syscalls)                     \
+               : "ecx", "edx", "cc", "memory");                 \
           retval;                                               \
         })
 
@@ -61,16 +82,65 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "    \
-             "pushl %[number]; int $0x30; addl $16, %%esp"      \
+             "pushl %[number]; " SYSCALL_ENTER                  \
+             "addl $16, %%esp"                                  \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1),                             \
-                 [arg2] "r" (ARG2)                              \
-               : "memory");                                     \
+                 [arg2] "r" (ARG2),                             \
+                 [fast] "m" (fast_syscalls)                     \
+               : "ecx", "edx", "cc", "memory");                 \
           retval;                                               \
         })
 
+/*! Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2, and
+    ARG3, and returns the return value as an `int'.  Four arguments
+    in registers would leave too few for the compiler, so they are
+    pushed from an array. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          int args_[4] = { (int) (ARG0), (int) (ARG1),          \
+                           (int) (ARG2), (int) (ARG3) };        \
+          asm volatile                                          \
+            ("pushl 12(%[args]); pushl 8(%[args]); "            \
+             "pushl 4(%[args]); pushl (%[args]); "              \
+             "pushl %[number]; " SYSCALL_ENTER                  \
+             "addl $20, %%esp"                                  \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [args] "r" (args_),                            \
+                 [fast] "m" (fast_syscalls)                     \
+               : "ecx", "edx", "cc", "memory");                 \
+          retval;                                               \
+        })
+
+/*! Returns true if the CPU supports SYSENTER, in which case the kernel
+    accepts system calls through it. */
+static bool sysenter_supported(void) {
+    unsigned eax, ebx, ecx, edx;
+    unsigned family, model, stepping;
+
+    asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                 : "a" (1), "c" (0));
+    family = (eax >> 8) & 0xf;
+    model = (eax >> 4) & 0xf;
+    stepping = eax & 0xf;
+
+    /* Early Pentium Pros claim SYSENTER but do not implement it. */
+    return (edx & 0x800) != 0 && !(family == 6 && model < 3 && stepping < 3);
+}
+
+/*! Makes system calls enter the kernel through SYSENTER if ENABLE is true
+    and the CPU supports it, and through `int $0x30' otherwise.  Returns
+    true if SYSENTER is now in use.  User programs start out using it
+    wherever it is available. */
+bool use_sysenter(bool enable) {
+    fast_syscalls = enable && sysenter_supported();
+    return fast_syscalls;
+}
+
 void halt(void) {
     syscall0(SYS_HALT);
     NOT_REACHED();
@@ -153,3 +223,104 @@ int inumber(int fd) {
     return syscall1(SYS_INUMBER, fd);
 }
 
+pid_t fork(void) {
+    return (pid_t) syscall0(SYS_FORK);
+}
+
+int readv(int fd, const struct iovec *iov, int iovcnt) {
+    return syscall3(SYS_READV, fd, iov, iovcnt);
+}
+
+int writev(int fd, const struct iovec *iov, int iovcnt) {
+    return syscall3(SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int pread(int fd, void *buffer, unsigned length, unsigned offset) {
+    return syscall4(SYS_PREAD, fd, buffer, length, offset);
+}
+
+int pwrite(int fd, const void *buffer, unsigned length, unsigned offset) {
+    return syscall4(SYS_PWRITE, fd, buffer, length, offset);
+}
+
+int pipe(int fds[2]) {
+    return syscall1(SYS_PIPE, fds);
+}
+
+bool shm_create(const char *name, unsigned size, void *addr) {
+    return syscall3(SYS_SHM_CREATE, name, size, addr);
+}
+
+int shm_attach(const char *name, void *addr) {
+    return syscall2(SYS_SHM_ATTACH, name, addr);
+}
+
+void shm_detach(void *addr) {
+    syscall1(SYS_SHM_DETACH, addr);
+}
+
+int futex_wait(int *addr, int expected) {
+    return syscall2(SYS_FUTEX_WAIT, addr, expected);
+}
+
+int futex_wake(int *addr, int n) {
+    return syscall2(SYS_FUTEX_WAKE, addr, n);
+}
+
+/*! Where a thread started by thread_create() begins: calls FUNC(AUX), then
+    ends the thread. */
+static void NO_RETURN thread_start(void (*func)(void *), void *aux) {
+    func(aux);
+    thread_exit();
+}
+
+tid_t thread_create(void (*func)(void *), void *aux) {
+    return (tid_t) syscall3(SYS_THREAD_CREATE, thread_start, func, aux);
+}
+
+int thread_join(tid_t tid) {
+    return syscall1(SYS_THREAD_JOIN, tid);
+}
+
+void thread_exit(void) {
+    syscall0(SYS_THREAD_EXIT);
+    NOT_REACHED();
+}
+
+int clock_gettime(int clock, struct timespec *ts) {
+    return syscall2(SYS_CLOCK_GETTIME, clock, ts);
+}
+
+/*! Queues system call NR, with arguments ARG0 through ARG3, in the batch
+    ring, to be carried out by the next syscall_batch().  Returns a ticket
+    for batch_result(), or -1 if the ring is full. */
+int batch_submit(int nr, int arg0, int arg1, int arg2, int arg3) {
+    struct batch_ring *ring = BATCH_RING;
+    unsigned tail = ring->sq_tail;
+    struct batch_entry *e;
+
+    if (tail - ring->sq_head >= BATCH_ENTRIES)
+        return -1;
+
+    e = &ring->entries[tail % BATCH_ENTRIES];
+    e->nr = nr;
+    e->args[0] = arg0;
+    e->args[1] = arg1;
+    e->args[2] = arg2;
+    e->args[3] = arg3;
+    ring->sq_tail = tail + 1;
+    return tail & 0x7fffffff;
+}
+
+/*! Carries out the system calls queued with batch_submit(), in order, with
+    a single entry into the kernel.  Returns the number carried out. */
+int syscall_batch(void) {
+    return syscall0(SYS_BATCH);
+}
+
+/*! Returns the return value of the call queued as TICKET, which must have
+    been carried out.  It is available until the ring has wrapped around. */
+int batch_result(int ticket) {
+    return BATCH_RING->entries[ticket % BATCH_ENTRIES].result;
+}
+
@@ -4,10 +4,17 @@
 #include <stdbool.h>
 #include <debug.h>
 
+struct iovec;
+struct timespec;
+
 /*! Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
+/*! Thread identifier. */
+typedef int tid_t;
+#define TID_ERROR ((tid_t) -1)
+
 /*! Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
@@ -45,5 +52,26 @@ bool readdir(int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir(int fd);
 int inumber(int fd);
 
+/* Extensions. */
+pid_t fork(void);
+bool use_sysenter(bool enable);
+int batch_submit(int nr, int arg0, int arg1, int arg2, int arg3);
+int syscall_batch(void);
+int readv(int fd, const struct iovec *, int iovcnt);
+int writev(int fd, const struct iovec *, int iovcnt);
+int pread(int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite(int fd, const void *buffer, unsigned length, unsigned offset);
+int pipe(int fds[2]);
+bool shm_create(const char *name, unsigned size, void *addr);
+int shm_attach(const char *name, void *addr);
+void shm_detach(void *addr);
+int futex_wait(int *addr, int expected);
+int futex_wake(int *addr, int n);
+tid_t thread_create(void (*func)(void *), void *aux);
+int thread_join(tid_t);
+void thread_exit(void) NO_RETURN;
+int clock_gettime(int clock, struct timespec *);
+int batch_result(int ticket);
+
 #endif /* lib/user/syscall.h */
 
@@ -33,6 +33,25 @@ sub check_expected {
     compare_output ("run", @options, \@output, $expected);
 }
 
+# Checks the output of a benchmark.  Its timings vary from run to run, so
+# just makes sure that a line matching each of @PATTERNS was reported,
+# and that the test ran to the end.
+sub check_timings {
+    my (@patterns) = @_;
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+    @output = get_core_output ("run", @output);
+
+    my ($name) = $test =~ m%([^/]+)$%;
+    foreach my $pattern (@patterns) {
+	fail "missing line matching \"$pattern\" in output\n"
+	  unless grep (/^\($name\) $pattern$/, @output);
+    }
+    fail "missing end of test in output\n"
+      unless grep ($_ eq "($name) end", @output);
+    pass;
+}
+
 sub common_checks {
     my ($run, @output) = @_;
 
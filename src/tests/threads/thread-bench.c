@@ -0,0 +1,46 @@
+/* Measures how fast threads can be created and destroyed.  Each
+   thread is created at a higher priority than the main thread, so
+   it runs and exits before thread_create() returns, and its page
+   is free again for the next one. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define ITERS 10000             /* Threads created. */
+
+static thread_func exit_thread;
+
+void
+test_thread_bench (void) 
+{
+  int64_t start_ns, ns;
+  uint64_t start;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  start_ns = timer_now_ns ();
+  start = rdtsc ();
+  for (i = 0; i < ITERS; i++)
+    if (thread_create ("bench", PRI_DEFAULT + 1, exit_thread, NULL)
+        == TID_ERROR)
+      fail ("thread_create failed after %d threads", i);
+  msg ("%llu cycles per thread", (rdtsc () - start) / ITERS);
+
+  ns = timer_now_ns () - start_ns;
+  if (ns > 0)
+    msg ("%lld threads per second", ITERS * 1000000000LL / ns);
+  else
+    msg ("more than %d threads per second", ITERS * TIMER_FREQ);
+}
+
+static void 
+exit_thread (void *aux UNUSED) 
+{
+}
@@ -0,0 +1,5 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_timings ('\d+ cycles per thread', '(more than )?\d+ threads per second');
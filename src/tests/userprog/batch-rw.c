@@ -0,0 +1,42 @@
+/* Queues a write, a seek, a read, and a tell on a file in the
+   batch ring, along with a fork, which cannot be batched.  Runs
+   them all with one syscall_batch() and checks the results. */
+
+#include <string.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  int size = sizeof sample - 1;
+  int fd, write_tk, read_tk, tell_tk, fork_tk;
+
+  CHECK (create ("batch.txt", size), "create \"batch.txt\"");
+  CHECK ((fd = open ("batch.txt")) > 1, "open \"batch.txt\"");
+
+  write_tk = batch_submit (SYS_WRITE, fd, (int) sample, size, 0);
+  batch_submit (SYS_SEEK, fd, 0, 0, 0);
+  read_tk = batch_submit (SYS_READ, fd, (int) buf, size, 0);
+  tell_tk = batch_submit (SYS_TELL, fd, 0, 0, 0);
+  fork_tk = batch_submit (SYS_FORK, 0, 0, 0, 0);
+  CHECK (syscall_batch () == 5, "run batch of 5 calls");
+
+  if (batch_result (write_tk) != size)
+    fail ("write returned %d instead of %d", batch_result (write_tk), size);
+  if (batch_result (read_tk) != size)
+    fail ("read returned %d instead of %d", batch_result (read_tk), size);
+  if (batch_result (tell_tk) != size)
+    fail ("tell returned %d instead of %d", batch_result (tell_tk), size);
+  if (batch_result (fork_tk) != -1)
+    fail ("batched fork returned %d", batch_result (fork_tk));
+  if (memcmp (buf, sample, size))
+    fail ("read back data differs from data written");
+  msg ("results correct");
+
+  CHECK (syscall_batch () == 0, "run empty batch");
+}
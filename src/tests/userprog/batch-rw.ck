@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(batch-rw) begin
+(batch-rw) create "batch.txt"
+(batch-rw) open "batch.txt"
+(batch-rw) run batch of 5 calls
+(batch-rw) results correct
+(batch-rw) run empty batch
+(batch-rw) end
+batch-rw: exit(0)
+EOF
+pass;
@@ -0,0 +1,22 @@
+/* Child process run by smp-scale tests.
+   Spins for a fixed number of iterations without making system
+   calls, then exits with the number passed as its first
+   command-line argument. */
+
+#include <stdlib.h>
+#include "tests/lib.h"
+
+#define SPIN_ITERS 20000000     /* Loop iterations. */
+
+const char *test_name = "child-spin";
+
+int
+main (int argc UNUSED, char *argv[])
+{
+  volatile unsigned counter = 0;
+  unsigned i;
+
+  for (i = 0; i < SPIN_ITERS; i++)
+    counter++;
+  return atoi (argv[1]);
+}
@@ -0,0 +1,42 @@
+/* Reads the monotonic and real-time clocks through clock_gettime()
+   and checks that the times are well formed, that the monotonic
+   clock does not go backward, and that unknown clocks are
+   rejected. */
+
+#include <syscall.h>
+#include <time.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Returns TS in nanoseconds. */
+static int64_t
+ts_to_ns (const struct timespec *ts)
+{
+  return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+void
+test_main (void)
+{
+  struct timespec before, after;
+  int i;
+
+  CHECK (clock_gettime (CLOCK_MONOTONIC, &before) == 0,
+         "clock_gettime (CLOCK_MONOTONIC)");
+  for (i = 0; i < 1000; i++)
+    close (-1);
+  CHECK (clock_gettime (CLOCK_MONOTONIC, &after) == 0,
+         "clock_gettime (CLOCK_MONOTONIC) again");
+  if (before.tv_nsec < 0 || before.tv_nsec >= 1000000000
+      || after.tv_nsec < 0 || after.tv_nsec >= 1000000000)
+    fail ("tv_nsec out of range");
+  if (ts_to_ns (&after) < ts_to_ns (&before))
+    fail ("monotonic clock went backward");
+
+  CHECK (clock_gettime (CLOCK_REALTIME, &after) == 0,
+         "clock_gettime (CLOCK_REALTIME)");
+  if (after.tv_sec < 946684800)
+    fail ("real-time clock is before 2000");
+
+  CHECK (clock_gettime (-1, &after) == -1, "clock_gettime (-1) fails");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(clock-gettime) begin
+(clock-gettime) clock_gettime (CLOCK_MONOTONIC)
+(clock-gettime) clock_gettime (CLOCK_MONOTONIC) again
+(clock-gettime) clock_gettime (CLOCK_REALTIME)
+(clock-gettime) clock_gettime (-1) fails
+(clock-gettime) end
+clock-gettime: exit(0)
+EOF
+pass;
@@ -0,0 +1,20 @@
+/* Runs child-simple, which leaves its parsed image in the kernel's
+   exec cache, then overwrites the first byte of its ELF header and
+   tries to run it again.  The write must invalidate the cached
+   image, so the second exec must fail. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (wait (exec ("child-simple")) == 81, "run \"child-simple\"");
+  CHECK ((fd = open ("child-simple")) > 1, "open \"child-simple\"");
+  CHECK (write (fd, "X", 1) == 1, "overwrite ELF magic");
+  close (fd);
+  msg ("exec(\"child-simple\"): %d", exec ("child-simple"));
+}
@@ -0,0 +1,38 @@
+/* Passes a short message and a whole page through a pipe, then
+   overwrites the page in place before reading it: the pipe must
+   still deliver what was written.  Once the write end is closed,
+   reading the empty pipe must report end of file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char page[4096] __attribute__ ((aligned (4096)));
+static char buf[4096];
+
+void
+test_main (void) 
+{
+  int fds[2];
+  size_t i;
+
+  CHECK (pipe (fds) == 0, "pipe");
+
+  memset (page, 'a', sizeof page);
+  CHECK (write (fds[1], "hello", 5) == 5, "write message");
+  CHECK (write (fds[1], page, sizeof page) == sizeof page, "write page");
+  memset (page, 'b', sizeof page);
+
+  CHECK (read (fds[0], buf, 5) == 5, "read message");
+  if (memcmp (buf, "hello", 5))
+    fail ("message differs from data written");
+  CHECK (read (fds[0], buf, sizeof buf) == sizeof buf, "read page");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 'a')
+      fail ("page differs from data written at offset %zu", i);
+
+  close (fds[1]);
+  CHECK (read (fds[0], buf, sizeof buf) == 0, "read at end of file");
+  close (fds[0]);
+}
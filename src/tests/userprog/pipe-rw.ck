@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-rw) begin
+(pipe-rw) pipe
+(pipe-rw) write message
+(pipe-rw) write page
+(pipe-rw) read message
+(pipe-rw) read page
+(pipe-rw) read at end of file
+(pipe-rw) end
+pipe-rw: exit(0)
+EOF
+pass;
@@ -0,0 +1,28 @@
+/* Calls pread() and pwrite() with offsets beyond the largest
+   file offset, which must fail instead of reaching sectors
+   outside the file, and checks that the file is unchanged. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char buf[sizeof sample];
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (pread (handle, buf, 16, 0x80000000) == -1,
+         "pread at 0x80000000 fails");
+  CHECK (pwrite (handle, "garbage", 7, 0x80000000) == -1,
+         "pwrite at 0x80000000 fails");
+  CHECK (pwrite (handle, "garbage", 7, 0xfffffff9) == -1,
+         "pwrite at 0xfffffff9 fails");
+  CHECK (pread (handle, buf, sizeof sample - 1, 0) == sizeof sample - 1,
+         "pread whole file");
+  if (memcmp (buf, sample, sizeof sample - 1))
+    fail ("file contents changed");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-large) begin
+(pread-large) open "sample.txt"
+(pread-large) pread at 0x80000000 fails
+(pread-large) pwrite at 0x80000000 fails
+(pread-large) pwrite at 0xfffffff9 fails
+(pread-large) pread whole file
+(pread-large) end
+pread-large: exit(0)
+EOF
+pass;
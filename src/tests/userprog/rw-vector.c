@@ -0,0 +1,52 @@
+/* Writes a header and a payload with one writev(), then checks
+   them with pread(), patches the payload with pwrite(), and reads
+   everything back into two buffers with readv().  The positional
+   calls must leave the file position alone. */
+
+#include <string.h>
+#include <syscall.h>
+#include <uio.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char header[] = "HEADER: ";
+
+void
+test_main (void) 
+{
+  int hsize = sizeof header - 1;
+  int psize = sizeof sample - 1;
+  char hbuf[sizeof header], pbuf[sizeof sample], patch[4];
+  struct iovec iov[2];
+  int fd;
+
+  CHECK (create ("vector.txt", hsize + psize), "create \"vector.txt\"");
+  CHECK ((fd = open ("vector.txt")) > 1, "open \"vector.txt\"");
+
+  iov[0].iov_base = header;
+  iov[0].iov_len = hsize;
+  iov[1].iov_base = sample;
+  iov[1].iov_len = psize;
+  CHECK (writev (fd, iov, 2) == hsize + psize, "writev header and payload");
+  CHECK (tell (fd) == (unsigned) (hsize + psize), "position after writev");
+
+  CHECK (pread (fd, pbuf, psize, hsize) == psize, "pread payload");
+  if (memcmp (pbuf, sample, psize))
+    fail ("pread payload differs from data written");
+
+  CHECK (pwrite (fd, "ZZZZ", 4, hsize) == 4, "pwrite into payload");
+  CHECK (tell (fd) == (unsigned) (hsize + psize),
+         "position unchanged by pread and pwrite");
+
+  seek (fd, 0);
+  iov[0].iov_base = hbuf;
+  iov[1].iov_base = pbuf;
+  CHECK (readv (fd, iov, 2) == hsize + psize, "readv header and payload");
+  memcpy (patch, pbuf, 4);
+  memcpy (pbuf, sample, 4);
+  if (memcmp (hbuf, header, hsize) || memcmp (pbuf, sample, psize)
+      || memcmp (patch, "ZZZZ", 4))
+    fail ("readv data differs from data written");
+  msg ("data correct");
+}
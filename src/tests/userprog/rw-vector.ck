@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rw-vector) begin
+(rw-vector) create "vector.txt"
+(rw-vector) open "vector.txt"
+(rw-vector) writev header and payload
+(rw-vector) position after writev
+(rw-vector) pread payload
+(rw-vector) pwrite into payload
+(rw-vector) position unchanged by pread and pwrite
+(rw-vector) readv header and payload
+(rw-vector) data correct
+(rw-vector) end
+rw-vector: exit(0)
+EOF
+pass;
@@ -0,0 +1,26 @@
+/* Seeks beyond the largest file offset, which must be ignored
+   rather than crash the kernel, then reads from the position the
+   file still has. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char buf[16];
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (read (handle, buf, 1) == 1, "read 1 byte");
+  seek (handle, 0x80000000);
+  CHECK (tell (handle) == 1, "seek to 0x80000000 ignored");
+  seek (handle, 0xffffffff);
+  CHECK (tell (handle) == 1, "seek to 0xffffffff ignored");
+  CHECK (read (handle, buf, sizeof buf) == sizeof buf,
+         "read %zu bytes", sizeof buf);
+  if (buf[0] != sample[1])
+    fail ("read from wrong position");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(seek-large) begin
+(seek-large) open "sample.txt"
+(seek-large) read 1 byte
+(seek-large) seek to 0x80000000 ignored
+(seek-large) seek to 0xffffffff ignored
+(seek-large) read 16 bytes
+(seek-large) end
+seek-large: exit(0)
+EOF
+pass;
@@ -0,0 +1,3 @@
+# -*- perl -*-
+# Same program and checks as smp-scale, run with --smp=4.
+do "tests/userprog/smp-scale.ck" or die "tests/userprog/smp-scale.ck: $@$!\n";
@@ -0,0 +1,55 @@
+/* Measures how CPU-bound user processes scale across CPUs.
+   Times one child-spin process alone, then CHILD_CNT of them at
+   once, each doing the same fixed amount of work.  User code runs
+   without the kernel lock, so with at least CHILD_CNT CPUs the
+   second run should take about as long as the first, and with one
+   CPU about CHILD_CNT times as long.
+
+   Run as smp-scale on one CPU, and as smp-scale-4 with
+   "--smp=4".  Compare the two outputs. */
+
+#include <syscall.h>
+#include <time.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4             /* Processes in the parallel run. */
+
+/* Returns the monotonic clock in milliseconds. */
+static int64_t
+now_ms (void)
+{
+  struct timespec ts;
+
+  if (clock_gettime (CLOCK_MONOTONIC, &ts) != 0)
+    fail ("clock_gettime (CLOCK_MONOTONIC)");
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* Runs CNT child-spin processes at once and returns the elapsed
+   milliseconds until all of them have exited. */
+static int64_t
+run_children (size_t cnt)
+{
+  pid_t pids[CHILD_CNT];
+  int64_t start;
+
+  start = now_ms ();
+  exec_children ("child-spin", pids, cnt);
+  wait_children (pids, cnt);
+  return now_ms () - start;
+}
+
+void
+test_main (void)
+{
+  int64_t one_ms, all_ms;
+
+  quiet = true;
+  one_ms = run_children (1);
+  all_ms = run_children (CHILD_CNT);
+  quiet = false;
+
+  msg ("1 process: %lld ms", one_ms);
+  msg ("%d processes: %lld ms", CHILD_CNT, all_ms);
+}
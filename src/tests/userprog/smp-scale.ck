@@ -0,0 +1,5 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_timings ('1 process: \d+ ms', '\d+ processes: \d+ ms');
@@ -0,0 +1,39 @@
+/* Measures, in CPU cycles, the latency of a null system call
+   entering the kernel through `int $0x30' and through SYSENTER. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ITERS 10000             /* Calls timed on each path. */
+
+/* Returns the average cycles taken by a null system call:
+   closing a descriptor that is not open. */
+static uint64_t
+time_null_syscall (void)
+{
+  uint64_t start;
+  int i;
+
+  close (-1);
+  start = rdtsc ();
+  for (i = 0; i < ITERS; i++)
+    close (-1);
+  return (rdtsc () - start) / ITERS;
+}
+
+void
+test_main (void)
+{
+  uint64_t trap_cycles;
+
+  use_sysenter (false);
+  trap_cycles = time_null_syscall ();
+  msg ("int $0x30: %llu cycles", trap_cycles);
+
+  if (use_sysenter (true))
+    msg ("sysenter: %llu cycles", time_null_syscall ());
+  else
+    msg ("sysenter: not supported");
+}
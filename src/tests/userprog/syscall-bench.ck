@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_timings ('int \$0x30: \d+ cycles',
+	       'sysenter: (\d+ cycles|not supported)');
@@ -0,0 +1,26 @@
+/* Child process for shm-exchange test.
+   Attaches the segment the parent created, checks its contents,
+   and replies by inverting every byte. */
+
+#include <syscall.h>
+#include "tests/vm/shm.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+const char *test_name = "child-shm";
+
+int
+main (void)
+{
+  unsigned char *seg = (unsigned char *) 0x20000000;
+  size_t i;
+
+  if (shm_attach (SHM_NAME, seg) != SHM_SIZE)
+    fail ("attach \"%s\"", SHM_NAME);
+  for (i = 0; i < SHM_SIZE; i++)
+    if (seg[i] != shm_byte (i))
+      fail ("segment differs at offset %zu", i);
+  for (i = 0; i < SHM_SIZE; i++)
+    seg[i] = ~seg[i];
+  return 0;
+}
@@ -0,0 +1,3 @@
+# -*- perl -*-
+# Same program and checks as fault-around, run with -fault-around=0.
+do "tests/vm/fault-around.ck" or die "tests/vm/fault-around.ck: $@$!\n";
@@ -0,0 +1,46 @@
+/* Maps the same file twice and reads through both mappings.
+   The first pass faults the file into the page cache.  In the
+   second pass every page is already cached, so with fault-around
+   one fault maps a whole window of pages.
+
+   Run as fault-around with the default window, and as
+   fault-around-off with "-fault-around=0".  The checkers compare
+   the kernel's page fault count against what each one allows. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGES 128               /* Pages in the file. */
+
+/* Returns the sum of the first byte of each page of the
+   PAGES-page mapping at MAP. */
+static int
+read_pages (const char *map)
+{
+  const volatile char *p = map;
+  int sum = 0;
+  size_t i;
+
+  for (i = 0; i < PAGES; i++)
+    sum += p[i * 4096];
+  return sum;
+}
+
+void
+test_main (void)
+{
+  char *map[2] = {(char *) 0x10000000, (char *) 0x20000000};
+  int handle;
+  size_t i;
+
+  CHECK (create ("data", PAGES * 4096), "create \"data\"");
+  for (i = 0; i < 2; i++)
+    {
+      CHECK ((handle = open ("data")) > 1, "open \"data\" #%zu", i);
+      CHECK (mmap (handle, map[i]) != MAP_FAILED,
+             "mmap \"data\" #%zu", i);
+    }
+  for (i = 0; i < 2; i++)
+    CHECK (read_pages (map[i]) == 0, "read mapping %zu", i);
+}
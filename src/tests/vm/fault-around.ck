@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my ($name) = $test =~ m%([^/]+)$%;
+check_expected (IGNORE_EXIT_CODES => 1, [<<EOF]);
+($name) begin
+($name) create "data"
+($name) open "data" #0
+($name) mmap "data" #0
+($name) open "data" #1
+($name) mmap "data" #1
+($name) read mapping 0
+($name) read mapping 1
+($name) end
+EOF
+
+# Without fault-around, each of the file's 128 pages faults in
+# each mapping.  With it, the second mapping faults about once
+# per window, and the first benefits from read-ahead.
+my ($faults) = map (/^Exception: (\d+) page faults$/,
+		    read_text_file ("$test.output"));
+fail "missing page fault count in output\n" if !defined $faults;
+if ($name eq 'fault-around-off') {
+    fail "$faults page faults without fault-around, expected at least 256\n"
+      if $faults < 256;
+} else {
+    fail "$faults page faults with fault-around, expected fewer than 192\n"
+      if $faults >= 192;
+}
+pass;
@@ -0,0 +1,42 @@
+/* Forks a child that overwrites a buffer the parent filled in
+   before the fork, then checks that the parent still sees its own
+   data.  The buffer is shared copy-on-write, so the child's
+   writes must land in private copies. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251;
+
+  child = fork ();
+  if (child == 0)
+    {
+      /* Child: the data must have come along, then overwrite it. */
+      for (i = 0; i < SIZE; i++)
+        if (buf[i] != (char) (i % 251))
+          exit (-1);
+      memset (buf, 0x5a, SIZE);
+      exit (81);
+    }
+  if (child == PID_ERROR)
+    fail ("fork");
+
+  CHECK (wait (child) == 81, "wait for child");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i % 251))
+      fail ("parent's buffer changed at offset %zu", i);
+  msg ("parent's buffer is unchanged");
+}
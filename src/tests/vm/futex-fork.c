@@ -0,0 +1,62 @@
+/* Waits on a futex in a page that fork() left shared with a
+   child, and wakes it from another thread after writing the
+   word.  The write gives the parent a private copy of the page,
+   so the waiter must already be waiting on that copy, or the
+   wakeup is lost and the test times out. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* A page of its own for the futex word. */
+static int words[1024] __attribute__ ((aligned (4096)));
+
+/* Set by the waiter just before it waits. */
+static volatile int ready;
+
+static void
+waiter (void *aux UNUSED)
+{
+  ready = 1;
+  futex_wait (&words[0], 0);
+  thread_exit ();
+}
+
+void
+test_main (void)
+{
+  volatile int delay;
+  int fds[2];
+  pid_t child;
+  tid_t tid;
+  char c = 0;
+
+  /* Bring the page in, so that fork() shares its frame. */
+  words[0] = 0;
+
+  CHECK (pipe (fds) == 0, "pipe");
+  child = fork ();
+  if (child == PID_ERROR)
+    fail ("fork");
+  if (child == 0)
+    {
+      /* Keep the page shared, without touching it, until the
+         parent is done. */
+      read (fds[0], &c, 1);
+      exit (0);
+    }
+
+  CHECK ((tid = thread_create (waiter, NULL)) != TID_ERROR,
+         "create waiter thread");
+  while (!ready)
+    continue;
+  for (delay = 0; delay < 1000000; delay++)
+    continue;
+
+  words[0] = 1;
+  futex_wake (&words[0], 1);
+  CHECK (thread_join (tid) == 0, "join waiter thread");
+
+  write (fds[1], &c, 1);
+  CHECK (wait (child) == 0, "wait for child");
+}
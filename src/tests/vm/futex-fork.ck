@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(futex-fork) begin
+(futex-fork) pipe
+(futex-fork) create waiter thread
+(futex-fork) join waiter thread
+(futex-fork) wait for child
+(futex-fork) end
+EOF
+pass;
@@ -0,0 +1,79 @@
+/* Forks several children that increment a counter in shared
+   memory under a mutex, with a delay between reading and writing
+   the counter so that preemption inside the critical section is
+   likely.  The parent waits on a condition variable until every
+   child has finished, then checks the count. */
+
+#include <synch.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+#define ITERS 2000
+
+struct shared
+  {
+    struct mutex lock;
+    struct condvar all_done;
+    int counter;
+    int done;
+  };
+
+void
+test_main (void)
+{
+  struct shared *s = (struct shared *) 0x10000000;
+  pid_t children[CHILD_CNT];
+  int i;
+
+  CHECK (shm_create ("futex", sizeof *s, s), "create shared memory");
+  mutex_init (&s->lock);
+  condvar_init (&s->all_done);
+
+  CHECK (futex_wait (&s->counter, 1) == -1,
+         "futex_wait with stale value returns at once");
+  CHECK (futex_wake (&s->counter, 1) == 0, "futex_wake with no waiters");
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      children[i] = fork ();
+      if (children[i] == PID_ERROR)
+        fail ("fork");
+      if (children[i] == 0)
+        {
+          int j;
+
+          for (j = 0; j < ITERS; j++)
+            {
+              volatile int delay;
+              int v;
+
+              mutex_lock (&s->lock);
+              v = s->counter;
+              for (delay = 0; delay < 100; delay++)
+                continue;
+              s->counter = v + 1;
+              mutex_unlock (&s->lock);
+            }
+
+          mutex_lock (&s->lock);
+          s->done++;
+          condvar_signal (&s->all_done);
+          mutex_unlock (&s->lock);
+          exit (0);
+        }
+    }
+
+  mutex_lock (&s->lock);
+  while (s->done < CHILD_CNT)
+    condvar_wait (&s->all_done, &s->lock);
+  mutex_unlock (&s->lock);
+  msg ("all children done");
+
+  for (i = 0; i < CHILD_CNT; i++)
+    wait (children[i]);
+  if (s->counter != CHILD_CNT * ITERS)
+    fail ("counter is %d, expected %d", s->counter, CHILD_CNT * ITERS);
+  msg ("counter correct");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(futex-shm) begin
+(futex-shm) create shared memory
+(futex-shm) futex_wait with stale value returns at once
+(futex-shm) futex_wake with no waiters
+(futex-shm) all children done
+(futex-shm) counter correct
+(futex-shm) end
+EOF
+pass;
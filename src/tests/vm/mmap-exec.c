@@ -0,0 +1,17 @@
+/* Tries to map the running executable.  Its pages share frames
+   with the text of the running process, so a writable mapping
+   must be refused. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int handle;
+
+  CHECK ((handle = open ("mmap-exec")) > 1, "open \"mmap-exec\"");
+  CHECK (mmap (handle, (void *) 0x10000000) == MAP_FAILED,
+         "try to mmap running executable");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-exec) begin
+(mmap-exec) open "mmap-exec"
+(mmap-exec) try to mmap running executable
+(mmap-exec) end
+EOF
+pass;
@@ -0,0 +1,70 @@
+/* Measures pipe throughput, in CPU cycles per kilobyte, by pushing
+   64 MB from a child process to its parent, once from a buffer
+   that is not page-aligned, which the kernel has to copy, and once
+   from a page-aligned one, whose pages the kernel can pass along
+   without copying them. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TOTAL (64 * 1024 * 1024) /* Bytes pushed through the pipe. */
+#define CHUNK (64 * 1024)       /* Bytes per read or write. */
+
+static char wbuf[CHUNK + 4096] __attribute__ ((aligned (4096)));
+static char rbuf[CHUNK];
+
+/* Writes TOTAL bytes from SRC to a pipe read by the parent, in
+   CHUNK-byte writes, and returns the cycles taken per kilobyte. */
+static uint64_t
+push (const char *src)
+{
+  uint64_t start;
+  size_t total = 0;
+  int fds[2];
+  pid_t pid;
+  int n;
+
+  CHECK (pipe (fds) == 0, "pipe");
+  start = rdtsc ();
+  pid = fork ();
+  if (pid == PID_ERROR)
+    fail ("fork");
+  if (pid == 0)
+    {
+      size_t sent;
+
+      close (fds[0]);
+      for (sent = 0; sent < TOTAL; sent += CHUNK)
+        if (write (fds[1], src, CHUNK) != CHUNK)
+          exit (1);
+      exit (0);
+    }
+
+  close (fds[1]);
+  while ((n = read (fds[0], rbuf, sizeof rbuf)) > 0)
+    total += n;
+  close (fds[0]);
+  if (wait (pid) != 0)
+    fail ("writer failed");
+  if (total != TOTAL)
+    fail ("read %zu bytes, expected %d", total, TOTAL);
+  return (rdtsc () - start) / (TOTAL / 1024);
+}
+
+void
+test_main (void)
+{
+  uint64_t copy_cycles, page_cycles;
+  size_t i;
+
+  for (i = 0; i < sizeof wbuf; i++)
+    wbuf[i] = i;
+
+  copy_cycles = push (wbuf + 1);
+  page_cycles = push (wbuf);
+
+  msg ("copied: %llu cycles per kB", copy_cycles);
+  msg ("page-aligned: %llu cycles per kB", page_cycles);
+}
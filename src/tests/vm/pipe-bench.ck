@@ -0,0 +1,5 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_timings ('copied: \d+ cycles per kB', 'page-aligned: \d+ cycles per kB');
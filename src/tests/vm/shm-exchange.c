@@ -0,0 +1,35 @@
+/* Creates a shared memory segment, fills it, and runs child-shm,
+   which attaches the segment at another address, checks what it
+   finds there, and writes back a reply.  Once the last process
+   has detached the segment, it must be gone. */
+
+#include <syscall.h>
+#include "tests/vm/shm.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  unsigned char *seg = (unsigned char *) 0x10000000;
+  size_t i;
+  pid_t child;
+
+  CHECK (shm_create (SHM_NAME, SHM_SIZE, seg), "create \"%s\"", SHM_NAME);
+  CHECK (!shm_create (SHM_NAME, SHM_SIZE, seg + SHM_SIZE),
+         "create \"%s\" again (must fail)", SHM_NAME);
+  for (i = 0; i < SHM_SIZE; i++)
+    seg[i] = shm_byte (i);
+
+  CHECK ((child = exec ("child-shm")) != -1, "exec \"child-shm\"");
+  CHECK (wait (child) == 0, "wait for child");
+
+  for (i = 0; i < SHM_SIZE; i++)
+    if (seg[i] != (unsigned char) ~shm_byte (i))
+      fail ("reply differs at offset %zu", i);
+  msg ("reply correct");
+
+  shm_detach (seg);
+  CHECK (shm_attach (SHM_NAME, seg) == -1,
+         "attach \"%s\" after last detach (must fail)", SHM_NAME);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shm-exchange) begin
+(shm-exchange) create "exchange"
+(shm-exchange) create "exchange" again (must fail)
+(shm-exchange) exec "child-shm"
+child-shm: exit(0)
+(shm-exchange) wait for child
+(shm-exchange) reply correct
+(shm-exchange) attach "exchange" after last detach (must fail)
+(shm-exchange) end
+shm-exchange: exit(0)
+EOF
+pass;
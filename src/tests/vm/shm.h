@@ -0,0 +1,17 @@
+#ifndef TESTS_VM_SHM_H
+#define TESTS_VM_SHM_H 1
+
+#include <stddef.h>
+
+/* The segment shared by shm-exchange and child-shm. */
+#define SHM_NAME "exchange"
+#define SHM_SIZE (64 * 1024)
+
+/* Returns the byte the parent stores at offset OFS. */
+static inline unsigned char
+shm_byte (size_t ofs)
+{
+  return ofs * 7 + (ofs >> 12);
+}
+
+#endif /* tests/vm/shm.h */
@@ -0,0 +1,79 @@
+/* Sorts 512 kB of random data in 8 chunks, one thread per chunk.
+   The main thread reads each chunk from a file and starts a thread
+   sorting it, then goes on to read the next chunk while the
+   earlier ones are sorted, so that sorting overlaps with file
+   system I/O.  Then it joins the threads and verifies that each
+   chunk is sorted and that no data was lost. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/arc4.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/vm/qsort.h"
+
+#define CHUNK_SIZE (64 * 1024)
+#define CHUNK_CNT 8                             /* Number of chunks. */
+#define DATA_SIZE (CHUNK_CNT * CHUNK_SIZE)      /* Buffer size. */
+
+static unsigned char buf[DATA_SIZE];
+static size_t histogram[256];
+
+/* Thread function that sorts the chunk at CHUNK. */
+static void
+sort_chunk (void *chunk)
+{
+  qsort_bytes (chunk, CHUNK_SIZE);
+}
+
+void
+test_main (void)
+{
+  tid_t threads[CHUNK_CNT];
+  struct arc4 arc4;
+  size_t i;
+  int fd;
+
+  /* Write random data to a file, counting the instances of each
+     value. */
+  arc4_init (&arc4, "foobar", 6);
+  arc4_crypt (&arc4, buf, sizeof buf);
+  for (i = 0; i < sizeof buf; i++)
+    histogram[buf[i]]++;
+  CHECK (create ("data", sizeof buf), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"data\"");
+  memset (buf, 0, sizeof buf);
+  seek (fd, 0);
+
+  msg ("read and sort chunks");
+  for (i = 0; i < CHUNK_CNT; i++)
+    {
+      unsigned char *chunk = buf + CHUNK_SIZE * i;
+
+      if (read (fd, chunk, CHUNK_SIZE) != CHUNK_SIZE)
+        fail ("read chunk %zu", i);
+      threads[i] = thread_create (sort_chunk, chunk);
+      if (threads[i] == TID_ERROR)
+        fail ("thread_create for chunk %zu", i);
+    }
+  close (fd);
+
+  msg ("join threads");
+  for (i = 0; i < CHUNK_CNT; i++)
+    if (thread_join (threads[i]) != 0)
+      fail ("thread for chunk %zu did not exit cleanly", i);
+
+  msg ("verify");
+  for (i = 0; i < sizeof buf; i++)
+    {
+      if (i % CHUNK_SIZE != 0 && buf[i - 1] > buf[i])
+        fail ("chunk %zu not sorted at offset %zu",
+              i / CHUNK_SIZE, i % CHUNK_SIZE);
+      histogram[buf[i]]--;
+    }
+  for (i = 0; i < 256; i++)
+    if (histogram[i] != 0)
+      fail ("bad count of value %zu after sorting", i);
+  msg ("success");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-sort) begin
+(thread-sort) create "data"
+(thread-sort) open "data"
+(thread-sort) write "data"
+(thread-sort) read and sort chunks
+(thread-sort) join threads
+(thread-sort) verify
+(thread-sort) success
+(thread-sort) end
+thread-sort: exit(0)
+EOF
+pass;
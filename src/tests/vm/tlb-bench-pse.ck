@@ -0,0 +1,3 @@
+# -*- perl -*-
+# Same program and checks as tlb-bench, run with -pse.
+do "tests/vm/tlb-bench.ck" or die "tests/vm/tlb-bench.ck: $@$!\n";
@@ -0,0 +1,71 @@
+/* Measures, in CPU cycles, the costs that depend on how well the
+   kernel's own mappings survive in the TLB: a system call
+   between passes over a user working set, and a fork that
+   switches to the child and back.  The cost of a bare system
+   call is measured by syscall-bench.
+
+   Run as tlb-bench with the kernel's default 4 kB mappings, and
+   as tlb-bench-pse with "-pse", which maps kernel memory with
+   global 4 MB pages.  Compare the two outputs. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SYSCALL_ITERS 10000     /* Iterations of the syscall loops. */
+#define FORK_ITERS 50           /* Iterations of the fork loop. */
+#define WSET_PAGES 64           /* Pages in the user working set. */
+
+static char wset[WSET_PAGES * 4096];
+
+/* Touches every page of the working set. */
+static void
+touch_wset (void)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof wset; i += 4096)
+    wset[i]++;
+}
+
+void
+test_main (void)
+{
+  uint64_t start, wset_cycles, base_cycles, fork_cycles;
+  int i;
+
+  /* The working set alone, then with a system call in between. */
+  touch_wset ();
+  start = rdtsc ();
+  for (i = 0; i < SYSCALL_ITERS; i++)
+    touch_wset ();
+  base_cycles = rdtsc () - start;
+
+  /* Closing a descriptor that is not open is about the cheapest
+     system call there is. */
+  start = rdtsc ();
+  for (i = 0; i < SYSCALL_ITERS; i++)
+    {
+      close (-1);
+      touch_wset ();
+    }
+  wset_cycles = rdtsc () - start;
+
+  /* fork() blocks until the child has run, and the child runs
+     until it exits, so each iteration switches address spaces
+     at least twice. */
+  start = rdtsc ();
+  for (i = 0; i < FORK_ITERS; i++)
+    {
+      pid_t pid = fork ();
+      if (pid == 0)
+        exit (0);
+      if (pid == PID_ERROR)
+        fail ("fork");
+    }
+  fork_cycles = rdtsc () - start;
+
+  msg ("syscall with %d-page working set: %llu cycles",
+       WSET_PAGES, (wset_cycles - base_cycles) / SYSCALL_ITERS);
+  msg ("fork round trip: %llu cycles", fork_cycles / FORK_ITERS);
+}
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_timings ('syscall with \d+-page working set: \d+ cycles',
+	       'fork round trip: \d+ cycles');
@@ -0,0 +1,107 @@
+/*! \file cpu.h
+ *
+ * Inline functions for identifying CPU features, for reading and writing
+ * control register CR4, for reading and writing model-specific registers,
+ * and for reading the time-stamp counter.
+ */
+
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*! Feature bits in EDX of CPUID leaf 1.  See [IA32-v2a] "CPUID". @{ */
+#define CPUID_PSE 0x00000008    /*!< 4 MB pages. */
+#define CPUID_TSC 0x00000010    /*!< Time-stamp counter. */
+#define CPUID_APIC 0x00000200   /*!< On-chip local APIC. */
+#define CPUID_SEP 0x00000800    /*!< SYSENTER and SYSEXIT. */
+#define CPUID_PGE 0x00002000    /*!< Global pages. */
+/*! @} */
+
+/*! CR4 bits.  See [IA32-v3a] 2.5 "Control Registers". @{ */
+#define CR4_PSE 0x00000010      /*!< Page Size Extensions. */
+#define CR4_PGE 0x00000080      /*!< Page Global Enable. */
+/*! @} */
+
+/*! Model-specific registers.  See [IA32-v3b] appendix B. @{ */
+#define MSR_APIC_BASE 0x1b      /*!< Local APIC base address and flags. */
+#define MSR_SYSENTER_CS 0x174   /*!< Code segment entered by SYSENTER. */
+#define MSR_SYSENTER_ESP 0x175  /*!< Stack pointer loaded by SYSENTER. */
+#define MSR_SYSENTER_EIP 0x176  /*!< Entry point of SYSENTER. */
+/*! @} */
+
+/*! Executes CPUID with EAX set to LEAF and stores the resulting EAX, EBX,
+    ECX, and EDX into REGS[0] through REGS[3].
+ *
+ * \see [IA32-v2a] "CPUID"
+ */
+static inline void cpuid(uint32_t leaf, uint32_t regs[4]) {
+    asm volatile ("cpuid"
+                  : "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]),
+                    "=d" (regs[3])
+                  : "a" (leaf), "c" (0));
+}
+
+/*! Returns true if the CPU has every feature in FEATURES, a set of CPUID_*
+    bits. */
+static inline bool cpu_has(uint32_t features) {
+    uint32_t regs[4];
+    cpuid(1, regs);
+    return (regs[3] & features) == features;
+}
+
+/*! Returns true if the CPU supports SYSENTER and SYSEXIT. */
+static inline bool cpu_has_sysenter(void) {
+    uint32_t regs[4];
+    uint32_t family, model, stepping;
+
+    cpuid(1, regs);
+    family = (regs[0] >> 8) & 0xf;
+    model = (regs[0] >> 4) & 0xf;
+    stepping = regs[0] & 0xf;
+
+    /* Early Pentium Pros claim SEP but do not implement it.  See [IA32-v3a]
+       5.8.7 "Performing Fast Calls to System Procedures". */
+    return ((regs[3] & CPUID_SEP) != 0 &&
+            !(family == 6 && model < 3 && stepping < 3));
+}
+
+/*! Returns the value of CR4. */
+static inline uint32_t cr4_read(void) {
+    uint32_t cr4;
+    asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+    return cr4;
+}
+
+/*! Sets the bits in BITS, a set of CR4_* bits, in CR4. */
+static inline void cr4_set(uint32_t bits) {
+    asm volatile ("movl %0, %%cr4" : : "r" (cr4_read() | bits) : "memory");
+}
+
+/*! Returns the value of model-specific register MSR. */
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile ("rdmsr" : "=a" (lo), "=d" (hi) : "c" (msr));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+/*! Writes VALUE to model-specific register MSR. */
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile ("wrmsr"
+                  : : "c" (msr), "a" ((uint32_t) value),
+                      "d" ((uint32_t) (value >> 32)));
+}
+
+/*! Returns the value of the time-stamp counter, which counts up at a
+    fixed rate from processor reset.  The CPU must have CPUID_TSC.
+ *
+ * \see [IA32-v2b] "RDTSC"
+ */
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+#endif /* threads/cpu.h */
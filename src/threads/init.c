@@ -15,18 +15,23 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/smp.h"
 #include "threads/thread.h"
+#include "threads/worker.h"
 
 #ifdef USERPROG
 
 #include "userprog/process.h"
+#include "userprog/elfcache.h"
 #include "userprog/exception.h"
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
@@ -46,6 +51,16 @@
 
 #endif
 
+#ifdef VM
+
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/prefetch.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
+
+#endif
+
 /*! Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
@@ -65,9 +80,30 @@ static const char *swap_bdev_name;
 /*! -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/*! -pse: Map the kernel's view of RAM with 4 MB global pages? */
+static bool large_pages;
+
+/*! -boot-profile: Print the whole boot timeline at shutdown? */
+static bool boot_profile;
+
+/*! A phase of booting, for the boot profile. */
+struct boot_phase {
+    const char *name;           /*!< Name, without spaces. */
+    uint64_t end;               /*!< boot_clock() when the phase ended. */
+};
+
+/*! Boot phases ended so far, in order.  The first starts at reset. */
+static struct boot_phase boot_phases[24];
+static int boot_phase_cnt;
+
 static void bss_init(void);
 static void paging_init(void);
 
+static uint64_t boot_clock(void);
+static void boot_phase_done(const char *name, uint64_t end);
+static void boot_mark(const char *name);
+static int64_t boot_clock_to_us(uint64_t);
+
 static char **read_command_line(void);
 static char **parse_options(char **argv);
 static void run_actions(char **argv);
@@ -82,14 +118,18 @@ int main(void) NO_RETURN;
 
 /*! Pintos main program. */
 int main(void) {
+    uint64_t start = boot_clock();
     char **argv;
 
     /* Clear BSS. */  
     bss_init();
+    boot_phase_done("reset", start);
+    boot_mark("bss_init");
 
     /* Break command line into arguments and parse options. */
     argv = read_command_line();
     argv = parse_options(argv);
+    boot_mark("command_line");
 
     /* Initialize ourselves as a thread so we can use locks,
        then enable console locking. */
@@ -99,16 +139,26 @@ int main(void) {
     /* Greet user. */
     printf("Pintos booting with %'"PRIu32" kB RAM...\n",
            init_ram_pages * PGSIZE / 1024);
+    boot_mark("thread_init");
 
     /* Initialize memory system. */
     palloc_init(user_page_limit);
+    boot_mark("palloc_init");
     malloc_init();
+    boot_mark("malloc_init");
     paging_init();
+    boot_mark("paging_init");
+#ifdef VM
+    frame_init();
+    shm_init();
+    boot_mark("frame_init");
+#endif
 
     /* Segmentation. */
 #ifdef USERPROG
     tss_init();
     gdt_init();
+    boot_mark("gdt_init");
 #endif
 
     /* Initialize interrupt handlers. */
@@ -116,21 +166,46 @@ int main(void) {
     timer_init();
     kbd_init();
     input_init();
+    boot_mark("intr_init");
 #ifdef USERPROG
     exception_init();
     syscall_init();
+    futex_init();
+    elf_cache_init();
+    boot_mark("syscall_init");
 #endif
 
+    /* Look for more CPUs. */
+    smp_init();
+    boot_mark("smp_init");
+
     /* Start thread scheduler and enable interrupts. */
     thread_start();
     serial_init_queue();
+    worker_init();
+    boot_mark("thread_start");
     timer_calibrate();
+    boot_mark("timer_calibrate");
+
+    /* Start the other CPUs. */
+    smp_start();
+    boot_mark("smp_start");
 
 #ifdef FILESYS
     /* Initialize file system. */
     ide_init();
+    boot_mark("ide_init");
     locate_block_devices();
+    boot_mark("locate_block_devices");
     filesys_init(format_filesys);
+    boot_mark("filesys_init");
+#endif
+
+#ifdef VM
+    /* Initialize swap space and start read-ahead. */
+    swap_init();
+    prefetch_init();
+    boot_mark("swap_init");
 #endif
 
     printf("Boot complete.\n");
@@ -154,15 +229,89 @@ static void bss_init(void) {
     memset(&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/*! Returns a reading of the clock by which booting is timed: the TSC, if
+    the CPU has one, which counts from reset, otherwise timer_ticks(). */
+static uint64_t boot_clock(void) {
+    return cpu_has(CPUID_TSC) ? rdtsc() : (uint64_t) timer_ticks();
+}
+
+/*! Records that the boot phase called NAME ended at time END, a reading
+    of boot_clock(). */
+static void boot_phase_done(const char *name, uint64_t end) {
+    if (boot_phase_cnt < (int) (sizeof boot_phases / sizeof *boot_phases)) {
+        boot_phases[boot_phase_cnt].name = name;
+        boot_phases[boot_phase_cnt].end = end;
+        boot_phase_cnt++;
+    }
+}
+
+/*! Records that the boot phase called NAME ends now. */
+static void boot_mark(const char *name) {
+    boot_phase_done(name, boot_clock());
+}
+
+/*! Converts TIME, a reading of boot_clock(), to microseconds since reset,
+    or -1 if the TSC has yet to be calibrated. */
+static int64_t boot_clock_to_us(uint64_t time) {
+    int64_t ns;
+
+    if (!cpu_has(CPUID_TSC))
+        return time * (TIMER_NS_PER_TICK / 1000);
+    ns = timer_tsc_to_ns(time);
+    return ns >= 0 ? ns / 1000 : -1;
+}
+
+/*! Prints how long booting took.  With -boot-profile, prints how long
+    each phase took and when it ended, in microseconds since reset. */
+void init_print_stats(void) {
+    const struct boot_phase *last;
+    int64_t prev = 0;
+    int i;
+
+    if (boot_phase_cnt == 0)
+        return;
+    last = &boot_phases[boot_phase_cnt - 1];
+    if (boot_clock_to_us(last->end) < 0)
+        return;
+
+    printf("Boot: %"PRId64" us through %s\n",
+           boot_clock_to_us(last->end), last->name);
+    if (!boot_profile)
+        return;
+    for (i = 0; i < boot_phase_cnt; i++) {
+        int64_t end = boot_clock_to_us(boot_phases[i].end);
+        printf("Boot phase: %-20s %10"PRId64" us, ending at %"PRId64" us\n",
+               boot_phases[i].name, end - prev, end);
+        prev = end;
+    }
+}
+
 /*! Populates the base page directory and page table with the
     kernel virtual mapping, and then sets up the CPU to use the
     new page directory.  Points init_page_dir to the page
-    directory it creates. */
+    directory it creates.
+
+    With -pse, every 4 MB of RAM that holds no kernel text is mapped by a
+    single 4 MB PDE instead of a page table, and all kernel mappings are
+    global, so the TLB keeps them across the CR3 loads of context switches.
+    The kernel text stays in 4 kB pages so that it can remain read-only. */
 static void paging_init(void) {
     uint32_t *pd, *pt;
     size_t page;
+    uint32_t global = 0;
     extern char _start, _end_kernel_text;
 
+    if (large_pages) {
+        if (cpu_has(CPUID_PSE | CPUID_PGE)) {
+            cr4_set(CR4_PSE);
+            global = PTE_G;
+        }
+        else {
+            printf("-pse: CPU lacks 4 MB or global pages, ignoring\n");
+            large_pages = false;
+        }
+    }
+
     pd = init_page_dir = palloc_get_page(PAL_ASSERT | PAL_ZERO);
     pt = NULL;
     for (page = 0; page < init_ram_pages; page++) {
@@ -172,12 +321,20 @@ static void paging_init(void) {
         size_t pte_idx = pt_no(vaddr);
         bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+        if (large_pages && pte_idx == 0 &&
+            page + LARGE_PGSIZE / PGSIZE <= init_ram_pages &&
+            (vaddr + LARGE_PGSIZE <= &_start || vaddr >= &_end_kernel_text)) {
+            pd[pde_idx] = pde_create_large_kernel(vaddr, true);
+            page += LARGE_PGSIZE / PGSIZE - 1;
+            continue;
+        }
+
         if (pd[pde_idx] == 0) {
             pt = palloc_get_page(PAL_ASSERT | PAL_ZERO);
             pd[pde_idx] = pde_create(pt);
         }
 
-        pt[pte_idx] = pte_create_kernel(vaddr, !in_kernel_text);
+        pt[pte_idx] = pte_create_kernel(vaddr, !in_kernel_text) | global;
     }
 
     /* Store the physical address of the page directory into CR3
@@ -186,6 +343,12 @@ static void paging_init(void) {
        to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
        of the Page Directory". */
     asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+    /* Only now that no stale non-global translations can linger, let the
+       global bit take effect.  See [IA32-v3a] 3.12 "Translation Lookaside
+       Buffers (TLBs)". */
+    if (large_pages)
+        cr4_set(CR4_PGE);
 }
 
 /*! Breaks the kernel command line into words and returns them as
@@ -250,9 +413,21 @@ static char ** parse_options(char **argv) {
             random_init(atoi(value));
         else if (!strcmp(name, "-mlfqs"))
             thread_mlfqs = true;
+        else if (!strcmp(name, "-tickless"))
+            timer_tickless = true;
+        else if (!strcmp(name, "-loops"))
+            timer_set_loops(atoi(value));
+        else if (!strcmp(name, "-boot-profile"))
+            boot_profile = true;
+        else if (!strcmp(name, "-pse"))
+            large_pages = true;
 #ifdef USERPROG
         else if (!strcmp(name, "-ul"))
             user_page_limit = atoi(value);
+#endif
+#ifdef VM
+        else if (!strcmp(name, "-fault-around"))
+            page_fault_around = atoi(value);
 #endif
         else
             PANIC("unknown option `%s' (use -h for help)", name);
@@ -367,8 +542,15 @@ static void usage(void) {
 #endif
            "  -rs=SEED           Set random number seed to SEED.\n"
            "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+           "  -tickless          Stop timer interrupts on idle CPUs.\n"
+           "  -loops=N           Skip timer calibration: N loops per tick.\n"
+           "  -boot-profile      Print how long each phase of booting took.\n"
+           "  -pse               Map kernel memory with 4 MB global pages.\n"
 #ifdef USERPROG
            "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+           "  -fault-around=COUNT Map up to COUNT pages per page fault.\n"
 #endif
           );
     shutdown_power_off();
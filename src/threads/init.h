@@ -9,5 +9,7 @@
 /* Page directory with kernel mappings only. */
 extern uint32_t *init_page_dir;
 
+void init_print_stats(void);
+
 #endif /* threads/init.h */
 
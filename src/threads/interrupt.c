@@ -6,9 +6,15 @@
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/smp.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "devices/lapic.h"
 #include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/process.h"
+#endif
 
 /*! Programmable Interrupt Controller (PIC) registers.
     A PC has two PICs, called the master and slave PICs, with the
@@ -32,6 +38,10 @@ static uint64_t idt[INTR_CNT];
 /*! Interrupt handler functions for each interrupt. */
 static intr_handler_func *intr_handlers[INTR_CNT];
 
+/*! Interrupts whose handlers run without the kernel lock.  See
+    intr_register_ipi(). */
+static bool intr_unlocked[INTR_CNT];
+
 /*! Names for each interrupt, for debugging purposes. */
 static const char *intr_names[INTR_CNT];
 
@@ -39,15 +49,32 @@ static const char *intr_names[INTR_CNT];
     is one that has no registered handler. */
 static unsigned int unexpected_cnt[INTR_CNT];
 
+/*! Deferred work for each external interrupt.  See intr_defer(). */
+static intr_deferred_func *deferred_funcs[INTR_CNT];
+
+/*! Vectors whose deferred work is pending, one bit per vector. */
+static uint32_t deferred_pending[INTR_CNT / 32];
+
 /*! External interrupts are those generated by devices outside the CPU, such as
     the timer.  External interrupts run with interrupts turned off, so they
     never nest, nor are they ever pre-empted.  Handlers for external interrupts
     also may not sleep, although they may invoke intr_yield_on_return() to
     request that a new process be scheduled just before the interrupt
-    returns. */
+    returns.  Only the CPU holding the kernel lock can be handling one, so
+    these need not be per-CPU. */
 static bool in_external_intr;   /*! Are we processing an external interrupt? */
 static bool yield_on_return;    /*! Should we yield on interrupt return? */
 
+/*! Deferred work is what an external interrupt handler leaves, through
+    intr_defer(), to be done once the interrupt has been acknowledged, with
+    interrupts turned back on.  It runs in the interrupted thread just before
+    the interrupt returns, so like the handler it may not sleep, but it may
+    invoke intr_yield_on_return().  An interrupt that arrives in the meantime
+    leaves its own deferred work to the loop already running, and does not
+    let other CPUs into the kernel either, so deferred work sees no other
+    thread run. */
+static bool in_deferred;        /*! Are we doing deferred work? */
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init(void);
 static void pic_end_of_interrupt(int irq);
@@ -56,10 +83,12 @@ static void pic_end_of_interrupt(int irq);
 static uint64_t make_intr_gate(void (*)(void), int dpl);
 static uint64_t make_trap_gate(void (*)(void), int dpl);
 static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
+static void load_idt(void);
 
 /* Interrupt handlers. */
 void intr_handler(struct intr_frame *args);
 static void unexpected_interrupt(const struct intr_frame *);
+static void run_deferred(void);
 
 /*! Returns the current interrupt status. */
 enum intr_level intr_get_level(void) {
@@ -108,7 +137,6 @@ enum intr_level intr_disable(void) {
 
 /*! Initializes the interrupt system. */
 void intr_init(void) {
-    uint64_t idtr_operand;
     int i;
 
     /* Initialize interrupt controller. */
@@ -118,11 +146,7 @@ void intr_init(void) {
     for (i = 0; i < INTR_CNT; i++)
         idt[i] = make_intr_gate(intr_stubs[i], 0);
 
-    /* Load IDT register.
-       See [IA32-v2a] "LIDT" and [IA32-v3a] 5.10 "Interrupt
-       Descriptor Table (IDT)". */
-    idtr_operand = make_idtr_operand(sizeof idt - 1, idt);
-    asm volatile ("lidt %0" : : "m" (idtr_operand));
+    load_idt();
 
     /* Initialize intr_names. */
     for (i = 0; i < INTR_CNT; i++)
@@ -149,6 +173,23 @@ void intr_init(void) {
     intr_names[19] = "#XF SIMD Floating-Point Exception";
 }
 
+/*! Loads the IDT set up by intr_init() on the application processor we are
+    running on. */
+void intr_init_ap(void) {
+    load_idt();
+}
+
+/*! Loads the IDT into the CPU we are running on. */
+static void load_idt(void) {
+    uint64_t idtr_operand;
+
+    /* Load IDT register.
+       See [IA32-v2a] "LIDT" and [IA32-v3a] 5.10 "Interrupt
+       Descriptor Table (IDT)". */
+    idtr_operand = make_idtr_operand(sizeof idt - 1, idt);
+    asm volatile ("lidt %0" : : "m" (idtr_operand));
+}
+
 /*! Registers interrupt VEC_NO to invoke HANDLER with descriptor
     privilege level DPL.  Names the interrupt NAME for debugging
     purposes.  The interrupt handler will be invoked with
@@ -168,13 +209,26 @@ static void register_handler(uint8_t vec_no, int dpl, enum intr_level level,
 
 /*! Registers external interrupt VEC_NO to invoke HANDLER, which
     is named NAME for debugging purposes.  The handler will
-    execute with interrupts disabled. */
+    execute with interrupts disabled.  Besides the PIC's vectors,
+    the local APIC timer's vector counts as external. */
 void intr_register_ext(uint8_t vec_no, intr_handler_func *handler,
                        const char *name) {
-    ASSERT(vec_no >= 0x20 && vec_no <= 0x2f);
+    ASSERT((vec_no >= 0x20 && vec_no <= 0x2f) || vec_no == LAPIC_VEC_TIMER);
     register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
+/*! Registers interprocessor interrupt VEC_NO to invoke HANDLER, which is
+    named NAME for debugging purposes.  The handler executes with interrupts
+    disabled and without the kernel lock, which its CPU may be waiting for
+    while another CPU waits for the handler, so it may touch only the state
+    of its own CPU.  It must acknowledge the interrupt with lapic_eoi(). */
+void intr_register_ipi(uint8_t vec_no, intr_handler_func *handler,
+                       const char *name) {
+    ASSERT(vec_no > LAPIC_VEC_TIMER);
+    register_handler(vec_no, 0, INTR_OFF, handler, name);
+    intr_unlocked[vec_no] = true;
+}
+
 /*! Registers internal interrupt VEC_NO to invoke HANDLER, which is named NAME
     for debugging purposes.  The interrupt handler will be invoked with
     interrupt status LEVEL.
@@ -192,19 +246,60 @@ void intr_register_int(uint8_t vec_no, int dpl, enum intr_level level,
     register_handler(vec_no, dpl, level, handler, name);
 }
 
+/*! Masks external interrupt VEC_NO, one of the PIC's, if MASKED is true,
+    or unmasks it otherwise.  A masked interrupt is held pending by the PIC
+    until it is unmasked. */
+void intr_mask_ext(uint8_t vec_no, bool masked) {
+    int port = vec_no < 0x28 ? PIC0_DATA : PIC1_DATA;
+    uint8_t bit = 1 << (vec_no & 7);
+    enum intr_level old_level;
+
+    ASSERT(vec_no >= 0x20 && vec_no <= 0x2f);
+
+    old_level = intr_disable();
+    if (masked)
+        outb(port, inb(port) | bit);
+    else
+        outb(port, inb(port) & ~bit);
+    intr_set_level(old_level);
+}
+
 /*! Returns true during processing of an external interrupt
     and false at all other times. */
 bool intr_context(void) {
     return in_external_intr;
 }
 
-/*! During processing of an external interrupt, directs the interrupt handler
-    to yield to a new process just before returning from the interrupt.  May
-    not be called at any other time. */
+/*! During processing of an external interrupt or its deferred work,
+    directs the interrupt handler to yield to a new process just before
+    returning from the interrupt.  May not be called at any other time. */
 void intr_yield_on_return(void) {
-    ASSERT(intr_context());
+    ASSERT(intr_context() || in_deferred);
     yield_on_return = true;
 }
+
+/*! Registers FUNC as the deferred work of external interrupt VEC_NO, to be
+    run after each interrupt whose handler calls intr_defer(). */
+void intr_register_deferred(uint8_t vec_no, intr_deferred_func *func) {
+    ASSERT((vec_no >= 0x20 && vec_no <= 0x2f) || vec_no == LAPIC_VEC_TIMER);
+    ASSERT(deferred_funcs[vec_no] == NULL);
+    deferred_funcs[vec_no] = func;
+}
+
+/*! Called by the handler of external interrupt VEC_NO to have the
+    interrupt's deferred work run once the handler is done.  Work deferred
+    more than once before it gets to run runs only once. */
+void intr_defer(uint8_t vec_no) {
+    ASSERT(intr_context());
+    ASSERT(deferred_funcs[vec_no] != NULL);
+    deferred_pending[vec_no / 32] |= 1u << (vec_no % 32);
+}
+
+/*! Returns true while deferred interrupt work is running, false at all
+    other times. */
+bool intr_deferred_context(void) {
+    return in_deferred;
+}
 
 /* 8259A Programmable Interrupt Controller. */
 
@@ -309,19 +404,41 @@ static inline uint64_t make_idtr_operand(uint16_t limit, void *base) {
     interrupted thread's registers. */
 void intr_handler(struct intr_frame *frame) {
     bool external;
+    bool locked;
     intr_handler_func *handler;
+    enum intr_level old_level;
+
+    /* Interprocessor interrupts need nothing from the rest of the
+       kernel. */
+    if (intr_unlocked[frame->vec_no]) {
+        intr_handlers[frame->vec_no](frame);
+        return;
+    }
+
+    /* Interrupts from user mode, or from a CPU halted in its idle loop,
+       enter the kernel proper.  See threads/smp.c.  A halted CPU might
+       have stopped its timer, and must catch up on the ticks it missed. */
+    old_level = intr_disable();
+    locked = !kernel_lock_held();
+    if (locked) {
+        kernel_lock_acquire();
+        timer_restart_ticks();
+    }
+    intr_set_level(old_level);
 
     /* External interrupts are special.
        We only handle one at a time (so interrupts must be off)
        and they need to be acknowledged on the PIC (see below).
        An external interrupt handler cannot sleep. */
-    external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+    external = ((frame->vec_no >= 0x20 && frame->vec_no < 0x30)
+                || frame->vec_no == LAPIC_VEC_TIMER);
     if (external) {
         ASSERT(intr_get_level() == INTR_OFF);
         ASSERT(!intr_context());
 
         in_external_intr = true;
-        yield_on_return = false;
+        if (!in_deferred)
+            yield_on_return = false;
     }
 
     /* Invoke the interrupt's handler. */
@@ -344,13 +461,71 @@ void intr_handler(struct intr_frame *frame) {
         ASSERT(intr_context());
 
         in_external_intr = false;
-        pic_end_of_interrupt(frame->vec_no); 
+        if (frame->vec_no < 0x30)
+            pic_end_of_interrupt(frame->vec_no);
+        else
+            lapic_eoi();
+
+        /* An interrupt that arrived during deferred work returns to it
+           straight away, leaving the rest to the interrupt that started
+           it. */
+        if (!in_deferred) {
+            run_deferred();
+
+            /* Kernel code that could be interrupted could as well have been
+               preempted, so this is a safe point to let CPUs waiting for the
+               kernel lock in. */
+            if (!locked)
+                kernel_lock_pass();
+
+            if (yield_on_return)
+                thread_yield();
+        }
+    }
+
+#ifdef USERPROG
+    /* A thread whose process is exiting gets no further on its way back
+       to user mode. */
+    if (frame->cs == SEL_UCSEG)
+        process_check_exit();
+#endif
 
-        if (yield_on_return) 
-            thread_yield(); 
+    if (locked) {
+        intr_disable();
+        kernel_lock_release();
     }
 }
 
+/*! Runs pending deferred work, with interrupts on, until there is none
+    left.  Interrupts must be off, and are off again on return. */
+static void run_deferred(void) {
+    bool again;
+    size_t i;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    in_deferred = true;
+    do {
+        again = false;
+        for (i = 0; i < INTR_CNT / 32; i++) {
+            uint32_t pending = deferred_pending[i];
+            int bit;
+
+            if (pending == 0)
+                continue;
+            deferred_pending[i] = 0;
+            again = true;
+
+            intr_enable();
+            for (bit = 0; bit < 32; bit++)
+                if (pending & (1u << bit))
+                    deferred_funcs[i * 32 + bit]();
+            intr_disable();
+        }
+    } while (again);
+    in_deferred = false;
+}
+
 /*! Handles an unexpected interrupt with interrupt frame F.  An
     unexpected interrupt is one that has no registered handler. */
 static void unexpected_interrupt(const struct intr_frame *f) {
@@ -64,14 +64,23 @@ struct intr_frame {
 };
 
 typedef void intr_handler_func(struct intr_frame *);
+typedef void intr_deferred_func(void);
 
 void intr_init(void);
+void intr_init_ap(void);
 void intr_register_ext(uint8_t vec, intr_handler_func *, const char *name);
+void intr_register_ipi(uint8_t vec, intr_handler_func *, const char *name);
+void intr_mask_ext(uint8_t vec, bool masked);
 void intr_register_int(uint8_t vec, int dpl, enum intr_level,
                        intr_handler_func *, const char *name);
 bool intr_context(void);
 void intr_yield_on_return(void);
 
+/* Deferred interrupt work. */
+void intr_register_deferred(uint8_t vec, intr_deferred_func *);
+void intr_defer(uint8_t vec);
+bool intr_deferred_context(void);
+
 void intr_dump_frame(const struct intr_frame *);
 const char *intr_name(uint8_t vec);
 
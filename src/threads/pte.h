@@ -73,20 +73,38 @@ static inline uintptr_t pd_no(const void *va) {
 #define PTE_P 0x1               /*!< 1=present, 0=not present. */
 #define PTE_W 0x2               /*!< 1=read/write, 0=read-only. */
 #define PTE_U 0x4               /*!< 1=user/kernel, 0=kernel only. */
+#define PTE_PWT 0x8             /*!< 1=write-through caching. */
+#define PTE_PCD 0x10            /*!< 1=caching disabled, as for devices. */
 #define PTE_A 0x20              /*!< 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /*!< 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /*!< 1=4 MB page, 0=page table (PDEs only). */
+#define PTE_G 0x100             /*!< 1=global, survives CR3 loads. */
 /*! @} */
 
+/*! Bytes covered by a 4 MB page, which takes the place of a whole page
+    table. */
+#define LARGE_PGSIZE PTSPAN
+
 /*! Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create(uint32_t *pt) {
     ASSERT(pg_ofs(pt) == 0);
     return vtop(pt) | PTE_U | PTE_P | PTE_W;
 }
 
+/*! Returns a PDE that maps the 4 MB page at PAGE, which must be 4 MB
+    aligned, for the kernel only, as a global page.  If WRITABLE is true then
+    it will be writable as well.  Requires CR4.PSE, and CR4.PGE for the
+    global bit to take effect. */
+static inline uint32_t pde_create_large_kernel(void *page, bool writable) {
+    ASSERT((uintptr_t) page % LARGE_PGSIZE == 0);
+    return vtop(page) | PTE_P | PTE_PS | PTE_G | (writable ? PTE_W : 0);
+}
+
 /*! Returns a pointer to the page table that page directory entry
-    PDE, which must "present", points to. */
+    PDE, which must "present" and not a 4 MB page, points to. */
 static inline uint32_t *pde_get_pt(uint32_t pde) {
     ASSERT(pde & PTE_P);
+    ASSERT(!(pde & PTE_PS));
     return ptov(pde & PTE_ADDR);
 }
 
@@ -0,0 +1,423 @@
+/*! \file smp.c
+ *
+ * Symmetric multiprocessing: finding and starting the other CPUs, and the
+ * lock that keeps them out of each other's way in the kernel.
+ *
+ * The rest of the kernel was written for one CPU, and synchronizes by
+ * turning interrupts off, which does nothing to stop another CPU.  So a
+ * CPU may run kernel code only while it holds the kernel lock.  It takes
+ * the lock on entry from user mode or from its idle loop, keeps it across
+ * thread switches, and drops it only to return to user mode or to halt in
+ * its idle loop.  User programs thus run in parallel on every CPU, while
+ * the kernel runs on one CPU at a time.  The lock is a ticket lock, so
+ * waiting CPUs get in in turn; a CPU running kernel threads lets waiting
+ * CPUs in at each external interrupt, since everything interrupts can
+ * interrupt may already be preempted anyway.
+ *
+ * A CPU that holds the kernel lock sometimes needs other CPUs to do
+ * something, such as flush their TLBs, and wait until they have.  It asks
+ * with smp_call(), which interrupts them with an IPI that they take
+ * without the kernel lock.  CPUs spinning for the lock, with interrupts
+ * off, answer such requests from their spin loops.
+ *
+ * CPUs are found through the tables described in the MultiProcessor
+ * Specification [MP].
+ */
+
+#include "threads/smp.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/spinlock.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/syscall.h"
+#endif
+
+/*! MP floating pointer structure.  See [MP] 4.1. */
+struct mp_float {
+    char signature[4];          /*!< "_MP_". */
+    uint32_t config;            /*!< Physical address of config table. */
+    uint8_t length;             /*!< Length in 16-byte units. */
+    uint8_t revision;           /*!< Version of [MP]. */
+    uint8_t checksum;           /*!< Makes all bytes sum to 0. */
+    uint8_t features[5];        /*!< Nonzero FEATURES[0] means no table. */
+};
+
+/*! MP configuration table header.  See [MP] 4.2. */
+struct mp_config {
+    char signature[4];          /*!< "PCMP". */
+    uint16_t length;            /*!< Length of header and entries. */
+    uint8_t revision;           /*!< Version of [MP]. */
+    uint8_t checksum;           /*!< Makes all bytes sum to 0. */
+    char oem[20];               /*!< OEM and product IDs. */
+    uint32_t oem_table;         /*!< Physical address of OEM table. */
+    uint16_t oem_table_size;    /*!< Size of OEM table. */
+    uint16_t entry_cnt;         /*!< Number of entries. */
+    uint32_t lapic_paddr;       /*!< Physical address of local APICs. */
+    uint16_t ext_length;        /*!< Length of extended entries. */
+    uint8_t ext_checksum;       /*!< Checksum of extended entries. */
+    uint8_t reserved;
+};
+
+/*! MP configuration table entry for a processor.  See [MP] 4.3.1.  Entries
+    of other types are 8 bytes long. */
+struct mp_proc {
+    uint8_t type;               /*!< MP_PROC. */
+    uint8_t apic_id;            /*!< Local APIC ID. */
+    uint8_t apic_version;       /*!< Local APIC version. */
+    uint8_t flags;              /*!< MP_PROC_* flags. */
+    uint32_t signature;         /*!< CPUID signature. */
+    uint32_t features;          /*!< CPUID feature flags. */
+    uint32_t reserved[2];
+};
+
+#define MP_PROC 0               /*!< Type of struct mp_proc. */
+#define MP_PROC_ENABLED 0x01    /*!< Processor is usable. */
+#define MP_PROC_BSP 0x02        /*!< Processor is the bootstrap processor. */
+
+/*! The CPUs.  The first CPU_CNT have been started. */
+struct cpu cpus[CPU_MAX];
+int cpu_cnt = 1;
+
+/*! Local APIC IDs of the application processors found by smp_init(). */
+static uint8_t ap_apic_ids[CPU_MAX - 1];
+static int ap_cnt;
+
+/*! Whether smp_init() set up the bootstrap processor's local APIC. */
+static bool lapic_up;
+
+/*! The kernel lock, and the CPU that holds it.  The bootstrap processor
+    takes it in thread_init(), before smp_init() runs, so it relies on
+    being initialized as unlocked by being zeroed. */
+static struct spinlock kernel_lock;
+static struct cpu *kernel_lock_holder;
+
+/*! Function for smp_call() to run on other CPUs, and its argument. */
+static void (*volatile call_func)(void *aux);
+static void *volatile call_aux;
+
+/*! Bootstrap processor's CR4. */
+static uint32_t bsp_cr4;
+
+#ifndef USERPROG
+/*! Operand for LGDT that loads the bootstrap processor's GDT. */
+static uint64_t gdtr_operand;
+#endif
+
+/* In ap-start.S. */
+extern char ap_start[], ap_start_end[];
+extern uint32_t ap_start_cr3, ap_start_cr4, ap_start_esp, ap_start_eip;
+
+/*! Parameter SYM of ap-start.S, in the copy at AP_START_PADDR. */
+#define AP_PARAM(SYM) \
+    (*(uint32_t *) ptov(AP_START_PADDR + ((char *) &(SYM) - ap_start)))
+
+static uintptr_t mp_parse(void);
+static struct mp_float *mp_search(void);
+static struct mp_float *mp_search_range(uintptr_t paddr, size_t size);
+static bool checksum_ok(const void *, size_t size);
+static void ap_main(struct cpu *) NO_RETURN;
+static intr_handler_func call_interrupt;
+static intr_handler_func wake_interrupt;
+static void smp_poll(void);
+
+/*! Finds the CPUs and, if there is more than one or the timer is to stop
+    on idle CPUs, sets up the bootstrap processor's local APIC.  The other
+    CPUs are not started until smp_start().  A machine without an MP
+    configuration table is taken to have just one CPU. */
+void smp_init(void) {
+    uintptr_t lapic_paddr;
+
+    if (!cpu_has(CPUID_APIC)) {
+        if (timer_tickless) {
+            printf("-tickless: CPU lacks a local APIC, ignoring\n");
+            timer_tickless = false;
+        }
+        return;
+    }
+
+    /* A uniprocessor otherwise does without its local APIC. */
+    lapic_paddr = mp_parse();
+    if (ap_cnt == 0 && !timer_tickless)
+        return;
+    if (lapic_paddr == 0)
+        lapic_paddr = rdmsr(MSR_APIC_BASE) & PTE_ADDR;
+    if (!lapic_init(lapic_paddr)) {
+        ap_cnt = 0;
+        timer_tickless = false;
+        return;
+    }
+    lapic_up = true;
+    cpus[0].apic_id = lapic_id();
+    intr_register_ipi(LAPIC_VEC_CALL, call_interrupt, "call IPI");
+    intr_register_ipi(LAPIC_VEC_WAKE, wake_interrupt, "wake IPI");
+}
+
+/*! Starts the application processors found by smp_init().  Each starts
+    out in its idle thread.  The timer must already be calibrated.  Also
+    moves the bootstrap processor's ticks to its local APIC timer, if the
+    timer is to stop on idle CPUs. */
+void smp_start(void) {
+    uint32_t *pd;
+    int i;
+
+    if (!lapic_up)
+        return;
+
+    lapic_timer_calibrate();
+    if (timer_tickless)
+        timer_use_lapic();
+    if (ap_cnt == 0)
+        return;
+
+    bsp_cr4 = cr4_read();
+#ifndef USERPROG
+    asm volatile ("sgdt %0" : "=m" (gdtr_operand));
+#endif
+
+
+    /* APs turn on paging with a page directory that maps the page where
+       they start at its physical address, which init_page_dir does not.
+       They switch to init_page_dir in ap_main(). */
+    pd = palloc_get_page(PAL_ASSERT);
+    memcpy(pd, init_page_dir, PGSIZE);
+    pd[0] = init_page_dir[pd_no(PHYS_BASE)];
+
+    memcpy(ptov(AP_START_PADDR), ap_start, ap_start_end - ap_start);
+    AP_PARAM(ap_start_cr3) = vtop(pd);
+    AP_PARAM(ap_start_cr4) = bsp_cr4 & ~CR4_PGE;
+    AP_PARAM(ap_start_eip) = (uintptr_t) ap_main;
+
+    for (i = 0; i < ap_cnt; i++) {
+        struct cpu *c = &cpus[cpu_cnt];
+        struct thread *idle;
+        uint32_t *esp;
+        int ms;
+
+        c->id = cpu_cnt;
+        c->apic_id = ap_apic_ids[i];
+        idle = thread_create_idle(c);
+        if (idle == NULL)
+            break;
+
+        /* Stack frame for ap_main(C). */
+        esp = (uint32_t *) ((uint8_t *) idle + PGSIZE) - 2;
+        esp[0] = 0;
+        esp[1] = (uint32_t) c;
+        AP_PARAM(ap_start_esp) = (uintptr_t) esp;
+
+        lapic_start_ap(c->apic_id, AP_START_PADDR);
+        for (ms = 0; ms < 1000 && !c->started; ms++)
+            timer_mdelay(1);
+        if (!c->started) {
+            /* It might still start, so we cannot reuse its slot. */
+            printf("CPU %d (APIC ID %d) failed to start\n",
+                   c->id, c->apic_id);
+            break;
+        }
+        cpu_cnt++;
+    }
+    palloc_free_page(pd);
+
+    printf("%d CPUs running.\n", cpu_cnt);
+}
+
+/*! Runs FUNC(AUX) on each CPU in CPU_MASK, a bitmap of CPU ids, other than
+    the current one, and waits for them all to finish.  FUNC runs in an
+    interrupt handler, without the kernel lock, so it must touch only the
+    state of the CPU it runs on.  The caller must hold the kernel lock. */
+void smp_call(uint32_t cpu_mask, void (*func)(void *aux), void *aux) {
+    enum intr_level old_level;
+    int i;
+
+    ASSERT(kernel_lock_held());
+
+    cpu_mask &= ~(1u << cpu_current()->id);
+    if (cpu_mask == 0)
+        return;
+
+    /* Other calls must wait until the CPUs are done with this one. */
+    old_level = intr_disable();
+    call_func = func;
+    call_aux = aux;
+    for (i = 0; i < cpu_cnt; i++)
+        if (cpu_mask & (1u << i)) {
+            cpus[i].call_pending = true;
+            lapic_send_ipi(cpus[i].apic_id, LAPIC_VEC_CALL);
+        }
+    for (i = 0; i < cpu_cnt; i++)
+        while (cpus[i].call_pending)
+            asm volatile ("pause" : : : "memory");
+    intr_set_level(old_level);
+}
+
+/*! Brings CPU out of its idle loop, so that it notices newly ready
+    threads. */
+void smp_wake(struct cpu *c) {
+    if (c != cpu_current())
+        lapic_send_ipi(c->apic_id, LAPIC_VEC_WAKE);
+}
+
+/*! Acquires the kernel lock for the current CPU.  Interrupts must be
+    off. */
+void kernel_lock_acquire(void) {
+    ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(!kernel_lock_held());
+
+    spinlock_acquire(&kernel_lock, smp_poll);
+    kernel_lock_holder = cpu_current();
+}
+
+/*! Releases the kernel lock, which the current CPU must hold.  Interrupts
+    must be off. */
+void kernel_lock_release(void) {
+    ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(kernel_lock_held());
+
+    kernel_lock_holder = NULL;
+    spinlock_release(&kernel_lock);
+}
+
+/*! Lets any CPUs waiting for the kernel lock, which the current CPU must
+    hold, have it before taking it back.  Interrupts must be off. */
+void kernel_lock_pass(void) {
+    if (spinlock_contended(&kernel_lock)) {
+        kernel_lock_release();
+        kernel_lock_acquire();
+    }
+}
+
+/*! Returns true if the current CPU holds the kernel lock. */
+bool kernel_lock_held(void) {
+    return kernel_lock_holder == cpu_current();
+}
+
+/*! Reads the MP configuration table, if there is one, into ap_apic_ids[]
+    and ap_cnt.  Returns the physical address of the local APICs that it
+    gives, or 0 if there is no table. */
+static uintptr_t mp_parse(void) {
+    struct mp_float *mp;
+    struct mp_config *config;
+    const uint8_t *p, *end;
+
+    mp = mp_search();
+    if (mp == NULL || mp->config == 0
+        || mp->config + sizeof *config > init_ram_pages * PGSIZE)
+        return 0;
+    config = ptov(mp->config);
+    if (memcmp(config->signature, "PCMP", 4)
+        || mp->config + config->length > init_ram_pages * PGSIZE
+        || !checksum_ok(config, config->length))
+        return 0;
+
+    p = (const uint8_t *) (config + 1);
+    end = (const uint8_t *) config + config->length;
+    while (p < end) {
+        if (*p == MP_PROC) {
+            const struct mp_proc *proc = (const struct mp_proc *) p;
+            if ((proc->flags & (MP_PROC_ENABLED | MP_PROC_BSP))
+                == MP_PROC_ENABLED && ap_cnt < CPU_MAX - 1)
+                ap_apic_ids[ap_cnt++] = proc->apic_id;
+            p += sizeof *proc;
+        }
+        else
+            p += 8;
+    }
+    return config->lapic_paddr;
+}
+
+/*! Searches for the MP floating pointer structure in the places listed in
+    [MP] 4: the first kB of the extended BIOS data area, the last kB of
+    base memory, and the BIOS ROM. */
+static struct mp_float * mp_search(void) {
+    uint16_t ebda_seg = *(uint16_t *) ptov(0x40e);
+    uint16_t base_kb = *(uint16_t *) ptov(0x413);
+    struct mp_float *mp = NULL;
+
+    if (ebda_seg != 0)
+        mp = mp_search_range((uintptr_t) ebda_seg << 4, 1024);
+    if (mp == NULL && base_kb >= 1)
+        mp = mp_search_range(((uintptr_t) base_kb - 1) * 1024, 1024);
+    if (mp == NULL)
+        mp = mp_search_range(0xf0000, 0x10000);
+    return mp;
+}
+
+/*! Searches the SIZE bytes at physical address PADDR for the MP floating
+    pointer structure, which is aligned on a 16-byte boundary. */
+static struct mp_float * mp_search_range(uintptr_t paddr, size_t size) {
+    uint8_t *p = ptov(paddr);
+    uint8_t *end = p + size;
+
+    for (; p + sizeof(struct mp_float) <= end; p += 16)
+        if (!memcmp(p, "_MP_", 4) && checksum_ok(p, sizeof(struct mp_float)))
+            return (struct mp_float *) p;
+    return NULL;
+}
+
+/*! Returns true if the SIZE bytes at P sum to 0, modulo 256. */
+static bool checksum_ok(const void *p_, size_t size) {
+    const uint8_t *p = p_;
+    uint8_t sum = 0;
+
+    while (size-- > 0)
+        sum += *p++;
+    return sum == 0;
+}
+
+/*! Entered by ap-start.S on application processor C, on its idle thread's
+    stack. */
+static void ap_main(struct cpu *c) {
+    /* Switch to the kernel's page directory, then let global pages take
+       effect, as paging_init() does. */
+    asm volatile ("movl %0, %%cr3" : : "r" (vtop(init_page_dir)) : "memory");
+    cr4_set(bsp_cr4 & CR4_PGE);
+
+#ifdef USERPROG
+    gdt_init_ap();
+    syscall_init_ap();
+#else
+    asm volatile ("lgdt %0" : : "m" (gdtr_operand));
+#endif
+    intr_init_ap();
+    lapic_init_ap();
+
+    /* smp_start() is waiting for this, and may be holding the kernel lock
+       while it waits. */
+    c->started = true;
+
+    kernel_lock_acquire();
+    thread_idle();
+}
+
+/*! Answers a pending smp_call() request for the current CPU, if any. */
+static void smp_poll(void) {
+    struct cpu *c = cpu_current();
+
+    if (c->call_pending) {
+        call_func(call_aux);
+        barrier();
+        c->call_pending = false;
+    }
+}
+
+/*! Handler for the IPI sent by smp_call(). */
+static void call_interrupt(struct intr_frame *args UNUSED) {
+    smp_poll();
+    lapic_eoi();
+}
+
+/*! Handler for the IPI sent by smp_wake().  Interrupting the halt in the
+    idle loop is all that it takes. */
+static void wake_interrupt(struct intr_frame *args UNUSED) {
+    lapic_eoi();
+}
@@ -0,0 +1,73 @@
+/*! \file smp.h
+ *
+ * Declarations for running on more than one CPU.
+ */
+
+#ifndef THREADS_SMP_H
+#define THREADS_SMP_H
+
+/*! Maximum number of CPUs. */
+#define CPU_MAX 8
+
+/*! Physical address of the page at which application processors start
+    running; see ap-start.S. */
+#define AP_START_PADDR 0x8000
+
+#ifndef __ASSEMBLER__
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/thread.h"
+
+/*! A CPU.
+
+    CPU 0 is the bootstrap processor (BSP), which runs main().  The others
+    are application processors (APs), started by smp_start().  Each CPU
+    has its own idle thread and its own queue of threads ready to run. */
+struct cpu {
+    int id;                             /*!< Index in cpus[]. */
+    uint8_t apic_id;                    /*!< Local APIC ID. */
+    volatile bool started;              /*!< Running the kernel yet? */
+
+    /*! Owned by thread.c. */
+    /**@{*/
+    struct thread *current;             /*!< Running thread. */
+    struct thread *idle;                /*!< Idle thread. */
+    struct list ready_lists[NUM_PRIORITIES]; /*!< Ready threads, by
+                                           priority. */
+    int ready_cnt;                      /*!< # of threads in READY_LISTS. */
+    unsigned thread_ticks;              /*!< # of timer ticks since last
+                                           yield. */
+    long long idle_ticks;               /*!< # of timer ticks spent idle. */
+    long long migrations;               /*!< # of threads moved here from
+                                           other CPUs. */
+    /**@}*/
+
+    /*! Owned by smp.c. */
+    /**@{*/
+    volatile bool call_pending;         /*!< smp_call() awaits us? */
+    /**@}*/
+
+    /*! Owned by devices/timer.c. */
+    /**@{*/
+    bool ticks_stopped;                 /*!< Timer stopped while idle? */
+    /**@}*/
+};
+
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+
+void smp_init(void);
+void smp_start(void);
+struct cpu *cpu_current(void);
+
+void smp_call(uint32_t cpu_mask, void (*func)(void *aux), void *aux);
+void smp_wake(struct cpu *);
+
+void kernel_lock_acquire(void);
+void kernel_lock_release(void);
+void kernel_lock_pass(void);
+bool kernel_lock_held(void);
+#endif
+
+#endif /* threads/smp.h */
@@ -0,0 +1,57 @@
+/*! \file spinlock.h
+ *
+ * Ticket spinlocks, for mutual exclusion between CPUs.
+ *
+ * A CPU that wants the lock takes the next ticket and spins until the lock
+ * serves it, so CPUs get the lock in the order they asked for it.  Holders
+ * must not sleep, and should keep interrupts off while they hold the lock,
+ * since an interrupt handler that tried to take it again would spin
+ * forever.
+ */
+
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*! A ticket spinlock. */
+struct spinlock {
+    volatile uint16_t next;     /*!< Next ticket to hand out. */
+    volatile uint16_t owner;    /*!< Ticket being served. */
+};
+
+/*! Initializes LOCK as unlocked. */
+static inline void spinlock_init(struct spinlock *lock) {
+    lock->next = 0;
+    lock->owner = 0;
+}
+
+/*! Acquires LOCK, spinning until it is available.  While spinning, calls
+    POLL, if it is nonnull, to let the waiting CPU answer requests from the
+    holder. */
+static inline void spinlock_acquire(struct spinlock *lock,
+                                    void (*poll)(void)) {
+    uint16_t ticket = 1;
+
+    asm volatile ("lock xaddw %0, %1"
+                  : "+r" (ticket), "+m" (lock->next) : : "memory");
+    while (lock->owner != ticket) {
+        if (poll != NULL)
+            poll();
+        asm volatile ("pause" : : : "memory");
+    }
+}
+
+/*! Releases LOCK, which the caller must hold. */
+static inline void spinlock_release(struct spinlock *lock) {
+    asm volatile ("" : : : "memory");
+    lock->owner++;
+}
+
+/*! Returns true if some CPU is waiting for LOCK. */
+static inline bool spinlock_contended(const struct spinlock *lock) {
+    return (uint16_t) (lock->next - lock->owner) > 1;
+}
+
+#endif /* threads/spinlock.h */
@@ -9,9 +9,11 @@
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/smp.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "threads/worker.h"
 #include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -25,23 +27,23 @@
 /*! List of processes that are sleeping. */
 static struct list sleep_list;
 
-/*! Processes in the THREAD_READY state,
-    Array (indexed by priority) of lists of threads */
-static struct list ready_priority_lists[NUM_PRIORITIES];
-
-/*! Add a thread to the ready queue.
-    Assumes that thread is not already in ready queue. */
+/*! Add a thread to the ready queue of its CPU.
+    Assumes that thread is not already in a ready queue. */
 void add_to_ready_queue(struct thread *t) {
-  list_push_back(&ready_priority_lists[t->priority], &t->elem);
+    list_push_back(&t->cpu->ready_lists[t->priority], &t->elem);
+    t->cpu->ready_cnt++;
+}
+
+/*! Removes ready thread T from the ready queue of its CPU. */
+static void remove_from_ready_queue(struct thread *t) {
+    list_remove(&t->elem);
+    t->cpu->ready_cnt--;
 }
 
 /*! List of all processes.  Processes are added to this list
     when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/*! Idle thread. */
-static struct thread *idle_thread;
-
 /*! Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
@@ -55,15 +57,25 @@ struct kernel_thread_frame {
     void *aux;                  /*!< Auxiliary data for function. */
 };
 
+/*! Pages of threads that have exited, kept for reuse by thread_create() so
+    that short-lived threads need not go through the page allocator.  Only
+    the struct thread at the bottom of a recycled page is cleared; the stack
+    above it is left as it was.  Accessed with interrupts off. */
+#define THREAD_POOL_PAGES 16
+static struct thread *thread_pool[THREAD_POOL_PAGES];
+static size_t thread_pool_cnt;  /*!< # of pages in thread_pool. */
+
 /* Statistics. */
 static long long idle_ticks;    /*!< # of timer ticks spent idle. */
 static long long kernel_ticks;  /*!< # of timer ticks in kernel threads. */
 static long long user_ticks;    /*!< # of timer ticks in user programs. */
+static long long pool_hits;     /*!< # of thread pages taken from the pool. */
+static long long pool_misses;   /*!< # of thread pages from palloc. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /*!< # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /*!< # of timer ticks since last
-				  yield. */
+#define CACHE_HOT_TICKS 3       /*!< Threads that ran within this many timer
+                                   ticks are not moved to other CPUs. */
 static fixed thread_load_avg;
 static int ready_threads;     /*!< # of threads either READY or
 				  RUNNING. */
@@ -73,14 +85,34 @@ static int ready_threads;     /*!< # of threads either READY or
     Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/*! Priorities need recomputing for the MLFQS, at the end of a time slice.
+    Done by thread_tick_deferred(). */
+static bool priorities_stale;
+
+/*! Last timer tick whose work thread_tick_deferred() has done. */
+static int64_t ticks_done;
+
+/*! Recomputes recent_cpu for every thread, once a second.  It visits
+    every thread, so the worker thread does it. */
+static struct work recent_cpu_work;
+
+/*! The next thread whose recent_cpu the worker's pass updates, or a null
+    pointer if no pass is in progress.  Kept valid by thread_exit(). */
+static struct list_elem *recent_cpu_next;
+
 static void kernel_thread(thread_func *, void *aux);
 
 static void idle(void *aux UNUSED);
 static struct thread *running_thread(void);
-static struct thread *next_thread_to_run(void);
+static struct thread *next_thread_to_run(struct cpu *);
+static bool is_idle(struct thread *);
+static struct cpu *choose_cpu(struct thread *);
+static void steal_thread(struct cpu *);
 static void init_thread(struct thread *, const char *name, int priority);
 static bool is_thread(struct thread *) UNUSED;
 static void *alloc_frame(struct thread *, size_t size);
+static struct thread *thread_page_get(void);
+static void thread_page_put(struct thread *);
 static void schedule(void);
 void thread_schedule_tail(struct thread *prev);
 void thread_update_priority(struct thread* t);
@@ -88,6 +120,9 @@ void thread_update_donated_priority(struct thread* t);
 void thread_update_advanced_priority(struct thread* t, void *aux UNUSED);
 void thread_update_recent_cpu(struct thread * t, void *aux UNUSED);
 static tid_t allocate_tid(void);
+static void deferred_foreach(thread_action_func *, void *aux);
+static void update_recent_cpu(struct work *);
+static bool in_load_avg(struct thread *);
 static void wake_thread(void);
 
 /*! Initializes the threading system by transforming the code
@@ -95,7 +130,8 @@ static void wake_thread(void);
     general and it is possible in this case only because loader.S
     was careful to put the bottom of the stack at a page boundary.
 
-    Also initializes the run queue and the tid lock.
+    Also initializes the run queues and the tid lock, and takes the kernel
+    lock for the bootstrap processor.
 
     After calling this function, be sure to initialize the page allocator
     before trying to create any threads with thread_create().
@@ -105,12 +141,16 @@ void thread_init(void) {
     ASSERT(intr_get_level() == INTR_OFF);
 
     lock_init(&tid_lock);
+    work_init(&recent_cpu_work, update_recent_cpu);
     list_init(&sleep_list);
 
     // Initialize all ready lists 
-    int i;
-    for (i = PRI_MIN; i <= PRI_MAX; ++i) {
-      list_init(&ready_priority_lists[i]);
+    int c, i;
+    for (c = 0; c < CPU_MAX; c++) {
+	cpus[c].id = c;
+	for (i = PRI_MIN; i <= PRI_MAX; ++i) {
+	    list_init(&cpus[c].ready_lists[i]);
+	}
     }
 
     list_init(&all_list);
@@ -121,6 +161,10 @@ void thread_init(void) {
     init_thread(initial_thread, "main", PRI_DEFAULT);
     initial_thread->status = THREAD_RUNNING;
     initial_thread->tid = allocate_tid();
+    initial_thread->cpu = &cpus[0];
+    cpus[0].current = initial_thread;
+    cpus[0].started = true;
+    kernel_lock_acquire();
 
     ready_threads = 0;
     thread_load_avg = int2fixed(0);
@@ -128,7 +172,7 @@ void thread_init(void) {
 }
 
 /*! Starts preemptive thread scheduling by enabling interrupts.
-    Also creates the idle thread. */
+    Also creates the bootstrap processor's idle thread. */
 void thread_start(void) {
     /* Create the idle thread. */
     struct semaphore idle_started;
@@ -138,18 +182,23 @@ void thread_start(void) {
     /* Start preemptive thread scheduling. */
     intr_enable();
 
-    /* Wait for the idle thread to initialize idle_thread. */
+    /* Wait for the idle thread to initialize cpus[0].idle. */
     sema_down(&idle_started);
 }
 
-/*! Called by the timer interrupt handler at each timer tick.
-    Thus, this function runs in an external interrupt context. */
+/*! Called by the timer interrupt handler at each timer tick, on each CPU.
+    Thus, this function runs in an external interrupt context.  Anything
+    that can wait until the interrupt has been acknowledged is left to
+    thread_tick_deferred(). */
 void thread_tick(void) {
     struct thread *t = thread_current();
+    struct cpu *c = t->cpu;
 
     /* Update statistics. */
-    if (t == idle_thread)
+    if (is_idle(t)) {
         idle_ticks++;
+        c->idle_ticks++;
+    }
 #ifdef USERPROG
     else if (t->pagedir != NULL)
         user_ticks++;
@@ -157,31 +206,114 @@ void thread_tick(void) {
     else
         kernel_ticks++;
 
-    if (t != idle_thread) {
+    if (!is_idle(t)) {
 	t->recent_cpu = fixedAddInt(t->recent_cpu, 1);
     }
     /* Enforce preemption and update priorities. */
-    if (++thread_ticks >= TIME_SLICE) {
+    if (++c->thread_ticks >= TIME_SLICE) {
 	if (thread_mlfqs) {
-	    thread_foreach(thread_update_advanced_priority, NULL);
+	    priorities_stale = true;
 	}
         intr_yield_on_return();
     }
 
-    if (timer_ticks() % TIMER_FREQ == 0) {
-	/* Update average load. */
-	thread_load_avg = fixedAdd(fixedMultiplyInt(thread_load_avg, 59),
-				   int2fixed(ready_threads));
-	thread_load_avg = fixedDivideInt(thread_load_avg, 60);
+    /* Threads are waiting here, so have a CPU that stopped its timer
+       look for work to steal. */
+    if (c->ready_cnt > 0) {
+        int i;
+        for (i = 0; i < cpu_cnt; i++)
+            if (cpus[i].ticks_stopped) {
+                smp_wake(&cpus[i]);
+                break;
+            }
+    }
+}
+
+/*! Accounts for a timer tick that the current CPU, which is idle, slept
+    through with its timer stopped.  Called by timer_restart_ticks() once
+    for each such tick, with interrupts off.  Like thread_tick(), except
+    that no thread is preempted. */
+void thread_tick_missed(void) {
+    struct cpu *c = cpu_current();
+
+    idle_ticks++;
+    c->idle_ticks++;
+    if (thread_mlfqs && ++c->thread_ticks >= TIME_SLICE) {
+        c->thread_ticks = 0;
+        priorities_stale = true;
+    }
+}
+
+/*! The deferred work of timer interrupts, run with interrupts on after
+    one or more calls to thread_tick().  Does the work that goes by
+    timer_ticks(), which advances only on the bootstrap processor's ticks,
+    for each tick since it last ran, and wakes sleeping threads that are
+    due. */
+void thread_tick_deferred(void) {
+    int64_t now = timer_ticks();
+
+    if (priorities_stale) {
+        priorities_stale = false;
+        deferred_foreach(thread_update_advanced_priority, NULL);
+    }
 
-	thread_foreach(thread_update_recent_cpu, NULL);
+    while (ticks_done < now) {
+        if (++ticks_done % TIMER_FREQ == 0) {
+	    /* Update average load, then have the worker update recent_cpu,
+	       which depends on it. */
+	    thread_load_avg = fixedAdd(fixedMultiplyInt(thread_load_avg, 59),
+				       int2fixed(ready_threads));
+	    thread_load_avg = fixedDivideInt(thread_load_avg, 60);
+
+	    work_queue(&recent_cpu_work);
+        }
     }
 
     int64_t cur_alarm = get_alarm();
-    if (cur_alarm != 0 && cur_alarm < timer_ticks())
+    if (cur_alarm != 0 && cur_alarm < now)
         wake_thread();
 }
 
+/*! Calls FUNC on every thread, passing along AUX, like thread_foreach(),
+    but from deferred interrupt work and with interrupts off only during
+    each call.  No other thread runs during deferred work, and interrupt
+    handlers do not create or destroy threads, so the list of all threads
+    cannot change in the middle of the pass. */
+static void deferred_foreach(thread_action_func *func, void *aux) {
+    struct list_elem *e;
+
+    ASSERT(intr_deferred_context());
+
+    for (e = list_begin(&all_list); e != list_end(&all_list);
+         e = list_next(e)) {
+        enum intr_level old_level = intr_disable();
+        func(list_entry(e, struct thread, allelem), aux);
+        intr_set_level(old_level);
+    }
+}
+
+/*! Recomputes recent_cpu for every thread.  Run by the worker thread,
+    which lets interrupts in between threads.  Other threads may run and
+    exit meanwhile, so the place in the list of all threads is kept in
+    RECENT_CPU_NEXT, which thread_exit() moves past an exiting thread. */
+static void update_recent_cpu(struct work *w UNUSED) {
+    enum intr_level old_level = intr_disable();
+
+    recent_cpu_next = list_begin(&all_list);
+    while (recent_cpu_next != list_end(&all_list)) {
+        struct thread *t = list_entry(recent_cpu_next, struct thread,
+                                      allelem);
+
+        recent_cpu_next = list_next(recent_cpu_next);
+        thread_update_recent_cpu(t, NULL);
+
+        intr_set_level(old_level);
+        old_level = intr_disable();
+    }
+    recent_cpu_next = NULL;
+    intr_set_level(old_level);
+}
+
 static void wake_thread(void) {
     // Loop through blocked threads and find threads to wake up.
     // If no more sleeping threads in blocked list, then set alarm = 0;
@@ -211,8 +343,15 @@ static void wake_thread(void) {
 
 /*! Prints thread statistics. */
 void thread_print_stats(void) {
+    int i;
+
     printf("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
            idle_ticks, kernel_ticks, user_ticks);
+    for (i = 0; i < cpu_cnt; i++)
+        printf("CPU %d: %lld idle ticks, %lld threads migrated in\n",
+               i, cpus[i].idle_ticks, cpus[i].migrations);
+    printf("Thread pool: %lld pages reused, %lld allocated\n",
+           pool_hits, pool_misses);
 }
 
 /*! Creates a new kernel thread named NAME with the given initial PRIORITY,
@@ -239,8 +378,9 @@ tid_t thread_create(const char *name, int priority, thread_func *function,
 
     ASSERT(function != NULL);
 
-    /* Allocate thread. */
-    t = palloc_get_page(PAL_ZERO);
+    /* Allocate thread.  init_thread() clears the struct thread; the stack
+       above it needs no clearing. */
+    t = thread_page_get();
     if (t == NULL)
         return TID_ERROR;
 
@@ -284,7 +424,7 @@ void thread_block(void) {
 
     struct thread* me = thread_current();
     me->status = THREAD_BLOCKED;
-    if (me != idle_thread) {
+    if (in_load_avg(me)) {
 	ready_threads--;
 	ASSERT(ready_threads >= 0);
     }
@@ -293,22 +433,30 @@ void thread_block(void) {
 
 /*! Transitions a blocked thread T to the ready-to-run state.  This is an
     error if T is not blocked.  (Use thread_yield() to make the running
-    thread ready.)
+    thread ready.)  T goes on the ready queue of the CPU chosen by
+    choose_cpu(), which is woken up if it is idle.
 
     This function does not preempt the running thread.  This can be important:
     if the caller had disabled interrupts itself, it may expect that it can
     atomically unblock a thread and update other data. */
 void thread_unblock(struct thread *t) {
     enum intr_level old_level;
+    struct cpu *c;
 
     ASSERT(is_thread(t));
 
     old_level = intr_disable();
     ASSERT(t->status == THREAD_BLOCKED);
+    c = choose_cpu(t);
+    if (t->cpu != NULL && t->cpu != c)
+        c->migrations++;
+    t->cpu = c;
     add_to_ready_queue(t);
     t->status = THREAD_READY;
-    if (t != idle_thread)
+    if (in_load_avg(t))
 	ready_threads++;
+    if (c != cpu_current() && c->current == c->idle)
+        smp_wake(c);
     intr_set_level(old_level);
 }
 
@@ -352,9 +500,13 @@ void thread_exit(void) {
        and schedule another process.  That process will destroy us
        when it calls thread_schedule_tail(). */
     intr_disable();
+    if (recent_cpu_next == &thread_current()->allelem)
+        recent_cpu_next = list_next(recent_cpu_next);
     list_remove(&thread_current()->allelem);
-    ready_threads--;
-    ASSERT(ready_threads >= 0);
+    if (in_load_avg(thread_current())) {
+        ready_threads--;
+        ASSERT(ready_threads >= 0);
+    }
     thread_current()->status = THREAD_DYING;
     schedule();
     NOT_REACHED();
@@ -369,7 +521,7 @@ void thread_yield(void) {
     ASSERT(!intr_context());
 
     old_level = intr_disable();
-    if (cur != idle_thread) {
+    if (!is_idle(cur)) {
 	add_to_ready_queue(cur);
     }
     cur->status = THREAD_READY;
@@ -377,6 +529,21 @@ void thread_yield(void) {
     intr_set_level(old_level);
 }
 
+/*! Makes the running thread a background thread, one that serves the rest
+    of the kernel, like the worker thread, and so is left out of the load
+    average, as the idle threads are. */
+void thread_set_background(void) {
+    struct thread *cur = thread_current();
+    enum intr_level old_level = intr_disable();
+
+    if (!cur->background) {
+        cur->background = true;
+        ready_threads--;
+        ASSERT(ready_threads >= 0);
+    }
+    intr_set_level(old_level);
+}
+
 /*! Invoke function 'func' on all threads, passing along 'aux'.
     This function must be called with interrupts off. */
 void thread_foreach(thread_action_func *func, void *aux) {
@@ -441,7 +608,7 @@ void thread_update_advanced_priority(struct thread* t, void* aux UNUSED) {
     int priority;
     enum intr_level old_level;
 
-    if (t == idle_thread)
+    if (is_idle(t))
 	return;
 
     old_level = intr_disable();
@@ -457,10 +624,12 @@ void thread_update_advanced_priority(struct thread* t, void* aux UNUSED) {
     priority = (priority < PRI_MIN) ? PRI_MIN : priority;
     
     // Remove from the ready queue it's in
-    t->priority = priority;
     if (t->status == THREAD_READY) {
-	list_remove(&t->elem);
+	remove_from_ready_queue(t);
+	t->priority = priority;
 	add_to_ready_queue(t);
+    } else {
+	t->priority = priority;
     }
 
     intr_set_level(old_level);
@@ -522,24 +691,62 @@ int thread_get_recent_cpu(void) {
     return fixed2intRoundClosest(scaled);
 }
 
-/*! Idle thread.  Executes when no other thread is ready to run.
+/*! Idle thread of the bootstrap processor.  Executes when no other thread
+    is ready to run.
 
     The idle thread is initially put on the ready list by thread_start().
     It will be scheduled once initially, at which point it initializes
-    idle_thread, "up"s the semaphore passed to it to enable thread_start()
+    cpus[0].idle, "up"s the semaphore passed to it to enable thread_start()
     to continue, and immediately blocks.  After that, the idle thread never
     appears in the ready list.  It is returned by next_thread_to_run() as a
     special case when the ready list is empty. */
 static void idle(void *idle_started_ UNUSED) {
     struct semaphore *idle_started = idle_started_;
-    idle_thread = thread_current();
+    struct thread *t = thread_current();
+
+    t->cpu->idle = t;
     sema_up(idle_started);
+    thread_idle();
+}
+
+/*! Creates the idle thread of application processor C, which starts out
+    running it.  The caller must set up the thread's stack.  Returns the new
+    thread, or a null pointer if there is no page for it. */
+struct thread * thread_create_idle(struct cpu *c) {
+    struct thread *t;
+    char name[16];
+
+    t = thread_page_get();
+    if (t == NULL)
+        return NULL;
+
+    snprintf(name, sizeof name, "idle%d", c->id);
+    init_thread(t, name, PRI_MIN);
+    t->tid = allocate_tid();
+    t->cpu = c;
+    t->status = THREAD_RUNNING;
+    c->idle = c->current = t;
+    return t;
+}
+
+/*! The loop of the current CPU's idle thread.  The kernel lock must be
+    held, and is let go while the CPU waits for an interrupt. */
+void thread_idle(void) {
+    struct cpu *c = thread_current()->cpu;
 
     for (;;) {
-        /* Let someone else run. */
+        /* Let someone else run, taking work from a busier CPU if we have
+           none of our own. */
         intr_disable();
+        if (c->ready_cnt == 0)
+            steal_thread(c);
         thread_block();
 
+        /* Stop the timer if it has nothing to do until the next
+           deadline, then let other CPUs into the kernel while we wait. */
+        timer_stop_ticks();
+        kernel_lock_release();
+
         /* Re-enable interrupts and wait for the next one.
 
            The `sti' instruction disables interrupts until the completion of
@@ -551,6 +758,10 @@ static void idle(void *idle_started_ UNUSED) {
            See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
            7.11.1 "HLT Instruction". */
         asm volatile ("sti; hlt" : : : "memory");
+
+        intr_disable();
+        kernel_lock_acquire();
+        timer_restart_ticks();
     }
 }
 
@@ -575,6 +786,86 @@ struct thread * running_thread(void) {
     return pg_round_down(esp);
 }
 
+/*! Returns the CPU we are running on. */
+struct cpu * cpu_current(void) {
+    return running_thread()->cpu;
+}
+
+/*! Returns true if T is the idle thread of its CPU. */
+static bool is_idle(struct thread *t) {
+    return t->cpu != NULL && t == t->cpu->idle;
+}
+
+/*! Returns true if T counts in READY_THREADS, and so in the load average,
+    while it is ready or running: unless it is an idle thread or a
+    background thread. */
+static bool in_load_avg(struct thread *t) {
+    return !is_idle(t) && !t->background;
+}
+
+/*! Returns the CPU whose ready queue T, which is about to become ready,
+    should join: its own CPU, or the CPU that is creating it, unless that
+    CPU is busy and another is idle. */
+static struct cpu * choose_cpu(struct thread *t) {
+    struct cpu *c = t->cpu != NULL ? t->cpu : cpu_current();
+    int i;
+
+    if (c->current == c->idle && c->ready_cnt == 0)
+        return c;
+    for (i = 0; i < cpu_cnt; i++)
+        if (cpus[i].current == cpus[i].idle && cpus[i].ready_cnt == 0)
+            return &cpus[i];
+    return c;
+}
+
+/*! Moves a thread to idle CPU C from the CPU with the most threads waiting
+    to run, if any.  The thread moved is the one of highest priority,
+    counting donations, among those that have not run in the last
+    CACHE_HOT_TICKS ticks, since a thread that has run lately probably
+    still has its working set in its own CPU's cache.  An idle CPU tries
+    again at each timer tick, so threads that are passed over for now are
+    not stuck. */
+static void steal_thread(struct cpu *c) {
+    struct cpu *victim = NULL;
+    struct thread *best = NULL;
+    int64_t now = timer_ticks();
+    int i;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    /* A CPU running its idle thread is about to run its own queue. */
+    for (i = 0; i < cpu_cnt; i++) {
+        struct cpu *p = &cpus[i];
+        if (p != c && p->current != p->idle && p->ready_cnt > 0
+            && (victim == NULL || p->ready_cnt > victim->ready_cnt))
+            victim = p;
+    }
+    if (victim == NULL)
+        return;
+
+    /* A donation raises a thread's priority without moving it to another
+       ready list, so look at every list. */
+    for (i = PRI_MAX; i >= PRI_MIN; i--) {
+        struct list *list = &victim->ready_lists[i];
+        struct list_elem *e;
+
+        for (e = list_begin(list); e != list_end(list); e = list_next(e)) {
+            struct thread *t = list_entry(e, struct thread, elem);
+            if (t->status == THREAD_READY
+                && now - t->last_ran >= CACHE_HOT_TICKS
+                && (best == NULL || t->priority > best->priority))
+                best = t;
+        }
+    }
+    if (best == NULL)
+        return;
+
+    remove_from_ready_queue(best);
+    best->cpu = c;
+    add_to_ready_queue(best);
+    c->migrations++;
+}
+
 /*! Returns true if T appears to point to a valid thread. */
 static bool is_thread(struct thread *t) {
     return t != NULL && t->magic == THREAD_MAGIC;
@@ -604,6 +895,26 @@ static void init_thread(struct thread *t, const char *name, int priority) {
     t->donee = NULL;
     list_init(&t->donors);
 
+#ifdef USERPROG
+    t->process = t;
+    t->stack_slot = -1;
+    list_init(&t->files);
+    t->next_fd = 2;
+    list_init(&t->children);
+    t->self = NULL;
+    t->batch_ring = NULL;
+    list_init(&t->threads);
+    t->stack_slots = 0;
+    t->exiting = false;
+    lock_init(&t->lock);
+#endif
+#ifdef VM
+    lock_init(&t->pages_lock);
+    list_init(&t->mappings);
+    t->next_mapid = 0;
+    list_init(&t->shm_attachments);
+#endif
+
     old_level = intr_disable();
     list_push_back(&all_list, &t->allelem);
     intr_set_level(old_level);
@@ -620,27 +931,61 @@ static void * alloc_frame(struct thread *t, size_t size) {
     return t->stack;
 }
 
-/*! Chooses and returns the next thread to be scheduled.  Should return a
-    thread from the run queue, unless the run queue is empty.  (If the running
-    thread can continue running, then it will be in the run queue.)  If the
-    run queue is empty, return idle_thread. */
-static struct thread * next_thread_to_run(void) {
-  
+/*! Returns a page for a new thread, from the pool if it has one, or a null
+    pointer if no page is available. */
+static struct thread * thread_page_get(void) {
+    struct thread *t = NULL;
+    enum intr_level old_level;
 
+    old_level = intr_disable();
+    if (thread_pool_cnt > 0) {
+        t = thread_pool[--thread_pool_cnt];
+        pool_hits++;
+    }
+    intr_set_level(old_level);
+
+    if (t == NULL) {
+        t = palloc_get_page(0);
+        if (t != NULL)
+            pool_misses++;
+    }
+    return t;
+}
+
+/*! Releases the page of dead thread T to the pool, or to the page allocator
+    if the pool is full. */
+static void thread_page_put(struct thread *t) {
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (thread_pool_cnt < THREAD_POOL_PAGES)
+        thread_pool[thread_pool_cnt++] = t;
+    else
+        palloc_free_page(t);
+}
+
+/*! Chooses and returns the next thread to be scheduled on CPU C.  Should
+    return a thread from C's run queue, unless the run queue is empty.  (If
+    the running thread can continue running, then it will be in the run
+    queue.)  If the run queue is empty, return C's idle thread. */
+static struct thread * next_thread_to_run(struct cpu *c) {
     int i;
+
+    if (c->ready_cnt == 0)
+	return c->idle;
     for (i = PRI_MAX; i >= PRI_MIN; --i) {
-	while (!list_empty(&ready_priority_lists[i])) {
+	while (!list_empty(&c->ready_lists[i])) {
 	    struct thread* t;
-	    t = list_entry(list_pop_front(&ready_priority_lists[i]),
+	    t = list_entry(list_pop_front(&c->ready_lists[i]),
 			   struct thread,
 			   elem);
+	    c->ready_cnt--;
 	    if (t->status == THREAD_READY) {
 		return t;
 	    }
 	}
     }
     // no ready threads
-    return idle_thread;
+    return c->idle;
 }
 
 /*! Completes a thread switch by activating the new thread's page tables, and,
@@ -664,9 +1009,10 @@ void thread_schedule_tail(struct thread *prev) {
 
     /* Mark us as running. */
     cur->status = THREAD_RUNNING;
+    cur->cpu->current = cur;
 
     /* Start new time slice. */
-    thread_ticks = 0;
+    cur->cpu->thread_ticks = 0;
 
 #ifdef USERPROG
     /* Activate the new address space. */
@@ -680,7 +1026,7 @@ void thread_schedule_tail(struct thread *prev) {
     if (prev != NULL && prev->status == THREAD_DYING &&
         prev != initial_thread) {
         ASSERT(prev != cur);
-        palloc_free_page(prev);
+        thread_page_put(prev);
     }
 }
 
@@ -692,13 +1038,14 @@ void thread_schedule_tail(struct thread *prev) {
     completed. */
 static void schedule(void) {
     struct thread *cur = running_thread();
-    struct thread *next = next_thread_to_run();
+    struct thread *next = next_thread_to_run(cur->cpu);
     struct thread *prev = NULL;
 
     ASSERT(intr_get_level() == INTR_OFF);
     ASSERT(cur->status != THREAD_RUNNING);
     ASSERT(is_thread(next));
 
+    cur->last_ran = timer_ticks();
     if (cur != next)
         prev = switch_threads(cur, next);
     thread_schedule_tail(prev);
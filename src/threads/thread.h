@@ -11,6 +11,13 @@
 #include <stdint.h>
 
 #include "fixed_point.h"
+#include "threads/synch.h"
+
+#ifdef VM
+#include <hash.h>
+#endif
+
+struct cpu;
 
 /*! States in a thread's life cycle. */
 enum thread_status {
@@ -113,6 +120,13 @@ struct thread {
                                            this thread. */
     struct thread* donee;               /*!< Pointer to the thread
 					  receiving a donation. */
+    struct cpu *cpu;                    /*!< CPU we run on, or last ran
+                                           on, or are queued on. */
+    int64_t last_ran;                   /*!< Timer tick at which we last
+                                           stopped running. */
+    bool background;                    /*!< Left out of the load
+                                           average?  See
+                                           thread_set_background(). */
     /**@}*/
 
     /*! Shared between thread.c and synch.c. */
@@ -123,10 +137,50 @@ struct thread {
     /**@}*/
 
 #ifdef USERPROG
-    /*! Owned by userprog/process.c. */
+    /*! Owned by userprog/process.c.  The threads of a process share the
+        state kept by its main thread; the others use only PROCESS,
+        STACK_SLOT, and SELF, which records their exit for
+        thread_join(). */
     /**@{*/
+    struct thread *process;             /*!< Main thread of our process. */
+    int stack_slot;                     /*!< User stack slot, or -1. */
     uint32_t *pagedir;                  /*!< Page directory. */
+    struct file *exec_file;             /*!< Running executable. */
+    struct list files;                  /*!< Open files. */
+    int next_fd;                        /*!< Next file descriptor to use. */
+    struct list children;               /*!< Exit status of each child. */
+    struct child *self;                 /*!< Our own exit status record. */
+    struct batch_ring *batch_ring;      /*!< Kernel address of batch ring. */
+    struct list threads;                /*!< Exit status of other threads. */
+    uint32_t stack_slots;               /*!< Stack slots in use, one bit
+                                           per slot. */
+    bool exiting;                       /*!< Whether the process is ending. */
+    struct lock lock;                   /*!< Protects FILES, CHILDREN,
+                                           THREADS, STACK_SLOTS and
+                                           EXITING among our threads. */
+    /**@{*/
+#endif
+
+#ifdef VM
+    /*! Owned by vm/page.c. */
+    /**@{*/
+    struct hash pages;                  /*!< Supplemental page table. */
+    struct lock pages_lock;             /*!< Protects PAGES and MAPPINGS
+                                           among the process's threads. */
+    void *last_fault;                   /*!< Page of the last page fault. */
+    int fault_run;                      /*!< # of forward faults up to it. */
+    /**@}*/
+
+    /*! Owned by vm/mmap.c. */
     /**@{*/
+    struct list mappings;               /*!< Memory-mapped files. */
+    int next_mapid;                     /*!< Next mapping identifier. */
+    /**@}*/
+
+    /*! Owned by vm/shm.c. */
+    /**@{*/
+    struct list shm_attachments;        /*!< Attached shared memory. */
+    /**@}*/
 #endif
 
     // Added for alarm clock
@@ -147,6 +201,8 @@ void thread_init(void);
 void thread_start(void);
 
 void thread_tick(void);
+void thread_tick_missed(void);
+void thread_tick_deferred(void);
 void thread_print_stats(void);
 
 typedef void thread_func(void *aux);
@@ -161,6 +217,10 @@ const char *thread_name(void);
 
 void thread_exit(void) NO_RETURN;
 void thread_yield(void);
+void thread_set_background(void);
+
+struct thread *thread_create_idle(struct cpu *);
+void thread_idle(void) NO_RETURN;
 
 /*! Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func(struct thread *t, void *aux);
@@ -0,0 +1,90 @@
+/*! \file worker.c
+ *
+ * The kernel worker thread, which takes over jobs too long to do in an
+ * interrupt handler or its deferred work.  Work items are queued with
+ * interrupts off rather than under a lock, so that interrupt handlers can
+ * queue them, and each is queued at most once at a time: queuing a job
+ * that is still waiting to run does nothing.  For the same reason, the
+ * worker waits for work by blocking itself rather than on a semaphore,
+ * whose sema_up() might yield.
+ *
+ * The worker is a background thread: it is not counted in the load average,
+ * which would otherwise rise whenever the kernel had work to do on its own
+ * behalf.
+ */
+
+#include "threads/worker.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static struct list queue;               /*!< Work items waiting to run. */
+static struct thread *worker;           /*!< The worker thread. */
+static bool worker_waiting;             /*!< Worker blocked for work? */
+
+static thread_func worker_thread NO_RETURN;
+
+/*! Starts the worker thread. */
+void worker_init(void) {
+    struct semaphore started;
+
+    list_init(&queue);
+    sema_init(&started, 0);
+    if (thread_create("worker", PRI_MAX, worker_thread, &started)
+        == TID_ERROR)
+        PANIC("could not start worker thread");
+    sema_down(&started);
+}
+
+/*! Initializes W to do its job by calling FUNC. */
+void work_init(struct work *w, work_func *func) {
+    w->queued = false;
+    w->func = func;
+}
+
+/*! Queues W for the worker thread, unless it is queued already.  May be
+    called from an interrupt handler or deferred interrupt work, in which
+    case the worker preempts the interrupted thread if it outranks it. */
+void work_queue(struct work *w) {
+    enum intr_level old_level = intr_disable();
+
+    if (!w->queued) {
+        w->queued = true;
+        list_push_back(&queue, &w->elem);
+    }
+    if (worker_waiting) {
+        worker_waiting = false;
+        thread_unblock(worker);
+        if ((intr_context() || intr_deferred_context())
+            && worker->cpu == thread_current()->cpu
+            && worker->priority > thread_current()->priority)
+            intr_yield_on_return();
+    }
+    intr_set_level(old_level);
+}
+
+/*! Runs queued work items, oldest first. */
+static void worker_thread(void *started_) {
+    struct semaphore *started = started_;
+
+    worker = thread_current();
+    thread_set_background();
+    sema_up(started);
+
+    for (;;) {
+        enum intr_level old_level;
+        struct work *w;
+
+        old_level = intr_disable();
+        while (list_empty(&queue)) {
+            worker_waiting = true;
+            thread_block();
+        }
+        w = list_entry(list_pop_front(&queue), struct work, elem);
+        w->queued = false;
+        intr_set_level(old_level);
+
+        w->func(w);
+    }
+}
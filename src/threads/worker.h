@@ -0,0 +1,25 @@
+#ifndef THREADS_WORKER_H
+#define THREADS_WORKER_H
+
+#include <list.h>
+#include <stdbool.h>
+
+struct work;
+
+/*! Does the job described by a work item. */
+typedef void work_func(struct work *);
+
+/*! A job for the kernel worker thread.  The owner embeds it in a larger
+    structure, if the job needs more data, and initializes it with
+    work_init(). */
+struct work {
+    struct list_elem elem;      /*!< Element in the worker's queue. */
+    bool queued;                /*!< In the queue now? */
+    work_func *func;            /*!< Does the job. */
+};
+
+void worker_init(void);
+void work_init(struct work *, work_func *);
+void work_queue(struct work *);
+
+#endif /* threads/worker.h */
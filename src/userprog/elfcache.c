@@ -0,0 +1,190 @@
+/*! \file elfcache.c
+ *
+ * Cache of parsed executables.  Loading a program means reading and
+ * validating its ELF header and program headers and then reading its
+ * segments.  Test harnesses and batch jobs run the same few programs over
+ * and over, so the results are kept here, keyed by the executable's inode,
+ * for the next load to use instead.
+ *
+ * Besides the segment layout, an image holds copies of the pages that
+ * loading it reads from the file into private memory, up to
+ * ELF_IMAGE_PAGES of them.  With virtual memory that is just the data
+ * segment: read-only pages are mapped through the page cache and already
+ * shared by every process running the program.
+ *
+ * An image stays valid until its executable is written to.  An image holds
+ * its inode open, so a removed executable lingers until its image is
+ * evicted, which happens to the least recently used image once there are
+ * ELF_CACHE_IMAGES of them.
+ */
+
+#include "userprog/elfcache.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/*! Maximum number of images cached. */
+#define ELF_CACHE_IMAGES 8
+
+/*! Maximum number of page copies kept per image. */
+#define ELF_IMAGE_PAGES 8
+
+static struct list images;      /*!< Cached images, most recent first. */
+static size_t image_cnt;        /*!< Number of images in IMAGES. */
+static struct lock cache_lock;  /*!< Protects IMAGES and IMAGE_CNT. */
+
+/* Statistics. */
+static long long hit_cnt;       /*!< # of loads that found their image. */
+static long long miss_cnt;      /*!< # of loads that did not. */
+
+static size_t image_copy_cnt(const struct elf_image *);
+static size_t segment_page_cnt(const struct elf_segment *);
+
+/*! Initializes the executable cache. */
+void elf_cache_init(void) {
+    list_init(&images);
+    lock_init(&cache_lock);
+}
+
+/*! Returns a new image with no segments yet, but room for MAX_SEGS, and no
+    inode, or a null pointer if memory allocation fails. */
+struct elf_image * elf_image_create(size_t max_segs) {
+    struct elf_image *img = malloc(sizeof *img);
+
+    if (img == NULL)
+        return NULL;
+    img->inode = NULL;
+    img->seg_cnt = 0;
+    img->segs = calloc(max_segs > 0 ? max_segs : 1, sizeof *img->segs);
+    if (img->segs == NULL) {
+        free(img);
+        return NULL;
+    }
+    return img;
+}
+
+/*! Frees IMG, which must not be in the cache, with its page copies, and
+    closes its inode. */
+void elf_image_destroy(struct elf_image *img) {
+    size_t i, j;
+
+    for (i = 0; i < img->seg_cnt; i++) {
+        struct elf_segment *seg = &img->segs[i];
+        if (seg->copies != NULL) {
+            for (j = 0; j < segment_page_cnt(seg); j++)
+                if (seg->copies[j] != NULL)
+                    palloc_free_page(seg->copies[j]);
+            free(seg->copies);
+        }
+    }
+    inode_close(img->inode);
+    free(img->segs);
+    free(img);
+}
+
+/*! Makes room in SEG, a segment of IMG, for copies of the pages it reads
+    from the file, to be filled in as they are loaded, if IMG's page budget
+    allows.  Returns true if successful. */
+bool elf_image_keep_copies(struct elf_image *img, struct elf_segment *seg) {
+    size_t page_cnt = segment_page_cnt(seg);
+
+    ASSERT(seg->copies == NULL);
+    if (page_cnt == 0 || image_copy_cnt(img) + page_cnt > ELF_IMAGE_PAGES)
+        return false;
+    seg->copies = calloc(page_cnt, sizeof *seg->copies);
+    return seg->copies != NULL;
+}
+
+/*! Returns the cached image of the executable INODE, or a null pointer if
+    there is none.  The image stays valid for as long as INODE cannot be
+    written, so the caller should deny writes to it first. */
+struct elf_image * elf_cache_lookup(struct inode *inode) {
+    struct elf_image *img = NULL;
+    struct list_elem *e;
+
+    lock_acquire(&cache_lock);
+    for (e = list_begin(&images); e != list_end(&images); e = list_next(e)) {
+        struct elf_image *candidate = list_entry(e, struct elf_image, elem);
+        if (candidate->inode == inode) {
+            img = candidate;
+            list_remove(&img->elem);
+            list_push_front(&images, &img->elem);
+            break;
+        }
+    }
+    if (img != NULL)
+        hit_cnt++;
+    else
+        miss_cnt++;
+    lock_release(&cache_lock);
+
+    return img;
+}
+
+/*! Adds IMG, the image just loaded from INODE, to the cache, which takes
+    it over, evicting the least recently used image if the cache is
+    full. */
+void elf_cache_insert(struct elf_image *img, struct inode *inode) {
+    struct elf_image *victim = NULL;
+
+    ASSERT(img->inode == NULL);
+    img->inode = inode_reopen(inode);
+
+    lock_acquire(&cache_lock);
+    list_push_front(&images, &img->elem);
+    if (++image_cnt > ELF_CACHE_IMAGES) {
+        victim = list_entry(list_pop_back(&images), struct elf_image, elem);
+        image_cnt--;
+    }
+    lock_release(&cache_lock);
+
+    if (victim != NULL)
+        elf_image_destroy(victim);
+}
+
+/*! Drops the image of INODE from the cache, if there is one.  Called by
+    inode_write_at() whenever INODE is written. */
+void elf_cache_invalidate(struct inode *inode) {
+    struct elf_image *img = NULL;
+    struct list_elem *e;
+
+    lock_acquire(&cache_lock);
+    for (e = list_begin(&images); e != list_end(&images); e = list_next(e)) {
+        struct elf_image *candidate = list_entry(e, struct elf_image, elem);
+        if (candidate->inode == inode) {
+            img = candidate;
+            list_remove(&img->elem);
+            image_cnt--;
+            break;
+        }
+    }
+    lock_release(&cache_lock);
+
+    if (img != NULL)
+        elf_image_destroy(img);
+}
+
+/*! Prints executable cache statistics. */
+void elf_cache_print_stats(void) {
+    printf("Exec cache: %lld hits, %lld misses\n", hit_cnt, miss_cnt);
+}
+
+/*! Returns the number of page copies IMG has room for. */
+static size_t image_copy_cnt(const struct elf_image *img) {
+    size_t i, cnt = 0;
+
+    for (i = 0; i < img->seg_cnt; i++)
+        if (img->segs[i].copies != NULL)
+            cnt += segment_page_cnt(&img->segs[i]);
+    return cnt;
+}
+
+/*! Returns the number of pages of SEG that are read from the file. */
+static size_t segment_page_cnt(const struct elf_segment *seg) {
+    return DIV_ROUND_UP(seg->read_bytes, PGSIZE);
+}
@@ -0,0 +1,41 @@
+#ifndef USERPROG_ELFCACHE_H
+#define USERPROG_ELFCACHE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct inode;
+
+/*! A loadable segment of an executable, in whole pages. */
+struct elf_segment {
+    uint32_t ofs;               /*!< Page-aligned offset in the file. */
+    uint8_t *upage;             /*!< Page-aligned user address. */
+    uint32_t read_bytes;        /*!< Bytes read from the file. */
+    uint32_t zero_bytes;        /*!< Bytes zeroed after them. */
+    bool writable;              /*!< Writable by the process? */
+    void **copies;              /*!< Copies of the pages read, or NULL. */
+};
+
+/*! What loading an executable needs to know about it, taken from its
+    validated ELF headers, along with copies of the pages that loading it
+    reads from the file, where there is room for them. */
+struct elf_image {
+    struct inode *inode;        /*!< The executable. */
+    uint32_t entry;             /*!< Entry point. */
+    size_t seg_cnt;             /*!< Number of loadable segments. */
+    struct elf_segment *segs;   /*!< The loadable segments. */
+    struct list_elem elem;      /*!< Element in the cache. */
+};
+
+void elf_cache_init(void);
+struct elf_image *elf_image_create(size_t max_segs);
+void elf_image_destroy(struct elf_image *);
+bool elf_image_keep_copies(struct elf_image *, struct elf_segment *);
+struct elf_image *elf_cache_lookup(struct inode *);
+void elf_cache_insert(struct elf_image *, struct inode *);
+void elf_cache_invalidate(struct inode *);
+void elf_cache_print_stats(void);
+
+#endif /* userprog/elfcache.h */
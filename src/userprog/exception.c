@@ -2,8 +2,13 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/usercopy.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /*! Number of page faults processed. */
 static long long page_fault_cnt;
@@ -134,6 +139,29 @@ static void page_fault(struct intr_frame *f) {
     write = (f->error_code & PF_W) != 0;
     user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+    /* A not-present fault on a page the process owns means the page was
+       evicted or was never read in; bring it in and retry the access. */
+    if (not_present && page_fault_in(fault_addr))
+        return;
+
+    /* A write to a present page the process may write is a write to a
+       copy-on-write page; give it a private copy and retry. */
+    if (!not_present && write && page_write_fault(fault_addr))
+        return;
+#endif
+
+    /* A bad user address passed to a system call faults in one of the user
+       copy routines; resume at its recovery code, which reports the error
+       to its caller. */
+    if (!user && is_user_vaddr(fault_addr)) {
+        uintptr_t fixup = usercopy_fixup((uintptr_t) f->eip);
+        if (fixup != 0) {
+            f->eip = (void (*)(void)) fixup;
+            return;
+        }
+    }
+
     /* To implement virtual memory, delete the rest of the function
        body, and replace it with code that brings in the page to
        which fault_addr refers. */
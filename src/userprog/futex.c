@@ -0,0 +1,262 @@
+/*! \file futex.c
+ *
+ * Futexes: blocking on a word of user memory.  User-space locks keep their
+ * state in an ordinary word and update it with atomic instructions, and
+ * call into the kernel only to sleep when they must wait, or to wake the
+ * waiters when they must not.  futex_wait() sleeps only if the word still
+ * holds the value the caller last saw, which closes the window between the
+ * caller's check and its going to sleep.
+ *
+ * Waiters are queued by the kernel address of the word, which names the
+ * physical frame holding it and the word's offset there.  Two processes
+ * that share memory therefore share wait queues however they have mapped
+ * it.  A waiter keeps its frame pinned, so that the word stays put while
+ * anyone might try to wake it.  A page that fork() left shared
+ * copy-on-write is not shared memory, though: the first write, such as the
+ * waker's, would move it to a new frame.  So a waiter first gets a private
+ * copy of such a page, as a write would give it.
+ *
+ * A process that is exiting wakes its threads from their futexes, so that
+ * they can exit too; see futex_cancel().
+ */
+
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#endif
+
+struct frame;
+
+/*! The threads waiting on one word. */
+struct futex_queue {
+    const uint32_t *key;        /*!< Kernel address of the word. */
+    struct list waiters;        /*!< List of struct futex_waiter. */
+    struct hash_elem elem;      /*!< Element in QUEUES. */
+};
+
+/*! A thread in futex_wait(). */
+struct futex_waiter {
+    struct thread *process;     /*!< Main thread of the waiter's process. */
+    struct semaphore woken;     /*!< Upped by futex_wake(). */
+    struct list_elem elem;      /*!< Element in its queue's list. */
+};
+
+static struct hash queues;      /*!< Nonempty wait queues, by key. */
+static struct lock futex_lock;  /*!< Protects QUEUES. */
+
+static hash_hash_func queue_hash;
+static hash_less_func queue_less;
+static const uint32_t *word_get(const uint32_t *uaddr, bool fault_in,
+                                struct frame **);
+static void word_put(struct frame *);
+static struct futex_queue *queue_lookup(const uint32_t *key);
+
+/*! Initializes the futex wait queues. */
+void futex_init(void) {
+    if (!hash_init(&queues, queue_hash, queue_less, NULL))
+        PANIC("futex table creation failed");
+    lock_init(&futex_lock);
+}
+
+/*! Sleeps until woken by futex_wake() on the same word, provided that the
+    user word at UADDR holds EXPECTED.  Returns 0 after waking, or -1 at
+    once if the word holds some other value, UADDR is not a valid, aligned
+    user word, memory allocation fails, or the process is exiting. */
+int futex_wait(const uint32_t *uaddr, uint32_t expected) {
+    struct futex_waiter w;
+    struct futex_queue *q;
+    const uint32_t *key;
+    struct frame *frame;
+
+    key = word_get(uaddr, true, &frame);
+    if (key == NULL)
+        return -1;
+
+    lock_acquire(&futex_lock);
+    if (*key != expected || process_current()->exiting) {
+        lock_release(&futex_lock);
+        word_put(frame);
+        return -1;
+    }
+    q = queue_lookup(key);
+    if (q == NULL) {
+        q = malloc(sizeof *q);
+        if (q == NULL) {
+            lock_release(&futex_lock);
+            word_put(frame);
+            return -1;
+        }
+        q->key = key;
+        list_init(&q->waiters);
+        hash_insert(&queues, &q->elem);
+    }
+    w.process = process_current();
+    sema_init(&w.woken, 0);
+    list_push_back(&q->waiters, &w.elem);
+    lock_release(&futex_lock);
+
+    sema_down(&w.woken);
+    word_put(frame);
+    return 0;
+}
+
+/*! Wakes up to N of the threads waiting on the user word at UADDR, oldest
+    first.  Returns the number woken, or -1 if UADDR is not a valid,
+    aligned user word. */
+int futex_wake(const uint32_t *uaddr, int n) {
+    struct futex_queue *q;
+    const uint32_t *key;
+    struct frame *frame;
+    int woken = 0;
+
+    /* Nobody can be waiting on a word that is not in memory. */
+    if ((uintptr_t) uaddr % sizeof *uaddr != 0 || !is_user_vaddr(uaddr))
+        return -1;
+    key = word_get(uaddr, false, &frame);
+    if (key == NULL)
+        return 0;
+
+    lock_acquire(&futex_lock);
+    q = queue_lookup(key);
+    if (q != NULL) {
+        while (woken < n && !list_empty(&q->waiters)) {
+            struct list_elem *e = list_pop_front(&q->waiters);
+            sema_up(&list_entry(e, struct futex_waiter, elem)->woken);
+            woken++;
+        }
+        if (list_empty(&q->waiters)) {
+            hash_delete(&queues, &q->elem);
+            free(q);
+        }
+    }
+    lock_release(&futex_lock);
+
+    word_put(frame);
+    return woken;
+}
+
+/*! Wakes every thread of the process whose main thread is PROCESS that is
+    sleeping in futex_wait().  The process must already be marked as
+    exiting, so that none of its threads can start waiting afterward. */
+void futex_cancel(struct thread *process) {
+    struct hash_iterator i;
+
+    ASSERT(process->exiting);
+
+    lock_acquire(&futex_lock);
+restart:
+    hash_first(&i, &queues);
+    while (hash_next(&i)) {
+        struct futex_queue *q = hash_entry(hash_cur(&i), struct futex_queue,
+                                           elem);
+        struct list_elem *e = list_begin(&q->waiters);
+
+        while (e != list_end(&q->waiters)) {
+            struct futex_waiter *w = list_entry(e, struct futex_waiter, elem);
+
+            e = list_next(e);
+            if (w->process == process) {
+                list_remove(&w->elem);
+                sema_up(&w->woken);
+            }
+        }
+
+        /* Deleting invalidates the iterator. */
+        if (list_empty(&q->waiters)) {
+            hash_delete(&queues, &q->elem);
+            free(q);
+            goto restart;
+        }
+    }
+    lock_release(&futex_lock);
+}
+
+/*! Returns the kernel address of the current process's user word at
+    UADDR, keeping the page that holds it in memory until word_put() is
+    called with the frame stored in *FRAME.  If FAULT_IN is false, returns
+    a null pointer if the page is not resident instead of bringing it in;
+    if it is true, a writable page still shared copy-on-write is first
+    copied.  Also returns a null pointer if UADDR is not a valid, aligned
+    user word. */
+static const uint32_t * word_get(const uint32_t *uaddr,
+                                 bool fault_in UNUSED,
+                                 struct frame **frame) {
+    struct thread *t = process_current();
+    const uint32_t *key;
+#ifdef VM
+    struct page *p;
+#endif
+
+    *frame = NULL;
+    if ((uintptr_t) uaddr % sizeof *uaddr != 0 || !is_user_vaddr(uaddr))
+        return NULL;
+
+#ifdef VM
+    /* Pages outside the supplemental page table, such as shared memory,
+       are never evicted and need no pin. */
+    page_table_lock();
+    p = page_lookup(uaddr);
+    if (p != NULL) {
+        *frame = fault_in ? page_pin(p) : frame_pin_page(p);
+        if (*frame != NULL && fault_in && p->type == PAGE_ANON &&
+            p->writable) {
+            struct frame *shared = *frame;
+
+            *frame = frame_cow(p, true) ? p->frame : NULL;
+            frame_unpin(shared);
+        }
+        if (*frame == NULL) {
+            page_table_unlock();
+            return NULL;
+        }
+    }
+    page_table_unlock();
+#endif
+
+    key = pagedir_get_page(t->pagedir, uaddr);
+    if (key == NULL)
+        word_put(*frame);
+    return key;
+}
+
+/*! Releases the page that word_get() kept in FRAME. */
+static void word_put(struct frame *frame UNUSED) {
+#ifdef VM
+    if (frame != NULL)
+        frame_unpin(frame);
+#endif
+}
+
+/*! Returns the queue of the waiters on the word at kernel address KEY, or
+    a null pointer if there are none.  The futex lock must be held. */
+static struct futex_queue * queue_lookup(const uint32_t *key) {
+    struct futex_queue probe;
+    struct hash_elem *e;
+
+    probe.key = key;
+    e = hash_find(&queues, &probe.elem);
+    return e != NULL ? hash_entry(e, struct futex_queue, elem) : NULL;
+}
+
+/*! Returns a hash value for the queue containing E. */
+static unsigned queue_hash(const struct hash_elem *e, void *aux UNUSED) {
+    const struct futex_queue *q = hash_entry(e, struct futex_queue, elem);
+    return hash_bytes(&q->key, sizeof q->key);
+}
+
+/*! Returns true if queue A's key precedes queue B's. */
+static bool queue_less(const struct hash_elem *a, const struct hash_elem *b,
+                       void *aux UNUSED) {
+    return hash_entry(a, struct futex_queue, elem)->key
+           < hash_entry(b, struct futex_queue, elem)->key;
+}
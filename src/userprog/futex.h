@@ -0,0 +1,13 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stdint.h>
+
+struct thread;
+
+void futex_init(void);
+int futex_wait(const uint32_t *uaddr, uint32_t expected);
+int futex_wake(const uint32_t *uaddr, int n);
+void futex_cancel(struct thread *process);
+
+#endif /* userprog/futex.h */
@@ -2,18 +2,49 @@
  *
  * Functions for initializing and manipulating page directory tables and
  * entries.
+ *
+ * The page directory loaded in CR3 is tracked here, so that switching to
+ * the one that is already loaded costs nothing.  Every page directory maps
+ * the kernel, so kernel threads never load one of their own: they keep
+ * running on whatever address space was loaded before them, and a process
+ * that is switched back to after a kernel thread finds its page directory
+ * still loaded.
+ *
+ * With more than one CPU, each has its own CR3 and TLB.  A change to a page
+ * directory loaded on other CPUs must be flushed from their TLBs too.  CPUs
+ * running user code in it are interrupted to flush at once.  CPUs that only
+ * borrow it for a kernel thread are just marked, and reload it before they
+ * run user code in it again.
  */
 
 #include "userprog/pagedir.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/smp.h"
+
+/*! Per CPU: the page directory loaded in CR3, or a null pointer for
+    init_page_dir; whether a kernel thread is only borrowing it; and whether
+    that CPU's TLB may be out of date for it.  @{ */
+static uint32_t *loaded_pd[CPU_MAX];
+static bool lazy[CPU_MAX];
+static bool stale[CPU_MAX];
+/*! @} */
+
+/* Statistics. */
+static long long cr3_load_cnt;  /*!< # of page directory loads. */
+static long long cr3_skip_cnt;  /*!< # of loads found unnecessary. */
 
 static uint32_t *active_pd(void);
-static void invalidate_pagedir(uint32_t *);
+static void load_pagedir(uint32_t *);
+static void invalidate_page(uint32_t *, const void *vaddr);
+static uint32_t loaded_elsewhere(uint32_t *);
+static void unload_pagedir(void *);
+static void flush_page(void *vaddr);
 
 /*! Creates a new page directory that has mappings for kernel virtual
     addresses, but none for user virtual addresses.  Returns the new page
@@ -25,14 +56,22 @@ uint32_t * pagedir_create(void) {
     return pd;
 }
 
-/*! Destroys page directory PD, freeing all the pages it references. */
+/*! Destroys page directory PD, freeing all the pages it references.  If PD is
+    loaded, for example because a kernel thread borrowed it, switches to the
+    kernel-only page directory first, on every CPU where it is loaded. */
 void pagedir_destroy(uint32_t *pd) {
     uint32_t *pde;
+    uint32_t cpu_mask;
 
     if (pd == NULL)
         return;
 
     ASSERT(pd != init_page_dir);
+    cpu_mask = loaded_elsewhere(pd);
+    if (cpu_mask != 0)
+        smp_call(cpu_mask, unload_pagedir, NULL);
+    if (active_pd() == pd)
+        load_pagedir(init_page_dir);
     for (pde = pd; pde < pd + pd_no(PHYS_BASE); pde++)
     if (*pde & PTE_P) {
         uint32_t *pt = pde_get_pt(*pde);
@@ -137,7 +176,23 @@ void pagedir_clear_page(uint32_t *pd, void *upage) {
     pte = lookup_page(pd, upage, false);
     if (pte != NULL && (*pte & PTE_P) != 0) {
         *pte &= ~PTE_P;
-        invalidate_pagedir(pd);
+        invalidate_page(pd, upage);
+    }
+}
+
+/*! Sets the writable bit to WRITABLE in the PTE for user virtual page UPAGE
+    in PD, leaving the rest of the entry alone.  Does nothing if PD contains
+    no PTE for UPAGE. */
+void pagedir_set_writable(uint32_t *pd, const void *upage, bool writable) {
+    uint32_t *pte = lookup_page(pd, upage, false);
+    if (pte != NULL) {
+        if (writable) {
+            *pte |= PTE_W;
+        }
+        else {
+            *pte &= ~(uint32_t) PTE_W;
+        }
+        invalidate_page(pd, upage);
     }
 }
 
@@ -158,7 +213,7 @@ void pagedir_set_dirty(uint32_t *pd, const void *vpage, bool dirty) {
         }
         else {
             *pte &= ~(uint32_t) PTE_D;
-            invalidate_pagedir(pd);
+            invalidate_page(pd, vpage);
         }
     }
 }
@@ -181,45 +236,101 @@ void pagedir_set_accessed(uint32_t *pd, const void *vpage, bool accessed) {
         }
         else {
             *pte &= ~(uint32_t) PTE_A; 
-            invalidate_pagedir(pd);
+            invalidate_page(pd, vpage);
         }
     }
 }
 
-/*! Loads page directory PD into the CPU's page directory base register. */
+/*! Makes PD the address space in use, or, if PD is a null pointer, any
+    address space that maps the kernel.  Loads PD into the CPU's page
+    directory base register only if it is not already there, or if its TLB
+    entries there may be out of date. */
 void pagedir_activate(uint32_t *pd) {
-    if (pd == NULL)
-        pd = init_page_dir;
+    int id = cpu_current()->id;
+
+    lazy[id] = pd == NULL;
+    if (pd == NULL || (pd == active_pd() && !stale[id]))
+        cr3_skip_cnt++;
+    else
+        load_pagedir(pd);
+}
+
+/*! Prints page directory statistics. */
+void pagedir_print_stats(void) {
+    printf("Page directories: %lld loads, %lld skipped\n",
+           cr3_load_cnt, cr3_skip_cnt);
+}
+
+/*! Returns the page directory loaded on the current CPU. */
+static uint32_t * active_pd(void) {
+    uint32_t *pd = loaded_pd[cpu_current()->id];
+    return pd != NULL ? pd : init_page_dir;
+}
+
+/*! Loads page directory PD into the current CPU's page directory base
+    register, which also flushes the TLB of all but global entries. */
+static void load_pagedir(uint32_t *pd) {
+    int id = cpu_current()->id;
 
     /* Store the physical address of the page directory into CR3 aka PDBR
        (page directory base register).  This activates our new page tables
        immediately.  See [IA32-v2a] "MOV--Move to/from Control Registers" and
        [IA32-v3a] 3.7.5 "Base Address of the Page Directory". */
     asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
-}
-
-/*! Returns the currently active page directory. */
-static uint32_t * active_pd(void) {
-    /* Copy CR3, the page directory base register (PDBR), into `pd'.
-       See [IA32-v2a] "MOV--Move to/from Control Registers" and
-       [IA32-v3a] 3.7.5 "Base Address of the Page Directory". */
-    uintptr_t pd;
-    asm volatile ("movl %%cr3, %0" : "=r" (pd));
-    return ptov(pd);
+    loaded_pd[id] = pd;
+    stale[id] = false;
+    cr3_load_cnt++;
 }
 
 /*! Some page table changes can cause the CPU's translation lookaside buffer
     (TLB) to become out-of-sync with the page table.  When this happens, we
-    have to "invalidate" the TLB by re-activating it.
-
-    This function invalidates the TLB if PD is the active page directory.
-    (If PD is not active then its entries are not in the TLB, so there is no
-    need to invalidate anything.) */
-static void invalidate_pagedir(uint32_t *pd) {
-    if (active_pd() == pd) {
-        /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-           "Translation Lookaside Buffers (TLBs)". */
-        pagedir_activate(pd);
-    }
+    have to "invalidate" the stale TLB entry.
+
+    This function invalidates the TLB entry for VADDR on each CPU where PD is
+    the active page directory.  (If PD is not active then its entries are not
+    in the TLB, so there is no need to invalidate anything.)  CPUs that are
+    only borrowing PD are left to reload it later instead. */
+static void invalidate_page(uint32_t *pd, const void *vaddr) {
+    uint32_t cpu_mask = loaded_elsewhere(pd);
+    int i;
+
+    for (i = 0; i < cpu_cnt; i++)
+        if ((cpu_mask & (1u << i)) && lazy[i]) {
+            stale[i] = true;
+            cpu_mask &= ~(1u << i);
+        }
+    if (cpu_mask != 0)
+        smp_call(cpu_mask, flush_page, (void *) vaddr);
+
+    if (active_pd() == pd)
+        flush_page((void *) vaddr);
+}
+
+/*! Returns a bitmap of the CPUs other than the current one on which PD is
+    loaded. */
+static uint32_t loaded_elsewhere(uint32_t *pd) {
+    uint32_t cpu_mask = 0;
+    int id = cpu_current()->id;
+    int i;
+
+    for (i = 0; i < cpu_cnt; i++)
+        if (i != id && loaded_pd[i] == pd)
+            cpu_mask |= 1u << i;
+    return cpu_mask;
 }
 
+/*! Switches the current CPU to init_page_dir.  Run by smp_call(), so it
+    leaves the statistics alone. */
+static void unload_pagedir(void *aux UNUSED) {
+    int id = cpu_current()->id;
+
+    asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)) : "memory");
+    loaded_pd[id] = init_page_dir;
+    stale[id] = false;
+}
+
+/*! Invalidates the current CPU's TLB entry for VADDR. */
+static void flush_page(void *vaddr) {
+    /* See [IA32-v2a] "INVLPG--Invalidate TLB Entry". */
+    asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+}
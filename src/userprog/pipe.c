@@ -0,0 +1,321 @@
+/*! \file pipe.c
+ *
+ * Pipes.  A pipe buffers the data written to it in a ring of up to
+ * PIPE_SLOTS pages until it is read.
+ *
+ * Small writes are copied into pages of the pipe's own, which successive
+ * writes fill up before moving on to the next.  With virtual memory, a
+ * write of a whole, page-aligned page of an anonymous user page moves no
+ * data at all: the writer lends its frame to the pipe (see frame_lend()),
+ * which keeps it until the reader has copied it out.  The writer's page is
+ * write-protected meanwhile, so the writer may reuse its buffer at once; if
+ * it does write to it, it gets a fresh copy of the page, at no more cost
+ * than copying into the pipe would have been.
+ *
+ * A read blocks until there is something to read and then takes whatever
+ * is buffered, up to the size asked for.  A write blocks until all of it
+ * has been buffered.  Once the last writer has closed its end, a read of an
+ * empty pipe returns 0; once the last reader has, writes fail.
+ */
+
+#include "userprog/pipe.h"
+#include <debug.h>
+#include <stdint.h>
+#include <uio.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/usercopy.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#endif
+
+/*! Maximum number of pages buffered in a pipe. */
+#define PIPE_SLOTS 16
+
+/*! A page of data in a pipe. */
+struct pipe_buf {
+    uint8_t *data;              /*!< Kernel address of the page. */
+    struct frame *frame;        /*!< Lent frame, or NULL if DATA is ours. */
+    size_t ofs;                 /*!< Offset of the first unread byte. */
+    size_t len;                 /*!< Number of unread bytes. */
+};
+
+/*! A pipe. */
+struct pipe {
+    struct lock lock;           /*!< Protects all the members below. */
+    struct condition not_empty; /*!< Signaled when data is written. */
+    struct condition not_full;  /*!< Signaled when data is read. */
+    struct pipe_buf bufs[PIPE_SLOTS]; /*!< Ring of buffered pages. */
+    size_t head;                /*!< Index in BUFS of the oldest page. */
+    size_t cnt;                 /*!< Number of pages in BUFS. */
+    int readers;                /*!< Open read ends. */
+    int writers;                /*!< Open write ends. */
+};
+
+static bool buffer_page(struct pipe *, const uint8_t *ubuf, size_t size,
+                        size_t *n);
+static bool buffer_copy(struct pipe *, const uint8_t *ubuf, size_t size,
+                        size_t *n);
+static struct frame *lend_page(const void *upage, void **kpage);
+static void release_buf(struct pipe_buf *);
+
+/*! Returns a new, empty pipe with one read end and one write end open, or a
+    null pointer if memory allocation fails. */
+struct pipe * pipe_create(void) {
+    struct pipe *p = malloc(sizeof *p);
+
+    if (p != NULL) {
+        lock_init(&p->lock);
+        cond_init(&p->not_empty);
+        cond_init(&p->not_full);
+        p->head = 0;
+        p->cnt = 0;
+        p->readers = 1;
+        p->writers = 1;
+    }
+    return p;
+}
+
+/*! Opens another handle on the write end of P if WRITE_END is true,
+    otherwise on its read end. */
+void pipe_dup(struct pipe *p, bool write_end) {
+    lock_acquire(&p->lock);
+    if (write_end)
+        p->writers++;
+    else
+        p->readers++;
+    lock_release(&p->lock);
+}
+
+/*! Closes a handle on the write end of P if WRITE_END is true, otherwise on
+    its read end, and frees P once both ends are fully closed. */
+void pipe_close(struct pipe *p, bool write_end) {
+    bool dead;
+
+    lock_acquire(&p->lock);
+    if (write_end)
+        p->writers--;
+    else
+        p->readers--;
+    ASSERT(p->readers >= 0 && p->writers >= 0);
+    dead = p->readers == 0 && p->writers == 0;
+
+    /* Let blocked readers see end of file and blocked writers fail. */
+    cond_broadcast(&p->not_empty, &p->lock);
+    cond_broadcast(&p->not_full, &p->lock);
+    lock_release(&p->lock);
+
+    if (dead) {
+        for (; p->cnt > 0; p->cnt--) {
+            release_buf(&p->bufs[p->head]);
+            p->head = (p->head + 1) % PIPE_SLOTS;
+        }
+        free(p);
+    }
+}
+
+/*! Reads from P into the IOVCNT user buffers in IOV, filling each before
+    moving on to the next.  Waits until P holds some data or has no writers
+    left, then reads as much as is there and fits.  Returns the number of
+    bytes read, which is 0 at end of file, or -1 if a buffer is not valid
+    user memory. */
+int pipe_read(struct pipe *p, const struct iovec *iov, int iovcnt) {
+    size_t total = 0;
+    int i;
+
+    lock_acquire(&p->lock);
+    while (p->cnt == 0 && p->writers > 0)
+        cond_wait(&p->not_empty, &p->lock);
+
+    for (i = 0; i < iovcnt && p->cnt > 0; i++) {
+        uint8_t *ubuf = iov[i].iov_base;
+        size_t done = 0;
+
+        while (done < iov[i].iov_len && p->cnt > 0) {
+            struct pipe_buf *b = &p->bufs[p->head];
+            size_t n = iov[i].iov_len - done;
+
+            if (n > b->len)
+                n = b->len;
+            if (!copy_to_user(ubuf + done, b->data + b->ofs, n)) {
+                lock_release(&p->lock);
+                return -1;
+            }
+            b->ofs += n;
+            b->len -= n;
+            done += n;
+
+            if (b->len == 0) {
+                release_buf(b);
+                p->head = (p->head + 1) % PIPE_SLOTS;
+                p->cnt--;
+            }
+        }
+        total += done;
+    }
+    cond_broadcast(&p->not_full, &p->lock);
+    lock_release(&p->lock);
+
+    return total;
+}
+
+/*! Writes the IOVCNT user buffers in IOV to P, in order, waiting for
+    readers to make room as necessary.  Returns the number of bytes written,
+    or -1 if a buffer is not valid user memory or P has no readers left, in
+    which case some of the data may have been written. */
+int pipe_write(struct pipe *p, const struct iovec *iov, int iovcnt) {
+    size_t total = 0;
+    int i;
+
+    lock_acquire(&p->lock);
+    for (i = 0; i < iovcnt; i++) {
+        const uint8_t *ubuf = iov[i].iov_base;
+        size_t done = 0;
+
+        while (done < iov[i].iov_len) {
+            size_t n;
+            bool ok;
+
+            if (p->readers == 0) {
+                lock_release(&p->lock);
+                return -1;
+            }
+
+            if (!buffer_page(p, ubuf + done, iov[i].iov_len - done, &n))
+                ok = buffer_copy(p, ubuf + done, iov[i].iov_len - done, &n);
+            else
+                ok = true;
+            if (!ok) {
+                lock_release(&p->lock);
+                return -1;
+            }
+
+            if (n > 0) {
+                done += n;
+                cond_broadcast(&p->not_empty, &p->lock);
+            }
+            else {
+                cond_wait(&p->not_full, &p->lock);
+            }
+        }
+        total += done;
+    }
+    lock_release(&p->lock);
+
+    return total;
+}
+
+/*! Tries to buffer the first page of the SIZE bytes at UBUF in P by
+    borrowing the frame that holds it.  On success, sets *N to the number
+    of bytes buffered, PGSIZE, and returns true.  Returns false if SIZE is
+    less than a page, if P has no free slot, or if UBUF is not the start of
+    a page that can be lent, leaving the caller to copy instead.  P's lock
+    must be held. */
+static bool buffer_page(struct pipe *p, const uint8_t *ubuf, size_t size,
+                        size_t *n) {
+    struct pipe_buf *b;
+    struct frame *f;
+    void *kpage;
+
+    if (pg_ofs(ubuf) != 0 || size < PGSIZE || p->cnt == PIPE_SLOTS)
+        return false;
+    f = lend_page(ubuf, &kpage);
+    if (f == NULL)
+        return false;
+
+    b = &p->bufs[(p->head + p->cnt++) % PIPE_SLOTS];
+    b->data = kpage;
+    b->frame = f;
+    b->ofs = 0;
+    b->len = PGSIZE;
+    *n = PGSIZE;
+    return true;
+}
+
+/*! Copies as much of the SIZE bytes at UBUF into P as there is room for,
+    appending to the last page if it is one of P's own, and sets *N to the
+    number of bytes copied, which is 0 if P is full.  Returns false if
+    UBUF is not valid user memory.  P's lock must be held. */
+static bool buffer_copy(struct pipe *p, const uint8_t *ubuf, size_t size,
+                        size_t *n) {
+    struct pipe_buf *b = NULL;
+    size_t end;
+
+    if (p->cnt > 0) {
+        b = &p->bufs[(p->head + p->cnt - 1) % PIPE_SLOTS];
+        if (b->frame != NULL || b->ofs + b->len == PGSIZE)
+            b = NULL;
+    }
+    if (b == NULL && p->cnt < PIPE_SLOTS) {
+        uint8_t *data = palloc_get_page(0);
+
+        /* Out of memory: wait for the reader to free some, if it can. */
+        if (data == NULL) {
+            *n = 0;
+            return p->cnt > 0;
+        }
+        b = &p->bufs[(p->head + p->cnt++) % PIPE_SLOTS];
+        b->data = data;
+        b->frame = NULL;
+        b->ofs = 0;
+        b->len = 0;
+    }
+    if (b == NULL) {
+        *n = 0;
+        return true;
+    }
+
+    end = b->ofs + b->len;
+    *n = size < PGSIZE - end ? size : PGSIZE - end;
+    if (!copy_from_user(b->data + end, ubuf, *n)) {
+        /* Don't leave an empty page behind for a reader to mistake for
+           end of file. */
+        if (b->len == 0) {
+            release_buf(b);
+            p->cnt--;
+        }
+        return false;
+    }
+    b->len += *n;
+    return true;
+}
+
+/*! Lends the frame holding the anonymous user page at UPAGE to a pipe, as
+    frame_lend() does, bringing the page in first if need be, and sets
+    *KPAGE to the frame's kernel address.  Returns the frame, or a null
+    pointer if the page cannot be lent, which is always the case without
+    virtual memory. */
+static struct frame * lend_page(const void *upage UNUSED,
+                                void **kpage UNUSED) {
+#ifdef VM
+    struct page *page;
+    struct frame *f = NULL;
+
+    page_table_lock();
+    page = page_lookup(upage);
+    if (page != NULL && page->type == PAGE_ANON &&
+        (page->frame != NULL || page_in(page, false))) {
+        f = frame_lend(page);
+        if (f != NULL)
+            *kpage = f->kpage;
+    }
+    page_table_unlock();
+    return f;
+#else
+    return NULL;
+#endif
+}
+
+/*! Gives up the page held by B. */
+static void release_buf(struct pipe_buf *b) {
+#ifdef VM
+    if (b->frame != NULL) {
+        frame_return(b->frame);
+        return;
+    }
+#endif
+    palloc_free_page(b->data);
+}
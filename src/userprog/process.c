@@ -5,8 +5,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <syscall-batch.h>
+#include "userprog/elfcache.h"
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/pipe.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -14,80 +19,336 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/smp.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#endif
+
+/*! An open file or pipe end in a process's file descriptor table. */
+struct fd_entry {
+    int fd;                     /*!< File descriptor. */
+    struct file *file;          /*!< Open file, or NULL for a pipe. */
+    struct pipe *pipe;          /*!< Pipe, if FILE is null. */
+    bool write_end;             /*!< Pipe's write end (true) or read end. */
+    struct list_elem elem;      /*!< Element in the thread's file list. */
+};
+
+/*! A process's exit status, shared by the process and its parent.  The
+    extra threads of a process have one each too, shared with whichever
+    thread joins them.
+
+    The record outlives whichever of the two exits first: each holds a
+    reference, and the last to drop it frees the record. */
+struct child {
+    tid_t tid;                  /*!< Child's thread id. */
+    int exit_status;            /*!< Status passed to exit(), or -1. */
+    struct semaphore dead;      /*!< Upped when the child exits. */
+    int ref_cnt;                /*!< Number of references, up to 2. */
+    struct list_elem elem;      /*!< Element in the parent's children list. */
+};
+
+/*! Handed by process_execute() to the child it creates. */
+struct exec_info {
+    char *cmd_line;             /*!< Command line, in a page of the parent. */
+    struct child *child;        /*!< Child's exit status record. */
+    struct semaphore loaded;    /*!< Upped once the load has finished. */
+    bool success;               /*!< Whether the load succeeded. */
+};
+
+#ifdef VM
+/*! User stacks of the extra threads of a process.  The stack in slot I
+    is the THREAD_STACK_PAGES pages below PHYS_BASE - (I + 1) *
+    THREAD_STACK_SPACING; the unmapped pages under each catch overflows.
+    @{ */
+#define THREAD_MAX 32           /*!< Number of slots; bits in a uint32_t. */
+#define THREAD_STACK_PAGES 16   /*!< Pages in a stack. */
+#define THREAD_STACK_SPACING (32 * PGSIZE)
+/*! @} */
+
+/*! Handed by process_thread_create() to the thread it creates. */
+struct thread_info {
+    struct thread *process;     /*!< Main thread of the creating process. */
+    void (*entry)(void);        /*!< User function to start at. */
+    void *args[2];              /*!< Its arguments. */
+    struct child *child;        /*!< Thread's exit status record. */
+    struct semaphore started;   /*!< Upped once the thread is set up. */
+    bool success;               /*!< Whether the thread was set up. */
+};
+
+/*! Handed by process_fork() to the child it creates. */
+struct fork_info {
+    struct thread *parent;      /*!< Forking process. */
+    struct intr_frame if_;      /*!< Parent's user context at the syscall. */
+    struct child *child;        /*!< Child's exit status record. */
+    struct semaphore done;      /*!< Upped once the child is set up. */
+    bool success;               /*!< Whether the child was set up. */
+};
+#endif
 
 static thread_func start_process NO_RETURN;
-static bool load(const char *cmdline, void (**eip)(void), void **esp);
-
-/*! Starts a new thread running a user program loaded from FILENAME.  The new
-    thread may be scheduled (and may even exit) before process_execute()
-    returns.  Returns the new process's thread id, or TID_ERROR if the thread
-    cannot be created. */
-tid_t process_execute(const char *file_name) {
-    char *fn_copy;
+static void start_user(struct intr_frame *) NO_RETURN;
+#ifdef VM
+static thread_func fork_process NO_RETURN;
+static thread_func start_thread NO_RETURN;
+static bool dup_files(struct thread *parent);
+static bool thread_stack_create(void **esp, void *args[2]);
+static void thread_stack_destroy(void);
+static void thread_leave(void);
+static void kill_threads(struct thread *process);
+static void wait_threads(void);
+#endif
+static struct child *child_create(void);
+static void child_add(struct child *, tid_t);
+static void child_release(struct child *);
+static struct child *child_remove(struct list *, tid_t);
+static int fd_add(struct file *, struct pipe *, bool write_end);
+static struct fd_entry *fd_lookup(int fd);
+static bool load(char *cmd_line, void (**eip)(void), void **esp);
+static bool map_batch_ring(void);
+
+/*! Starts a new thread running a user program loaded according to
+    CMD_LINE, a program name followed by its arguments, separated by
+    spaces.  Waits for the program to load.  Returns the new process's
+    thread id, or TID_ERROR if the thread cannot be created or the program
+    cannot be loaded. */
+tid_t process_execute(const char *cmd_line) {
+    struct exec_info info;
+    char name[sizeof thread_current()->name];
     tid_t tid;
 
-    /* Make a copy of FILE_NAME.
+    /* Make a copy of CMD_LINE.
        Otherwise there's a race between the caller and load(). */
-    fn_copy = palloc_get_page(0);
-    if (fn_copy == NULL)
+    info.cmd_line = palloc_get_page(0);
+    if (info.cmd_line == NULL)
         return TID_ERROR;
-    strlcpy(fn_copy, file_name, PGSIZE);
+    strlcpy(info.cmd_line, cmd_line, PGSIZE);
+
+    info.child = child_create();
+    if (info.child == NULL) {
+        palloc_free_page(info.cmd_line);
+        return TID_ERROR;
+    }
+    sema_init(&info.loaded, 0);
+    info.success = false;
+
+    /* Create a new thread, named after the program, to execute CMD_LINE. */
+    strlcpy(name, cmd_line, sizeof name);
+    name[strcspn(name, " ")] = '\0';
+    tid = thread_create(name, PRI_DEFAULT, start_process, &info);
+    if (tid != TID_ERROR) {
+        sema_down(&info.loaded);
+        if (!info.success)
+            tid = TID_ERROR;
+    }
+    else {
+        /* No thread ever held the child's reference. */
+        child_release(info.child);
+    }
 
-    /* Create a new thread to execute FILE_NAME. */
-    tid = thread_create(file_name, PRI_DEFAULT, start_process, fn_copy);
-    if (tid == TID_ERROR)
-        palloc_free_page(fn_copy); 
+    if (tid != TID_ERROR)
+        child_add(info.child, tid);
+    else
+        child_release(info.child);
+    palloc_free_page(info.cmd_line);
     return tid;
 }
 
 /*! A thread function that loads a user process and starts it running. */
-static void start_process(void *file_name_) {
-    char *file_name = file_name_;
+static void start_process(void *info_) {
+    struct exec_info *info = info_;
     struct intr_frame if_;
     bool success;
 
+    thread_current()->self = info->child;
+
     /* Initialize interrupt frame and load executable. */
     memset(&if_, 0, sizeof(if_));
     if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
     if_.cs = SEL_UCSEG;
     if_.eflags = FLAG_IF | FLAG_MBS;
-    success = load(file_name, &if_.eip, &if_.esp);
+    success = load(info->cmd_line, &if_.eip, &if_.esp);
 
-    /* If load failed, quit. */
-    palloc_free_page(file_name);
+    /* INFO belongs to the parent, which may return as soon as we let it.
+       If load failed, quit. */
+    info->success = success;
+    sema_up(&info->loaded);
     if (!success) 
         thread_exit();
 
+    start_user(&if_);
+}
+
+/*! Starts running the current thread in user mode, with the registers in
+    IF_, which must be on the current thread's stack. */
+static void start_user(struct intr_frame *if_) {
+    /* Leave the kernel proper (see threads/smp.c). */
+    intr_disable();
+    kernel_lock_release();
+
     /* Start the user process by simulating a return from an
        interrupt, implemented by intr_exit (in
        threads/intr-stubs.S).  Because intr_exit takes all of its
        arguments on the stack in the form of a `struct intr_frame',
        we just point the stack pointer (%esp) to our stack frame
        and jump to it. */
-    asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+    asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (if_) : "memory");
     NOT_REACHED();
 }
 
+#ifdef VM
+/*! Creates a child of the current process that is a copy of it, resuming
+    in user mode from the user context in PARENT_IF with a return value of
+    0.  The child shares the parent's memory copy-on-write, its memory
+    mappings, and its open files, though each open file gets its own file
+    position.  Returns the child's thread id, or TID_ERROR if it could not
+    be created.  Only the calling thread is copied into the child. */
+tid_t process_fork(const struct intr_frame *parent_if) {
+    struct thread *cur = process_current();
+    struct fork_info info;
+    tid_t tid;
+
+    info.parent = cur;
+    info.if_ = *parent_if;
+    info.child = child_create();
+    if (info.child == NULL)
+        return TID_ERROR;
+    sema_init(&info.done, 0);
+    info.success = false;
+
+    /* We stay blocked until the child has copied what it needs, so none of
+       our state can change under it. */
+    tid = thread_create(cur->name, PRI_DEFAULT, fork_process, &info);
+    if (tid != TID_ERROR) {
+        sema_down(&info.done);
+        if (!info.success)
+            tid = TID_ERROR;
+    }
+    else {
+        child_release(info.child);
+    }
+
+    if (tid != TID_ERROR)
+        child_add(info.child, tid);
+    else
+        child_release(info.child);
+    return tid;
+}
+
+/*! A thread function that copies the address space and open files of a
+    forking process and starts the copy running. */
+static void fork_process(void *info_) {
+    struct fork_info *info = info_;
+    struct thread *parent = info->parent;
+    struct thread *t = thread_current();
+    struct intr_frame if_ = info->if_;
+    bool success = false;
+
+    t->self = info->child;
+    t->pagedir = pagedir_create();
+    if (t->pagedir != NULL) {
+        if (page_table_init(&t->pages)) {
+            process_activate();
+            t->exec_file = file_reopen(parent->exec_file);
+            if (t->exec_file != NULL) {
+                file_deny_write(t->exec_file);
+                lock_acquire(&parent->pages_lock);
+                success = page_table_dup(parent) && mmap_dup(parent);
+                lock_release(&parent->pages_lock);
+                success = (success && shm_dup(parent) && dup_files(parent) &&
+                           map_batch_ring());
+                if (success)
+                    memcpy(t->batch_ring, parent->batch_ring, PGSIZE);
+            }
+        }
+        else {
+            pagedir_destroy(t->pagedir);
+            t->pagedir = NULL;
+        }
+    }
+
+    /* INFO belongs to the parent, which may return as soon as we let it. */
+    info->success = success;
+    sema_up(&info->done);
+    if (!success)
+        thread_exit();
+
+    if_.eax = 0;
+    start_user(&if_);
+}
+#endif
+
 /*! Waits for thread TID to die and returns its exit status.  If it was
     terminated by the kernel (i.e. killed due to an exception), returns -1.
     If TID is invalid or if it was not a child of the calling process, or if
     process_wait() has already been successfully called for the given TID,
-    returns -1 immediately, without waiting.
+    returns -1 immediately, without waiting. */
+int process_wait(tid_t child_tid) {
+    struct thread *cur = process_current();
+    struct child *c = child_remove(&cur->children, child_tid);
+    int status;
 
-    This function will be implemented in problem 2-2.  For now, it does
-    nothing. */
-int process_wait(tid_t child_tid UNUSED) {
-    return -1;
+    if (c == NULL)
+        return -1;
+    sema_down(&c->dead);
+    status = c->exit_status;
+    child_release(c);
+    return status;
 }
 
-/*! Free the current process's resources. */
+/*! Sets the status that the current process reports to its parent when it
+    exits, and marks it as exiting.  The first status set wins. */
+void process_set_exit_status(int status) {
+    struct thread *proc = process_current();
+
+    lock_acquire(&proc->lock);
+    if (proc->self != NULL && !proc->exiting)
+        proc->self->exit_status = status;
+    proc->exiting = true;
+    lock_release(&proc->lock);
+}
+
+/*! Free the current process's resources.  If the current thread is one of
+    the extra threads of a process, free only its own.  */
 void process_exit(void) {
     struct thread *cur = thread_current();
     uint32_t *pd;
 
+#ifdef VM
+    if (cur->process != cur) {
+        thread_leave();
+        return;
+    }
+
+    /* Our other threads go with us, and must be gone before we tear down
+       what they use. */
+    if (cur->self != NULL) {
+        kill_threads(cur);
+        wait_threads();
+    }
+#endif
+
+    if (cur->self != NULL)
+        printf("%s: exit(%d)\n", cur->name, cur->self->exit_status);
+
+    /* Our children no longer have a parent to report to. */
+    while (!list_empty(&cur->children)) {
+        struct list_elem *e = list_pop_front(&cur->children);
+        child_release(list_entry(e, struct child, elem));
+    }
+
+    /* Close the process's open files. */
+    while (!list_empty(&cur->files)) {
+        struct list_elem *e = list_front(&cur->files);
+        process_close_file(list_entry(e, struct fd_entry, elem)->fd);
+    }
+
     /* Destroy the current process's page directory and switch back
        to the kernel-only page directory. */
     pd = cur->pagedir;
@@ -95,28 +356,501 @@ void process_exit(void) {
         /* Correct ordering here is crucial.  We must set
            cur->pagedir to NULL before switching page directories,
            so that a timer interrupt can't switch back to the
-           process page directory.  We must activate the base page
-           directory before destroying the process's page
-           directory, or our active page directory will be one
-           that's been freed (and cleared). */
+           process page directory.  Our page directory stays loaded
+           until pagedir_destroy() switches away from it, so that
+           our active page directory is never one that's been freed
+           (and cleared). */
+#ifdef VM
+        mmap_unmap_all();
+        shm_detach_all();
+        page_table_destroy(&cur->pages);
+#endif
         cur->pagedir = NULL;
+        cur->batch_ring = NULL;
         pagedir_activate(NULL);
         pagedir_destroy(pd);
     }
+
+    /* Let the executable be written again, once no other process is
+       running it.  Its text pages are gone by now. */
+    file_close(cur->exec_file);
+    cur->exec_file = NULL;
+
+    /* Only now that everything is released may our parent go on. */
+    if (cur->self != NULL) {
+        sema_up(&cur->self->dead);
+        child_release(cur->self);
+        cur->self = NULL;
+    }
 }
 
 /*! Sets up the CPU for running user code in the current thread.
     This function is called on every context switch. */
 void process_activate(void) {
-    struct thread *t = thread_current();
+    struct thread *t = process_current();
 
-    /* Activate thread's page tables. */
+    /* Activate the process's page tables. */
     pagedir_activate(t->pagedir);
 
     /* Set thread's kernel stack for use in processing interrupts. */
     tss_update();
 }
 
+/*! Returns the main thread of the running thread's process, which holds the
+    state that all of the process's threads share.  Every thread that is
+    not part of a user process is its own process. */
+struct thread * process_current(void) {
+    return thread_current()->process;
+}
+
+/*! Makes the running thread exit, instead of returning to user mode, if its
+    process is exiting.  Called on the way back to user mode from the
+    kernel. */
+void process_check_exit(void) {
+    if (thread_current()->process->exiting) {
+        intr_enable();
+        thread_exit();
+    }
+}
+
+#ifdef VM
+/*! Starts a new thread in the current process that runs ENTRY in user
+    mode, on a stack of its own, as if called with ARG0 and ARG1 as its
+    arguments.  It must not return.  The new thread shares the process's
+    address space and open files.  Returns the thread's id, or TID_ERROR if
+    it could not be created because the process has as many threads as it
+    can have, is exiting, or runs out of memory. */
+tid_t process_thread_create(void (*entry)(void), void *arg0, void *arg1) {
+    struct thread *proc = process_current();
+    struct thread_info info;
+    tid_t tid;
+
+    info.process = proc;
+    info.entry = entry;
+    info.args[0] = arg0;
+    info.args[1] = arg1;
+    info.child = child_create();
+    if (info.child == NULL)
+        return TID_ERROR;
+    sema_init(&info.started, 0);
+    info.success = false;
+
+    tid = thread_create(proc->name, PRI_DEFAULT, start_thread, &info);
+    if (tid != TID_ERROR) {
+        sema_down(&info.started);
+        if (!info.success)
+            tid = TID_ERROR;
+    }
+    else {
+        /* No thread ever held the record's reference. */
+        child_release(info.child);
+    }
+
+    if (tid != TID_ERROR) {
+        info.child->tid = tid;
+        lock_acquire(&proc->lock);
+        list_push_back(&proc->threads, &info.child->elem);
+        lock_release(&proc->lock);
+    }
+    else {
+        child_release(info.child);
+    }
+    return tid;
+}
+
+/*! Waits for thread TID of the current process to exit.  Returns 0 if it
+    called thread_exit(), or -1 if it was killed, or at once if TID is not
+    an extra thread of the process that has yet to be joined. */
+int process_thread_join(tid_t tid) {
+    struct thread *proc = process_current();
+    struct child *c;
+    int status;
+
+    if (tid == thread_tid())
+        return -1;
+    c = child_remove(&proc->threads, tid);
+    if (c == NULL)
+        return -1;
+    sema_down(&c->dead);
+    status = c->exit_status;
+    child_release(c);
+    return status;
+}
+
+/*! Ends the running thread.  In the main thread of a process, ends the
+    whole process, as exit(0) does. */
+void process_thread_exit(void) {
+    struct thread *cur = thread_current();
+
+    if (cur->process == cur)
+        process_set_exit_status(0);
+    else
+        cur->self->exit_status = 0;
+    thread_exit();
+}
+#endif
+
+/*! Adds FILE to the current process's file descriptor table and returns its
+    new file descriptor, or -1 if memory allocation fails. */
+int process_add_file(struct file *file) {
+    return fd_add(file, NULL, false);
+}
+
+/*! Adds the write end of PIPE to the current process's file descriptor
+    table if WRITE_END is true, otherwise its read end, and returns its new
+    file descriptor, or -1 if memory allocation fails. */
+int process_add_pipe(struct pipe *pipe, bool write_end) {
+    return fd_add(NULL, pipe, write_end);
+}
+
+/*! Returns the current process's open file with descriptor FD, or a null
+    pointer if FD is not an open file. */
+struct file * process_get_file(int fd) {
+    struct thread *proc = process_current();
+    struct fd_entry *e;
+    struct file *file;
+
+    lock_acquire(&proc->lock);
+    e = fd_lookup(fd);
+    file = e != NULL ? e->file : NULL;
+    lock_release(&proc->lock);
+    return file;
+}
+
+/*! Returns the pipe whose write end, if WRITE_END is true, or read end, if
+    not, the current process has open as FD, or a null pointer if FD is no
+    such thing. */
+struct pipe * process_get_pipe(int fd, bool write_end) {
+    struct thread *proc = process_current();
+    struct fd_entry *e;
+    struct pipe *pipe;
+
+    lock_acquire(&proc->lock);
+    e = fd_lookup(fd);
+    pipe = (e != NULL && e->pipe != NULL && e->write_end == write_end
+            ? e->pipe : NULL);
+    lock_release(&proc->lock);
+    return pipe;
+}
+
+/*! Closes file descriptor FD of the current process.  Does nothing if FD is
+    not open.  Another thread of the process must not be using FD. */
+void process_close_file(int fd) {
+    struct thread *proc = process_current();
+    struct fd_entry *e;
+
+    lock_acquire(&proc->lock);
+    e = fd_lookup(fd);
+    if (e != NULL)
+        list_remove(&e->elem);
+    lock_release(&proc->lock);
+
+    if (e != NULL) {
+        if (e->file != NULL)
+            file_close(e->file);
+        else
+            pipe_close(e->pipe, e->write_end);
+        free(e);
+    }
+}
+
+#ifdef VM
+/*! Gives the current process, which has just been forked from PARENT, its
+    own handle on each of PARENT's open files, under the same descriptors
+    and at the same positions, and on each of its pipe ends.  Returns false
+    if memory allocation fails. */
+static bool dup_files(struct thread *parent) {
+    struct thread *t = thread_current();
+    struct list_elem *e;
+    bool success = true;
+
+    lock_acquire(&parent->lock);
+    for (e = list_begin(&parent->files); e != list_end(&parent->files);
+         e = list_next(e)) {
+        struct fd_entry *pentry = list_entry(e, struct fd_entry, elem);
+        struct fd_entry *entry = malloc(sizeof *entry);
+
+        if (entry == NULL) {
+            success = false;
+            break;
+        }
+        if (pentry->file != NULL) {
+            entry->file = file_reopen(pentry->file);
+            if (entry->file == NULL) {
+                free(entry);
+                success = false;
+                break;
+            }
+            file_seek(entry->file, file_tell(pentry->file));
+        }
+        else {
+            entry->file = NULL;
+            pipe_dup(pentry->pipe, pentry->write_end);
+        }
+        entry->pipe = pentry->pipe;
+        entry->write_end = pentry->write_end;
+        entry->fd = pentry->fd;
+        list_push_back(&t->files, &entry->elem);
+    }
+    t->next_fd = parent->next_fd;
+    lock_release(&parent->lock);
+    return success;
+}
+
+/*! A thread function that sets up a new thread in an existing user process
+    and starts it running. */
+static void start_thread(void *info_) {
+    struct thread_info *info = info_;
+    struct thread *t = thread_current();
+    struct intr_frame if_;
+    bool success;
+
+    t->process = info->process;
+    t->self = info->child;
+    process_activate();
+
+    memset(&if_, 0, sizeof(if_));
+    if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+    if_.cs = SEL_UCSEG;
+    if_.eflags = FLAG_IF | FLAG_MBS;
+    if_.eip = info->entry;
+    success = thread_stack_create(&if_.esp, info->args);
+
+    /* INFO belongs to our creator, which may return as soon as we let it.
+       If we failed, we leave quietly: nobody will join us. */
+    info->success = success;
+    sema_up(&info->started);
+    if (!success) {
+        child_release(t->self);
+        t->self = NULL;
+        thread_exit();
+    }
+
+    start_user(&if_);
+}
+
+/*! Returns the top of the user stack in slot SLOT. */
+static uint8_t * stack_top(int slot) {
+    return (uint8_t *) PHYS_BASE - (slot + 1) * THREAD_STACK_SPACING;
+}
+
+/*! Claims a free stack slot in the current process for the running thread,
+    maps a stack there, and pushes ARGS onto it below a null return address,
+    storing the resulting stack pointer into *ESP.  Returns false if the
+    process is exiting or has no free slot, the stack's pages are in use, or
+    memory allocation fails. */
+static bool thread_stack_create(void **esp, void *args[2]) {
+    struct thread *t = thread_current();
+    struct thread *proc = t->process;
+    uint32_t *sp;
+    struct page *p;
+    int slot;
+    int i;
+
+    lock_acquire(&proc->lock);
+    for (slot = 0; slot < THREAD_MAX; slot++)
+        if ((proc->stack_slots & (1u << slot)) == 0)
+            break;
+    if (slot < THREAD_MAX && !proc->exiting)
+        proc->stack_slots |= 1u << slot;
+    else
+        slot = -1;
+    lock_release(&proc->lock);
+    if (slot == -1)
+        return false;
+
+    /* Map the stack, with its top page resident so that we can write the
+       arguments through the kernel's mapping. */
+    page_table_lock();
+    for (i = 1; i <= THREAD_STACK_PAGES; i++) {
+        p = page_create(stack_top(slot) - i * PGSIZE, true);
+        if (p == NULL)
+            break;
+    }
+    if (i <= THREAD_STACK_PAGES ||
+        !page_in(page_lookup(stack_top(slot) - PGSIZE), true)) {
+        while (--i >= 1)
+            page_remove(page_lookup(stack_top(slot) - i * PGSIZE));
+        page_table_unlock();
+
+        lock_acquire(&proc->lock);
+        proc->stack_slots &= ~(1u << slot);
+        lock_release(&proc->lock);
+        return false;
+    }
+    t->stack_slot = slot;
+
+    p = page_lookup(stack_top(slot) - PGSIZE);
+    sp = (uint32_t *) ((uint8_t *) pagedir_get_page(proc->pagedir, p->upage)
+                       + PGSIZE);
+    *--sp = (uint32_t) args[1];
+    *--sp = (uint32_t) args[0];
+    *--sp = 0;
+    pagedir_set_dirty(proc->pagedir, p->upage, true);
+    page_unpin(p);
+    page_table_unlock();
+
+    *esp = stack_top(slot) - 3 * sizeof *sp;
+    return true;
+}
+
+/*! Unmaps the running thread's user stack and frees its slot. */
+static void thread_stack_destroy(void) {
+    struct thread *t = thread_current();
+    struct thread *proc = t->process;
+    int i;
+
+    page_table_lock();
+    for (i = 1; i <= THREAD_STACK_PAGES; i++)
+        page_remove(page_lookup(stack_top(t->stack_slot) - i * PGSIZE));
+    page_table_unlock();
+
+    lock_acquire(&proc->lock);
+    proc->stack_slots &= ~(1u << t->stack_slot);
+    lock_release(&proc->lock);
+    t->stack_slot = -1;
+}
+
+/*! Releases what the running thread, one of the extra threads of its
+    process, holds of its own.  Unless it is leaving through thread_exit(),
+    it takes the rest of the process with it. */
+static void thread_leave(void) {
+    struct thread *cur = thread_current();
+
+    if (cur->stack_slot != -1)
+        thread_stack_destroy();
+
+    if (cur->self != NULL) {
+        if (cur->self->exit_status != 0)
+            kill_threads(cur->process);
+        sema_up(&cur->self->dead);
+        child_release(cur->self);
+        cur->self = NULL;
+    }
+}
+
+/*! Marks the process whose main thread is PROCESS as exiting, so that its
+    threads exit the next time they would return to user mode, and wakes
+    those sleeping on futexes so that they get there.  A thread blocked
+    anywhere else, such as reading an empty pipe, exits once it
+    returns. */
+static void kill_threads(struct thread *process) {
+    lock_acquire(&process->lock);
+    process->exiting = true;
+    lock_release(&process->lock);
+    futex_cancel(process);
+}
+
+/*! Waits until every extra thread of the current process, which must be
+    its main thread, has exited. */
+static void wait_threads(void) {
+    struct thread *cur = thread_current();
+
+    lock_acquire(&cur->lock);
+    while (!list_empty(&cur->threads)) {
+        struct list_elem *e = list_pop_front(&cur->threads);
+        struct child *c = list_entry(e, struct child, elem);
+
+        lock_release(&cur->lock);
+        sema_down(&c->dead);
+        child_release(c);
+        lock_acquire(&cur->lock);
+    }
+    lock_release(&cur->lock);
+}
+#endif
+
+/*! Returns a new exit status record for a child about to be created, with
+    references for both parent and child, or a null pointer if memory
+    allocation fails. */
+static struct child * child_create(void) {
+    struct child *c = malloc(sizeof *c);
+
+    if (c != NULL) {
+        c->tid = TID_ERROR;
+        c->exit_status = -1;
+        sema_init(&c->dead, 0);
+        c->ref_cnt = 2;
+    }
+    return c;
+}
+
+/*! Adds C, the record of the current process's new child TID, to its list
+    of children. */
+static void child_add(struct child *c, tid_t tid) {
+    struct thread *proc = process_current();
+
+    c->tid = tid;
+    lock_acquire(&proc->lock);
+    list_push_back(&proc->children, &c->elem);
+    lock_release(&proc->lock);
+}
+
+/*! Drops a reference to C, freeing it if it was the last. */
+static void child_release(struct child *c) {
+    enum intr_level old_level = intr_disable();
+    bool dead = --c->ref_cnt == 0;
+    intr_set_level(old_level);
+
+    if (dead)
+        free(c);
+}
+
+/*! Removes the record of TID from LIST, a list of children or of threads
+    of the current process, and returns it, or a null pointer if there is
+    none. */
+static struct child * child_remove(struct list *list, tid_t tid) {
+    struct thread *proc = process_current();
+    struct child *found = NULL;
+    struct list_elem *e;
+
+    lock_acquire(&proc->lock);
+    for (e = list_begin(list); e != list_end(list); e = list_next(e)) {
+        struct child *c = list_entry(e, struct child, elem);
+        if (c->tid == tid) {
+            list_remove(&c->elem);
+            found = c;
+            break;
+        }
+    }
+    lock_release(&proc->lock);
+    return found;
+}
+
+/*! Adds FILE, or if it is null the given end of PIPE, to the current
+    process's file descriptor table under a new descriptor and returns it,
+    or -1 if memory allocation fails. */
+static int fd_add(struct file *file, struct pipe *pipe, bool write_end) {
+    struct thread *t = process_current();
+    struct fd_entry *e = malloc(sizeof *e);
+
+    if (e == NULL)
+        return -1;
+    e->file = file;
+    e->pipe = pipe;
+    e->write_end = write_end;
+    lock_acquire(&t->lock);
+    e->fd = t->next_fd++;
+    list_push_back(&t->files, &e->elem);
+    lock_release(&t->lock);
+    return e->fd;
+}
+
+/*! Returns the current process's file descriptor table entry for FD, or a
+    null pointer if FD is not open.  The process's lock must be held. */
+static struct fd_entry * fd_lookup(int fd) {
+    struct thread *t = process_current();
+    struct list_elem *e;
+
+    for (e = list_begin(&t->files); e != list_end(&t->files);
+         e = list_next(e)) {
+        struct fd_entry *entry = list_entry(e, struct fd_entry, elem);
+        if (entry->fd == fd)
+            return entry;
+    }
+    return NULL;
+}
+
 /*! We load ELF binaries.  The following definitions are taken
     from the ELF specification, [ELF1], more-or-less verbatim.  */
 
@@ -181,57 +915,167 @@ struct Elf32_Phdr {
 #define PF_R 4          /*!< Readable. */
 /*! @} */
 
-static bool setup_stack(void **esp);
+static bool setup_stack(void **esp, const char *file_name, char **save_ptr);
+static bool push_args(void **esp, const char *file_name, char **save_ptr);
+static struct elf_image *read_image(struct file *, const char *file_name);
 static bool validate_segment(const struct Elf32_Phdr *, struct file *);
-static bool load_segment(struct file *file, off_t ofs, uint8_t *upage,
-                         uint32_t read_bytes, uint32_t zero_bytes,
-                         bool writable);
-
-/*! Loads an ELF executable from FILE_NAME into the current thread.  Stores the
-    executable's entry point into *EIP and its initial stack pointer into *ESP.
-    Returns true if successful, false otherwise. */
-bool load(const char *file_name, void (**eip) (void), void **esp) {
+static bool load_segment(struct file *, const struct elf_segment *);
+static bool read_page(struct file *, off_t ofs, void *kpage,
+                      size_t read_bytes, void **copy);
+
+/*! Loads the ELF executable named by the first word of CMD_LINE into the
+    current thread, with the words of CMD_LINE as its arguments.  CMD_LINE
+    is modified.  Stores the executable's entry point into *EIP and its
+    initial stack pointer into *ESP.  Returns true if successful, false
+    otherwise. */
+bool load(char *cmd_line, void (**eip) (void), void **esp) {
     struct thread *t = thread_current();
-    struct Elf32_Ehdr ehdr;
+    struct elf_image *img = NULL;
     struct file *file = NULL;
-    off_t file_ofs;
+    const char *file_name;
+    char *save_ptr;
+    bool cached = true;
     bool success = false;
-    int i;
+    size_t i;
+
+    file_name = strtok_r(cmd_line, " ", &save_ptr);
+    if (file_name == NULL)
+        return false;
+    lock_acquire(&fs_lock);
 
     /* Allocate and activate page directory. */
     t->pagedir = pagedir_create();
     if (t->pagedir == NULL) 
         goto done;
+#ifdef VM
+    if (!page_table_init(&t->pages)) {
+        pagedir_destroy(t->pagedir);
+        t->pagedir = NULL;
+        goto done;
+    }
+#endif
     process_activate();
 
-    /* Open executable file. */
+    /* Open executable file.  It stays open, and unwritable, until the
+       process exits: the text pages are read from it on demand. */
     file = filesys_open(file_name);
     if (file == NULL) {
         printf("load: %s: open failed\n", file_name);
         goto done; 
     }
+    file_deny_write(file);
+    t->exec_file = file;
+
+    /* Read the executable's headers, unless an earlier load of the same
+       executable already did. */
+    img = elf_cache_lookup(file_get_inode(file));
+    if (img == NULL) {
+        cached = false;
+        img = read_image(file, file_name);
+        if (img == NULL)
+            goto done;
+    }
+
+    /* Load the segments. */
+    for (i = 0; i < img->seg_cnt; i++)
+        if (!load_segment(file, &img->segs[i]))
+            goto done;
+
+    /* Set up stack. */
+    if (!setup_stack(esp, file_name, &save_ptr))
+        goto done;
+
+    /* Map the batch ring. */
+    if (!map_batch_ring())
+        goto done;
+
+    /* Start address. */
+    *eip = (void (*)(void)) img->entry;
+
+    success = true;
+
+done:
+    /* We arrive here whether the load is successful or not.  The
+       executable is closed by process_exit(). */
+    if (img != NULL && !cached) {
+        if (success)
+            elf_cache_insert(img, file_get_inode(file));
+        else
+            elf_image_destroy(img);
+    }
+    lock_release(&fs_lock);
+    return success;
+}
+
+/* load() helpers. */
+
+/*! Maps a zeroed page at BATCH_RING in the current process to serve as its
+    batch ring.  The page lies outside the supplemental page table, so it is
+    never evicted and the kernel can always reach it through its own
+    mapping; pagedir_destroy() frees it.  Returns false if memory
+    allocation fails or something else is already there. */
+static bool map_batch_ring(void) {
+    struct thread *t = thread_current();
+    uint8_t *kpage;
+
+#ifdef VM
+    if (page_lookup(BATCH_RING) != NULL)
+        return false;
+#endif
+    if (pagedir_get_page(t->pagedir, BATCH_RING) != NULL)
+        return false;
+
+    kpage = palloc_get_page(PAL_USER | PAL_ZERO);
+    if (kpage == NULL)
+        return false;
+    if (!pagedir_set_page(t->pagedir, BATCH_RING, kpage, true)) {
+        palloc_free_page(kpage);
+        return false;
+    }
+    t->batch_ring = (struct batch_ring *) kpage;
+    return true;
+}
+
+#ifndef VM
+static bool install_page(void *upage, void *kpage, bool writable);
+#endif
+
+/*! Reads and validates the ELF header and program headers of FILE, the
+    executable named FILE_NAME, and returns an image of it, ready to make
+    copies of the pages it loads into private memory.  Returns a null
+    pointer if FILE is not a valid executable or memory allocation
+    fails. */
+static struct elf_image * read_image(struct file *file,
+                                     const char *file_name) {
+    struct Elf32_Ehdr ehdr;
+    struct elf_image *img;
+    off_t file_ofs;
+    int i;
 
     /* Read and verify executable header. */
-    if (file_read(file, &ehdr, sizeof ehdr) != sizeof ehdr ||
+    if (file_read_at(file, &ehdr, sizeof ehdr, 0) != sizeof ehdr ||
         memcmp(ehdr.e_ident, "\177ELF\1\1\1", 7) || ehdr.e_type != 2 ||
         ehdr.e_machine != 3 || ehdr.e_version != 1 ||
         ehdr.e_phentsize != sizeof(struct Elf32_Phdr) || ehdr.e_phnum > 1024) {
         printf("load: %s: error loading executable\n", file_name);
-        goto done; 
+        return NULL;
     }
 
+    img = elf_image_create(ehdr.e_phnum);
+    if (img == NULL)
+        return NULL;
+    img->entry = ehdr.e_entry;
+
     /* Read program headers. */
     file_ofs = ehdr.e_phoff;
     for (i = 0; i < ehdr.e_phnum; i++) {
         struct Elf32_Phdr phdr;
+        struct elf_segment *seg;
 
         if (file_ofs < 0 || file_ofs > file_length(file))
-            goto done;
-        file_seek(file, file_ofs);
-
-        if (file_read(file, &phdr, sizeof phdr) != sizeof phdr)
-            goto done;
-
+            goto fail;
+        if (file_read_at(file, &phdr, sizeof phdr, file_ofs) != sizeof phdr)
+            goto fail;
         file_ofs += sizeof phdr;
 
         switch (phdr.p_type) {
@@ -246,57 +1090,48 @@ bool load(const char *file_name, void (**eip) (void), void **esp) {
         case PT_DYNAMIC:
         case PT_INTERP:
         case PT_SHLIB:
-            goto done;
+            goto fail;
 
         case PT_LOAD:
-            if (validate_segment(&phdr, file)) {
-                bool writable = (phdr.p_flags & PF_W) != 0;
-                uint32_t file_page = phdr.p_offset & ~PGMASK;
-                uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
-                uint32_t page_offset = phdr.p_vaddr & PGMASK;
-                uint32_t read_bytes, zero_bytes;
-                if (phdr.p_filesz > 0) {
-                    /* Normal segment.
-                       Read initial part from disk and zero the rest. */
-                    read_bytes = page_offset + phdr.p_filesz;
-                    zero_bytes = (ROUND_UP(page_offset + phdr.p_memsz, PGSIZE) -
-                                 read_bytes);
-                }
-                else {
-                    /* Entirely zero.
-                       Don't read anything from disk. */
-                    read_bytes = 0;
-                    zero_bytes = ROUND_UP(page_offset + phdr.p_memsz, PGSIZE);
-                }
-                if (!load_segment(file, file_page, (void *) mem_page,
-                                  read_bytes, zero_bytes, writable))
-                    goto done;
+            if (!validate_segment(&phdr, file))
+                goto fail;
+
+            seg = &img->segs[img->seg_cnt++];
+            seg->ofs = phdr.p_offset & ~PGMASK;
+            seg->upage = (uint8_t *) (phdr.p_vaddr & ~PGMASK);
+            seg->writable = (phdr.p_flags & PF_W) != 0;
+            if (phdr.p_filesz > 0) {
+                /* Normal segment.
+                   Read initial part from disk and zero the rest. */
+                seg->read_bytes = (phdr.p_vaddr & PGMASK) + phdr.p_filesz;
+                seg->zero_bytes = (ROUND_UP((phdr.p_vaddr & PGMASK) +
+                                            phdr.p_memsz, PGSIZE)
+                                   - seg->read_bytes);
             }
             else {
-                goto done;
+                /* Entirely zero.
+                   Don't read anything from disk. */
+                seg->read_bytes = 0;
+                seg->zero_bytes = ROUND_UP((phdr.p_vaddr & PGMASK) +
+                                           phdr.p_memsz, PGSIZE);
             }
+
+#ifdef VM
+            /* Read-only pages come from the page cache. */
+            if (seg->writable)
+                elf_image_keep_copies(img, seg);
+#else
+            elf_image_keep_copies(img, seg);
+#endif
             break;
         }
     }
+    return img;
 
-    /* Set up stack. */
-    if (!setup_stack(esp))
-        goto done;
-
-    /* Start address. */
-    *eip = (void (*)(void)) ehdr.e_entry;
-
-    success = true;
-
-done:
-    /* We arrive here whether the load is successful or not. */
-    file_close(file);
-    return success;
+fail:
+    elf_image_destroy(img);
+    return NULL;
 }
-
-/* load() helpers. */
-
-static bool install_page(void *upage, void *kpage, bool writable);
 
 /*! Checks whether PHDR describes a valid, loadable segment in
     FILE and returns true if so, false otherwise. */
@@ -340,41 +1175,78 @@ static bool validate_segment(const struct Elf32_Phdr *phdr, struct file *file) {
     return true;
 }
 
-/*! Loads a segment starting at offset OFS in FILE at address UPAGE.  In total,
-    READ_BYTES + ZERO_BYTES bytes of virtual memory are initialized, as follows:
+/*! Loads segment SEG of FILE.  In total, READ_BYTES + ZERO_BYTES bytes of
+    virtual memory are initialized at SEG->UPAGE, as follows:
 
         - READ_BYTES bytes at UPAGE must be read from FILE
-          starting at offset OFS.
+          starting at offset SEG->OFS, or from the copies SEG keeps.
 
         - ZERO_BYTES bytes at UPAGE + READ_BYTES must be zeroed.
 
     The pages initialized by this function must be writable by the user process
-    if WRITABLE is true, read-only otherwise.
+    if SEG->WRITABLE is true, read-only otherwise.
 
     Return true if successful, false if a memory allocation error or disk read
     error occurs. */
-static bool load_segment(struct file *file, off_t ofs, uint8_t *upage,
-                         uint32_t read_bytes, uint32_t zero_bytes,
-                         bool writable) {
+static bool load_segment(struct file *file, const struct elf_segment *seg) {
+    uint32_t read_bytes = seg->read_bytes;
+    uint32_t zero_bytes = seg->zero_bytes;
+    uint8_t *upage = seg->upage;
+    off_t ofs = seg->ofs;
+    bool writable = seg->writable;
+    size_t page_idx = 0;
+
     ASSERT((read_bytes + zero_bytes) % PGSIZE == 0);
     ASSERT(pg_ofs(upage) == 0);
     ASSERT(ofs % PGSIZE == 0);
 
-    file_seek(file, ofs);
+#ifdef VM
+    struct thread *t = thread_current();
+#endif
     while (read_bytes > 0 || zero_bytes > 0) {
         /* Calculate how to fill this page.
            We will read PAGE_READ_BYTES bytes from FILE
            and zero the final PAGE_ZERO_BYTES bytes. */
         size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
         size_t page_zero_bytes = PGSIZE - page_read_bytes;
+        void **copy = (seg->copies != NULL && page_read_bytes > 0
+                       ? &seg->copies[page_idx] : NULL);
+
+#ifdef VM
+        if (!writable) {
+            /* Read-only pages are read in on demand through the page
+               cache, so every process running this executable shares one
+               copy of its text. */
+            if (page_create_file(upage, false, file, ofs,
+                                 page_read_bytes) == NULL)
+                return false;
+        }
+        else {
+            /* Give the page a frame, kept pinned while we fill it in. */
+            struct page *p = page_create(upage, writable);
+            if (p == NULL || !page_in(p, true))
+                return false;
+            uint8_t *kpage = pagedir_get_page(t->pagedir, upage);
 
+            /* Load this page.  The kernel writes it through its own
+               mapping, which leaves the user PTE clean, so mark it dirty by
+               hand to make sure eviction saves it. */
+            if (!read_page(file, ofs, kpage, page_read_bytes, copy)) {
+                page_unpin(p);
+                return false;
+            }
+            if (page_read_bytes > 0)
+                pagedir_set_dirty(t->pagedir, upage, true);
+            page_unpin(p);
+        }
+#else
         /* Get a page of memory. */
         uint8_t *kpage = palloc_get_page(PAL_USER);
         if (kpage == NULL)
             return false;
 
         /* Load this page. */
-        if (file_read(file, kpage, page_read_bytes) != (int) page_read_bytes) {
+        if (!read_page(file, ofs, kpage, page_read_bytes, copy)) {
             palloc_free_page(kpage);
             return false;
         }
@@ -385,32 +1257,122 @@ static bool load_segment(struct file *file, off_t ofs, uint8_t *upage,
             palloc_free_page(kpage);
             return false; 
         }
+#endif
 
         /* Advance. */
         read_bytes -= page_read_bytes;
         zero_bytes -= page_zero_bytes;
         upage += PGSIZE;
+        ofs += page_read_bytes;
+        page_idx++;
     }
     return true;
 }
 
-/*! Create a minimal stack by mapping a zeroed page at the top of
-    user virtual memory. */
-static bool setup_stack(void **esp) {
+/*! Reads READ_BYTES bytes at offset OFS in FILE into KPAGE.  If COPY is
+    nonnull and *COPY holds a copy of those bytes made by an earlier load,
+    reads that instead; if *COPY is null, makes such a copy there if memory
+    allows.  Returns false if the read fails. */
+static bool read_page(struct file *file, off_t ofs, void *kpage,
+                      size_t read_bytes, void **copy) {
+    if (copy != NULL && *copy != NULL) {
+        memcpy(kpage, *copy, read_bytes);
+        return true;
+    }
+
+    if (file_read_at(file, kpage, read_bytes, ofs) != (int) read_bytes)
+        return false;
+    if (copy != NULL) {
+        *copy = palloc_get_page(0);
+        if (*copy != NULL)
+            memcpy(*copy, kpage, read_bytes);
+    }
+    return true;
+}
+
+/*! Create a minimal stack by mapping a zeroed page at the top of user
+    virtual memory, and push the program's arguments onto it: FILE_NAME,
+    then the rest of the words that strtok_r() returns for SAVE_PTR. */
+static bool setup_stack(void **esp, const char *file_name, char **save_ptr) {
+#ifdef VM
+    struct page *p = page_create(((uint8_t *) PHYS_BASE) - PGSIZE, true);
+    bool success;
+
+    /* Keep the page resident while we write it through its user
+       address. */
+    if (p == NULL || !page_in(p, true))
+        return false;
+    *esp = PHYS_BASE;
+    success = push_args(esp, file_name, save_ptr);
+    page_unpin(p);
+    return success;
+#else
     uint8_t *kpage;
     bool success = false;
 
     kpage = palloc_get_page(PAL_USER | PAL_ZERO);
     if (kpage != NULL) {
         success = install_page(((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-        if (success)
+        if (success) {
             *esp = PHYS_BASE;
+            success = push_args(esp, file_name, save_ptr);
+        }
         else
             palloc_free_page(kpage);
     }
     return success;
+#endif
+}
+
+/*! Pushes the SIZE bytes at DATA onto the user stack at *ESP.  Returns false
+    if they would not fit in the stack's single page. */
+static bool push(void **esp, const void *data, size_t size) {
+    uint8_t *sp = *esp;
+
+    if ((size_t) (sp - ((uint8_t *) PHYS_BASE - PGSIZE)) < size)
+        return false;
+    sp -= size;
+    memcpy(sp, data, size);
+    *esp = sp;
+    return true;
+}
+
+/*! Sets up the freshly mapped user stack at *ESP the way the 80x86 calling
+    convention has it on entry to main(): the argument strings, the argv
+    array that points to them, argc, and a null return address.  The
+    arguments are FILE_NAME followed by the words that strtok_r() returns
+    for SAVE_PTR.  Returns false if they do not fit in a page. */
+static bool push_args(void **esp, const char *file_name, char **save_ptr) {
+    const char *arg;
+    char *s, **argv;
+    void *null = NULL;
+    int argc = 0;
+    int i;
+
+    for (arg = file_name; arg != NULL; arg = strtok_r(NULL, " ", save_ptr)) {
+        if (!push(esp, arg, strlen(arg) + 1))
+            return false;
+        argc++;
+    }
+    s = *esp;
+
+    /* Word-align, then argv[argc] down to argv[0].  The strings went on in
+       order, so walking up from the last one pushed visits them in reverse. */
+    *esp = (void *) ((uintptr_t) *esp & ~3);
+    if (!push(esp, &null, sizeof null))
+        return false;
+    for (i = 0; i < argc; i++) {
+        if (!push(esp, &s, sizeof s))
+            return false;
+        s += strlen(s) + 1;
+    }
+
+    argv = *esp;
+    return (push(esp, &argv, sizeof argv) && push(esp, &argc, sizeof argc)
+            && push(esp, &null, sizeof null));
 }
 
+#ifndef VM
 /*! Adds a mapping from user virtual address UPAGE to kernel
     virtual address KPAGE to the page table.
     If WRITABLE is true, the user process may modify the page;
@@ -428,4 +1390,4 @@ static bool install_page(void *upage, void *kpage, bool writable) {
     return (pagedir_get_page(t->pagedir, upage) == NULL &&
             pagedir_set_page(t->pagedir, upage, kpage, writable));
 }
-
+#endif
@@ -3,10 +3,31 @@
 
 #include "threads/thread.h"
 
-tid_t process_execute(const char *file_name);
+struct file;
+struct intr_frame;
+struct pipe;
+
+tid_t process_execute(const char *cmd_line);
+#ifdef VM
+tid_t process_fork(const struct intr_frame *);
+#endif
 int process_wait(tid_t);
+void process_set_exit_status(int);
 void process_exit(void);
 void process_activate(void);
+struct thread *process_current(void);
+void process_check_exit(void);
+#ifdef VM
+tid_t process_thread_create(void (*entry)(void), void *arg0, void *arg1);
+int process_thread_join(tid_t);
+void process_thread_exit(void) NO_RETURN;
+#endif
+
+int process_add_file(struct file *);
+int process_add_pipe(struct pipe *, bool write_end);
+struct file *process_get_file(int fd);
+struct pipe *process_get_pipe(int fd, bool write_end);
+void process_close_file(int fd);
 
 #endif /* userprog/process.h */
 
@@ -1,17 +1,744 @@
 #include "userprog/syscall.h"
+#include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
+#include <syscall-batch.h>
 #include <syscall-nr.h>
+#include <time.h>
+#include <uio.h>
+#include "devices/input.h"
+#include "devices/rtc.h"
+#include "devices/shutdown.h"
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/futex.h"
+#include "userprog/gdt.h"
+#include "userprog/pipe.h"
+#include "userprog/process.h"
+#include "userprog/tss.h"
+#include "userprog/usercopy.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/shm.h"
+#endif
 
-static void syscall_handler(struct intr_frame *);
+/*! A system call handler.  Handlers are declared with the parameters they
+    actually take and called with all four argument slots; the 80x86
+    calling convention makes the extra ones harmless. */
+typedef uint32_t syscall_function(uint32_t, uint32_t, uint32_t, uint32_t);
 
+/*! A system call. */
+struct syscall {
+    const char *name;           /*!< Name, for statistics. */
+    size_t arg_cnt;             /*!< Number of 32-bit arguments. */
+    syscall_function *func;     /*!< Handler. */
+};
+
+static void sys_halt(void) NO_RETURN;
+static void sys_exit(int status) NO_RETURN;
+static tid_t sys_exec(const char *ucmd_line);
+static int sys_wait(tid_t);
+static bool sys_create(const char *ufile, unsigned initial_size);
+static bool sys_remove(const char *ufile);
+static int sys_open(const char *ufile);
+static int sys_filesize(int fd);
+static int sys_read(int fd, void *ubuf, unsigned size);
+static int sys_write(int fd, const void *ubuf, unsigned size);
+static void sys_seek(int fd, unsigned position);
+static unsigned sys_tell(int fd);
+static void sys_close(int fd);
+#ifdef VM
+static mapid_t sys_mmap(int fd, void *addr);
+static void sys_munmap(mapid_t);
+static tid_t sys_fork(void);
+#endif
+static int sys_batch(void);
+static int sys_readv(int fd, const struct iovec *uiov, int iovcnt);
+static int sys_writev(int fd, const struct iovec *uiov, int iovcnt);
+static int sys_pread(int fd, void *ubuf, unsigned size, unsigned offset);
+static int sys_pwrite(int fd, const void *ubuf, unsigned size,
+                      unsigned offset);
+static int sys_pipe(int *ufds);
+#ifdef VM
+static bool sys_shm_create(const char *uname, unsigned size, void *addr);
+static int sys_shm_attach(const char *uname, void *addr);
+static void sys_shm_detach(void *addr);
+#endif
+static int sys_futex_wait(const uint32_t *uaddr, uint32_t expected);
+static int sys_futex_wake(const uint32_t *uaddr, int n);
+#ifdef VM
+static tid_t sys_thread_create(void (*entry)(void), void *arg0, void *arg1);
+static int sys_thread_join(tid_t);
+static void sys_thread_exit(void) NO_RETURN;
+#endif
+static int sys_clock_gettime(int clock, struct timespec *uts);
+
+/*! Table entry for sys_NAME(), which takes ARG_CNT arguments.  Casting
+    through void (*)(void) marks the change of type as intended. */
+#define SYSCALL(NAME, ARG_CNT) \
+    { #NAME, ARG_CNT, (syscall_function *) (void (*)(void)) sys_##NAME }
+
+/*! System calls, indexed by the numbers in syscall-nr.h.  Calls this kernel
+    does not implement have no handler. */
+static const struct syscall syscall_table[] = {
+    [SYS_HALT] = SYSCALL(halt, 0),
+    [SYS_EXIT] = SYSCALL(exit, 1),
+    [SYS_EXEC] = SYSCALL(exec, 1),
+    [SYS_WAIT] = SYSCALL(wait, 1),
+    [SYS_CREATE] = SYSCALL(create, 2),
+    [SYS_REMOVE] = SYSCALL(remove, 1),
+    [SYS_OPEN] = SYSCALL(open, 1),
+    [SYS_FILESIZE] = SYSCALL(filesize, 1),
+    [SYS_READ] = SYSCALL(read, 3),
+    [SYS_WRITE] = SYSCALL(write, 3),
+    [SYS_SEEK] = SYSCALL(seek, 2),
+    [SYS_TELL] = SYSCALL(tell, 1),
+    [SYS_CLOSE] = SYSCALL(close, 1),
+#ifdef VM
+    [SYS_MMAP] = SYSCALL(mmap, 2),
+    [SYS_MUNMAP] = SYSCALL(munmap, 1),
+    [SYS_FORK] = SYSCALL(fork, 0),
+#endif
+    [SYS_BATCH] = SYSCALL(batch, 0),
+    [SYS_READV] = SYSCALL(readv, 3),
+    [SYS_WRITEV] = SYSCALL(writev, 3),
+    [SYS_PREAD] = SYSCALL(pread, 4),
+    [SYS_PWRITE] = SYSCALL(pwrite, 4),
+    [SYS_PIPE] = SYSCALL(pipe, 1),
+#ifdef VM
+    [SYS_SHM_CREATE] = SYSCALL(shm_create, 3),
+    [SYS_SHM_ATTACH] = SYSCALL(shm_attach, 2),
+    [SYS_SHM_DETACH] = SYSCALL(shm_detach, 1),
+#endif
+    [SYS_FUTEX_WAIT] = SYSCALL(futex_wait, 2),
+    [SYS_FUTEX_WAKE] = SYSCALL(futex_wake, 2),
+#ifdef VM
+    [SYS_THREAD_CREATE] = SYSCALL(thread_create, 3),
+    [SYS_THREAD_JOIN] = SYSCALL(thread_join, 1),
+    [SYS_THREAD_EXIT] = SYSCALL(thread_exit, 0),
+#endif
+    [SYS_CLOCK_GETTIME] = SYSCALL(clock_gettime, 2),
+};
+
+/*! Number of entries in syscall_table. */
+#define SYSCALL_CNT (sizeof syscall_table / sizeof *syscall_table)
+
+/* Statistics. */
+static long long call_cnt[SYSCALL_CNT];     /*!< # of calls of each. */
+static int64_t call_ns[SYSCALL_CNT];        /*!< Nanoseconds spent in each. */
+
+/* In sysenter.S. */
+void sysenter_entry(void);
+
+static void sysenter_init(void);
+static const struct syscall *syscall_lookup(unsigned nr);
+static int do_io(int fd, const struct iovec *iov, int iovcnt, bool write,
+                 bool positional, off_t offset);
+static int transfer(struct file *, off_t, uint8_t *ubuf, size_t size,
+                    uint8_t *kbuf, bool write);
+static uint32_t syscall_invoke(const struct syscall *, const uint32_t args[]);
+
+static char *copy_in_string(const char *us);
+
+/*! Serializes access to the file system, which does no locking of its
+    own. */
+struct lock fs_lock;
+
+/*! Sets up the entry points for system calls: `int $0x30', and also
+    SYSENTER if the CPU has it. */
 void syscall_init(void) {
-    intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
+    lock_init(&fs_lock);
+    intr_register_int(0x30, 3, INTR_ON, syscall_dispatch, "syscall");
+    sysenter_init();
+}
+
+/*! Sets up SYSENTER on the application processor we are running on.  The
+    IDT entry for `int $0x30' is shared by all CPUs. */
+void syscall_init_ap(void) {
+    sysenter_init();
+}
+
+/*! Sets up SYSENTER on the current CPU, if it has it.  SYSENTER loads its
+    stack pointer from MSR_SYSENTER_ESP, so we point that to the kernel
+    stack pointer in this CPU's TSS, which is kept up to date across thread
+    switches, and let sysenter_entry load the actual stack pointer from
+    there. */
+static void sysenter_init(void) {
+    if (cpu_has_sysenter()) {
+        wrmsr(MSR_SYSENTER_CS, SEL_KCSEG);
+        wrmsr(MSR_SYSENTER_ESP, (uintptr_t) tss_esp0());
+        wrmsr(MSR_SYSENTER_EIP, (uintptr_t) sysenter_entry);
+    }
+}
+
+/*! Prints the number of calls of each system call that has been used and the
+    time spent in it. */
+void syscall_print_stats(void) {
+    size_t nr;
+
+    printf("System calls:");
+    for (nr = 0; nr < SYSCALL_CNT; nr++)
+        if (call_cnt[nr] > 0)
+            printf(" %s %lld (%"PRId64" us)", syscall_table[nr].name,
+                   call_cnt[nr], call_ns[nr] / 1000);
+    printf("\n");
 }
 
-static void syscall_handler(struct intr_frame *f UNUSED) {
-    printf("system call!\n");
+/*! Carries out the system call requested by the user stack in F, from
+    either entry point. */
+void syscall_dispatch(struct intr_frame *f) {
+    const struct syscall *sc;
+    uint32_t args[4];
+    unsigned nr;
+
+    /* Fetch the system call number and, in one copy, its arguments. */
+    if (!copy_from_user(&nr, f->esp, sizeof nr))
+        sys_exit(-1);
+    sc = syscall_lookup(nr);
+    if (sc == NULL)
+        sys_exit(-1);
+    memset(args, 0, sizeof args);
+    if (!copy_from_user(args, (uint32_t *) f->esp + 1,
+                        sc->arg_cnt * sizeof *args))
+        sys_exit(-1);
+
+    f->eax = syscall_invoke(sc, args);
+
+    /* SYSENTER returns to user mode without passing through
+       intr_handler(), which would otherwise make this check. */
+    process_check_exit();
+}
+
+/*! Returns the system call numbered NR, or a null pointer if there is
+    none. */
+static const struct syscall * syscall_lookup(unsigned nr) {
+    if (nr >= SYSCALL_CNT || syscall_table[nr].func == NULL)
+        return NULL;
+    return &syscall_table[nr];
+}
+
+/*! Calls the handler for SC with ARGS, counting the call and the time it
+    takes, and returns its return value. */
+static uint32_t syscall_invoke(const struct syscall *sc,
+                               const uint32_t args[]) {
+    size_t nr = sc - syscall_table;
+    int64_t start;
+    uint32_t retval;
+
+    /* exit() and halt() never return, so they are counted up front. */
+    call_cnt[nr]++;
+    start = timer_now_ns();
+    retval = sc->func(args[0], args[1], args[2], args[3]);
+    call_ns[nr] += timer_now_ns() - start;
+    return retval;
+}
+
+/*! Returns a copy of the null-terminated string at user address US in a page
+    obtained from palloc_get_page(), which the caller must free.  Terminates
+    the process if US is not a valid user string; a string longer than a page
+    is truncated. */
+static char * copy_in_string(const char *us) {
+    char *ks = palloc_get_page(0);
+
+    if (ks == NULL)
+        sys_exit(-1);
+    if (us == NULL || strncpy_from_user(ks, us, PGSIZE) < 0) {
+        palloc_free_page(ks);
+        sys_exit(-1);
+    }
+    ks[PGSIZE - 1] = '\0';
+    return ks;
+}
+
+/*! Powers off the machine. */
+static void sys_halt(void) {
+    shutdown_power_off();
+}
+
+/*! Terminates the current process, reporting STATUS to its parent. */
+static void sys_exit(int status) {
+    process_set_exit_status(status);
     thread_exit();
 }
 
+/*! Runs the program named by the first word of user string UCMD_LINE, with
+    the rest as its arguments, and returns its process id, or -1 if it could
+    not be loaded. */
+static tid_t sys_exec(const char *ucmd_line) {
+    char *kcmd_line = copy_in_string(ucmd_line);
+    tid_t tid = process_execute(kcmd_line);
+
+    palloc_free_page(kcmd_line);
+    return tid;
+}
+
+/*! Waits for child process TID to exit and returns its exit status. */
+static int sys_wait(tid_t tid) {
+    return process_wait(tid);
+}
+
+/*! Creates a file named by user string UFILE, INITIAL_SIZE bytes long. */
+static bool sys_create(const char *ufile, unsigned initial_size) {
+    char *kfile = copy_in_string(ufile);
+    bool success;
+
+    lock_acquire(&fs_lock);
+    success = filesys_create(kfile, initial_size);
+    lock_release(&fs_lock);
+
+    palloc_free_page(kfile);
+    return success;
+}
+
+/*! Deletes the file named by user string UFILE. */
+static bool sys_remove(const char *ufile) {
+    char *kfile = copy_in_string(ufile);
+    bool success;
+
+    lock_acquire(&fs_lock);
+    success = filesys_remove(kfile);
+    lock_release(&fs_lock);
+
+    palloc_free_page(kfile);
+    return success;
+}
+
+/*! Opens the file named by user string UFILE and returns a new file
+    descriptor for it, or -1 if the file could not be opened. */
+static int sys_open(const char *ufile) {
+    char *kfile = copy_in_string(ufile);
+    struct file *file;
+    int fd = -1;
+
+    lock_acquire(&fs_lock);
+    file = filesys_open(kfile);
+    if (file != NULL) {
+        fd = process_add_file(file);
+        if (fd == -1)
+            file_close(file);
+    }
+    lock_release(&fs_lock);
+
+    palloc_free_page(kfile);
+    return fd;
+}
+
+/*! Returns the size of the file open as FD, or -1 if FD is not open. */
+static int sys_filesize(int fd) {
+    struct file *file = process_get_file(fd);
+    int size;
+
+    if (file == NULL)
+        return -1;
+
+    lock_acquire(&fs_lock);
+    size = file_length(file);
+    lock_release(&fs_lock);
+    return size;
+}
+
+/*! Reads up to SIZE bytes into user buffer UBUF from FD, which is either
+    STDIN_FILENO or an open file.  Returns the number of bytes read, or -1
+    if FD is not open for reading. */
+static int sys_read(int fd, void *ubuf, unsigned size) {
+    struct iovec iov = { ubuf, size };
+    return do_io(fd, &iov, 1, false, false, 0);
+}
+
+/*! Writes SIZE bytes from user buffer UBUF to FD, which is either
+    STDOUT_FILENO or an open file.  Returns the number of bytes written, or
+    -1 if FD is not open for writing. */
+static int sys_write(int fd, const void *ubuf, unsigned size) {
+    struct iovec iov = { (void *) ubuf, size };
+    return do_io(fd, &iov, 1, true, false, 0);
+}
+
+/*! Sets the position of the file open as FD to POSITION.  A position
+    beyond the largest file offset is ignored. */
+static void sys_seek(int fd, unsigned position) {
+    struct file *file = process_get_file(fd);
+
+    if (file != NULL && position <= INT32_MAX) {
+        lock_acquire(&fs_lock);
+        file_seek(file, position);
+        lock_release(&fs_lock);
+    }
+}
+
+/*! Returns the position of the file open as FD, or 0 if FD is not open. */
+static unsigned sys_tell(int fd) {
+    struct file *file = process_get_file(fd);
+    unsigned position = 0;
+
+    if (file != NULL) {
+        lock_acquire(&fs_lock);
+        position = file_tell(file);
+        lock_release(&fs_lock);
+    }
+    return position;
+}
+
+/*! Closes file descriptor FD. */
+static void sys_close(int fd) {
+    lock_acquire(&fs_lock);
+    process_close_file(fd);
+    lock_release(&fs_lock);
+}
+
+#ifdef VM
+/*! Maps the file open as FD into memory at ADDR.  The console descriptors
+    cannot be mapped. */
+static mapid_t sys_mmap(int fd, void *addr) {
+    struct file *file = process_get_file(fd);
+    mapid_t id;
+
+    if (file == NULL)
+        return MAP_FAILED;
+
+    lock_acquire(&fs_lock);
+    id = mmap_map(file, addr);
+    lock_release(&fs_lock);
+    return id;
+}
+
+/*! Removes memory mapping ID. */
+static void sys_munmap(mapid_t id) {
+    mmap_unmap(id);
+}
+
+/*! Creates a copy of the current process.  Returns the child's process id
+    in the parent and 0 in the child, or -1 if the child could not be
+    created. */
+static tid_t sys_fork(void) {
+    /* The user context saved on entry to the kernel sits at the top of our
+       kernel stack. */
+    struct intr_frame *f = ((struct intr_frame *)
+                            ((uint8_t *) thread_current() + PGSIZE)) - 1;
+    return process_fork(f);
+}
+#endif
+
+/*! Carries out, in order, the system calls queued in the current process's
+    batch ring, posting each one's return value in its entry.  A call that
+    does not exist, or that cannot be batched, gets -1.  Returns the number
+    of calls carried out, or -1 if the ring's indexes are inconsistent.
+
+    The ring is shared with the process, so each entry is copied before use
+    and the indexes are read only once. */
+static int sys_batch(void) {
+    struct batch_ring *ring = process_current()->batch_ring;
+    unsigned head = ring->sq_head;
+    unsigned tail = ring->sq_tail;
+    int cnt = 0;
+
+    if (tail - head > BATCH_ENTRIES)
+        return -1;
+
+    for (; head != tail; head++) {
+        struct batch_entry *e = &ring->entries[head % BATCH_ENTRIES];
+        struct batch_entry req = *e;
+        const struct syscall *sc = syscall_lookup(req.nr);
+
+        /* fork() needs the user context of a real kernel entry. */
+        if (sc != NULL && req.nr != SYS_FORK && req.nr != SYS_BATCH)
+            e->result = syscall_invoke(sc, req.args);
+        else
+            e->result = -1;
+        ring->sq_head = head + 1;
+        cnt++;
+    }
+    return cnt;
+}
+
+/*! Reads from FD, like sys_read(), into the IOVCNT buffers described by the
+    array at user address UIOV, filling each before moving on to the
+    next. */
+static int sys_readv(int fd, const struct iovec *uiov, int iovcnt) {
+    struct iovec iov[IOV_MAX];
+
+    if (iovcnt < 0 || iovcnt > IOV_MAX)
+        return -1;
+    if (!copy_from_user(iov, uiov, iovcnt * sizeof *iov))
+        sys_exit(-1);
+    return do_io(fd, iov, iovcnt, false, false, 0);
+}
+
+/*! Writes to FD, like sys_write(), the IOVCNT buffers described by the
+    array at user address UIOV, in order. */
+static int sys_writev(int fd, const struct iovec *uiov, int iovcnt) {
+    struct iovec iov[IOV_MAX];
+
+    if (iovcnt < 0 || iovcnt > IOV_MAX)
+        return -1;
+    if (!copy_from_user(iov, uiov, iovcnt * sizeof *iov))
+        sys_exit(-1);
+    return do_io(fd, iov, iovcnt, true, false, 0);
+}
+
+/*! Reads up to SIZE bytes into user buffer UBUF from the file open as FD,
+    starting at byte OFFSET, without using or changing its position.
+    Returns the number of bytes read, or -1 if FD is not an open file or
+    OFFSET is beyond the largest file offset. */
+static int sys_pread(int fd, void *ubuf, unsigned size, unsigned offset) {
+    struct iovec iov = { ubuf, size };
+
+    if (offset > INT32_MAX)
+        return -1;
+    return do_io(fd, &iov, 1, false, true, offset);
+}
+
+/*! Writes SIZE bytes from user buffer UBUF to the file open as FD, starting
+    at byte OFFSET, without using or changing its position.  Returns the
+    number of bytes written, or -1 if FD is not an open file or OFFSET is
+    beyond the largest file offset. */
+static int sys_pwrite(int fd, const void *ubuf, unsigned size,
+                      unsigned offset) {
+    struct iovec iov = { (void *) ubuf, size };
+
+    if (offset > INT32_MAX)
+        return -1;
+    return do_io(fd, &iov, 1, true, true, offset);
+}
+
+/*! Creates a pipe and stores descriptors for its read and write ends in
+    the two-element array at user address UFDS.  Returns 0 if successful,
+    -1 if memory allocation fails. */
+static int sys_pipe(int *ufds) {
+    struct pipe *pipe = pipe_create();
+    int fds[2];
+
+    if (pipe == NULL)
+        return -1;
+
+    fds[0] = process_add_pipe(pipe, false);
+    if (fds[0] == -1) {
+        pipe_close(pipe, false);
+        pipe_close(pipe, true);
+        return -1;
+    }
+    fds[1] = process_add_pipe(pipe, true);
+    if (fds[1] == -1) {
+        process_close_file(fds[0]);
+        pipe_close(pipe, true);
+        return -1;
+    }
+
+    if (!copy_to_user(ufds, fds, sizeof fds)) {
+        process_close_file(fds[0]);
+        process_close_file(fds[1]);
+        sys_exit(-1);
+    }
+    return 0;
+}
+
+#ifdef VM
+/*! Creates a shared memory segment named by user string UNAME, SIZE bytes
+    long, and attaches it at ADDR. */
+static bool sys_shm_create(const char *uname, unsigned size, void *addr) {
+    char *kname = copy_in_string(uname);
+    bool success = shm_create(kname, size, addr);
+
+    palloc_free_page(kname);
+    return success;
+}
+
+/*! Attaches the shared memory segment named by user string UNAME at ADDR
+    and returns its size, or -1 on failure. */
+static int sys_shm_attach(const char *uname, void *addr) {
+    char *kname = copy_in_string(uname);
+    int size = shm_attach(kname, addr);
+
+    palloc_free_page(kname);
+    return size;
+}
+
+/*! Detaches the shared memory segment attached at ADDR. */
+static void sys_shm_detach(void *addr) {
+    shm_detach(addr);
+}
+#endif
+
+/*! Sleeps on the user word at UADDR if it holds EXPECTED; see
+    futex_wait(). */
+static int sys_futex_wait(const uint32_t *uaddr, uint32_t expected) {
+    return futex_wait(uaddr, expected);
+}
+
+/*! Wakes up to N threads sleeping on the user word at UADDR; see
+    futex_wake(). */
+static int sys_futex_wake(const uint32_t *uaddr, int n) {
+    return futex_wake(uaddr, n);
+}
+
+#ifdef VM
+/*! Starts a new thread in the current process running ENTRY(ARG0, ARG1);
+    see process_thread_create(). */
+static tid_t sys_thread_create(void (*entry)(void), void *arg0, void *arg1) {
+    return process_thread_create(entry, arg0, arg1);
+}
+
+/*! Waits for thread TID of the current process to exit; see
+    process_thread_join(). */
+static int sys_thread_join(tid_t tid) {
+    return process_thread_join(tid);
+}
+
+/*! Ends the calling thread. */
+static void sys_thread_exit(void) {
+    process_thread_exit();
+}
+#endif
+
+/*! Stores the time by CLOCK, one of the CLOCK_* constants, in the timespec
+    at user address UTS.  Returns 0 if successful, -1 if CLOCK is not a
+    known clock.  The real-time clock counts from the CMOS clock's reading
+    the first time it is asked for, which is only good to the second. */
+static int sys_clock_gettime(int clock, struct timespec *uts) {
+    static int64_t boot_time = -1;
+    struct timespec ts;
+    int64_t ns = timer_now_ns();
+
+    if (clock == CLOCK_REALTIME) {
+        if (boot_time < 0)
+            boot_time = rtc_get_time() - ns / 1000000000;
+        ns += boot_time * 1000000000;
+    }
+    else if (clock != CLOCK_MONOTONIC)
+        return -1;
+
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    if (!copy_to_user(uts, &ts, sizeof ts))
+        sys_exit(-1);
+    return 0;
+}
+
+/*! Carries out a read, or a write if WRITE is true, between FD and the
+    IOVCNT user buffers in IOV, which are in kernel memory.  FD may be the
+    console descriptor for the direction, unless POSITIONAL is true.  A file
+    is accessed at OFFSET if POSITIONAL is true, otherwise at its position,
+    which is then advanced.  FD may also be the matching end of a pipe,
+    unless POSITIONAL is true; writing to a pipe that nobody can read any
+    more kills the process, as SIGPIPE would on Unix.  Returns the number of
+    bytes transferred, or -1 if FD is not open for the purpose.
+
+    The whole call takes the file system lock just once.  The file system
+    cannot recover from a fault in the middle of an inode operation, so the
+    data goes through a kernel buffer, a page at a time.  No byte is
+    transferred beyond the largest file offset, INT32_MAX. */
+static int do_io(int fd, const struct iovec *iov, int iovcnt, bool write,
+                 bool positional, off_t offset) {
+    struct file *file = NULL;
+    struct pipe *pipe;
+    uint8_t *kbuf;
+    size_t total = 0;
+    bool bad = false;
+    int i;
+
+    /* Pipes block, so they must not hold up the file system lock. */
+    pipe = process_get_pipe(fd, write);
+    if (pipe != NULL) {
+        int n;
+
+        if (positional)
+            return -1;
+        n = write ? pipe_write(pipe, iov, iovcnt)
+                  : pipe_read(pipe, iov, iovcnt);
+        if (n < 0)
+            sys_exit(-1);
+        return n;
+    }
+
+    if (fd != (write ? STDOUT_FILENO : STDIN_FILENO)) {
+        file = process_get_file(fd);
+        if (file == NULL)
+            return -1;
+    }
+    else if (positional) {
+        return -1;
+    }
+
+    kbuf = palloc_get_page(0);
+    if (kbuf == NULL)
+        return -1;
+
+    if (file != NULL) {
+        lock_acquire(&fs_lock);
+        if (!positional)
+            offset = file_tell(file);
+    }
+    for (i = 0; i < iovcnt; i++) {
+        size_t room = INT32_MAX - (offset + total);
+        size_t len = iov[i].iov_len < room ? iov[i].iov_len : room;
+        int n = transfer(file, offset + total, iov[i].iov_base, len, kbuf,
+                         write);
+        if (n < 0) {
+            bad = true;
+            break;
+        }
+        total += n;
+        if ((size_t) n < iov[i].iov_len)
+            break;
+    }
+    if (file != NULL) {
+        if (!positional)
+            file_seek(file, offset + total);
+        lock_release(&fs_lock);
+    }
+    palloc_free_page(kbuf);
+
+    /* Only now that we hold no lock may we die of a bad buffer. */
+    if (bad)
+        sys_exit(-1);
+    return total;
+}
+
+/*! Moves SIZE bytes between user buffer UBUF and FILE at offset OFS, or
+    the console if FILE is null, a page at a time through kernel page KBUF:
+    from FILE to UBUF, or the other way if WRITE is true.  Returns the number
+    of bytes moved, which is less than SIZE at end of file, or -1 if UBUF is
+    not a valid user buffer. */
+static int transfer(struct file *file, off_t ofs, uint8_t *ubuf, size_t size,
+                    uint8_t *kbuf, bool write) {
+    size_t done = 0;
+
+    while (done < size) {
+        size_t chunk = size - done < PGSIZE ? size - done : PGSIZE;
+        size_t n;
+
+        if (write) {
+            if (!copy_from_user(kbuf, ubuf + done, chunk))
+                return -1;
+            if (file != NULL) {
+                n = file_write_at(file, kbuf, chunk, ofs + done);
+            }
+            else {
+                putbuf((const char *) kbuf, chunk);
+                n = chunk;
+            }
+        }
+        else {
+            if (file != NULL) {
+                n = file_read_at(file, kbuf, chunk, ofs + done);
+            }
+            else {
+                for (n = 0; n < chunk; n++)
+                    kbuf[n] = input_getc();
+            }
+            if (!copy_to_user(ubuf + done, kbuf, n))
+                return -1;
+        }
+
+        done += n;
+        if (n < chunk)
+            break;
+    }
+    return done;
+}
@@ -1,7 +1,16 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include "threads/synch.h"
+
+struct intr_frame;
+
+extern struct lock fs_lock;
+
 void syscall_init(void);
+void syscall_init_ap(void);
+void syscall_dispatch(struct intr_frame *);
+void syscall_print_stats(void);
 
 #endif /* userprog/syscall.h */
 
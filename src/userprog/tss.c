@@ -4,6 +4,7 @@
 #include "userprog/gdt.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
+#include "threads/smp.h"
 #include "threads/vaddr.h"
 
 /*! The Task-State Segment (TSS).
@@ -65,29 +66,41 @@ struct tss {
     uint16_t trace, bitmap;
 };
 
-/*! Kernel TSS. */
+/*! Kernel TSSs, one per CPU, all in one page. */
 static struct tss *tss;
 
-/*! Initializes the kernel TSS. */
+/*! Initializes the kernel TSSs. */
 void tss_init(void) {
+    int i;
+
+    ASSERT(CPU_MAX * sizeof *tss <= PGSIZE);
+
     /* Our TSS is never used in a call gate or task gate, so only a few fields
        of it are ever referenced, and those are the only ones we initialize. */
     tss = palloc_get_page(PAL_ASSERT | PAL_ZERO);
-    tss->ss0 = SEL_KDSEG;
-    tss->bitmap = 0xdfff;
+    for (i = 0; i < CPU_MAX; i++) {
+        tss[i].ss0 = SEL_KDSEG;
+        tss[i].bitmap = 0xdfff;
+    }
     tss_update();
 }
 
-/*! Returns the kernel TSS. */
-struct tss * tss_get(void) {
+/*! Returns the TSS of the CPU numbered CPU_ID. */
+struct tss * tss_get(int cpu_id) {
     ASSERT(tss != NULL);
-    return tss;
+    ASSERT(cpu_id >= 0 && cpu_id < CPU_MAX);
+    return &tss[cpu_id];
 }
 
-/*! Sets the ring 0 stack pointer in the TSS to point to the end
-    of the thread stack. */
+/*! Returns the address of the ring 0 stack pointer in the current CPU's TSS,
+    which always points to the end of the running thread's stack. */
+void ** tss_esp0(void) {
+    return &tss_get(cpu_current()->id)->esp0;
+}
+
+/*! Sets the ring 0 stack pointer in the current CPU's TSS to point to the
+    end of the thread stack. */
 void tss_update(void) {
-    ASSERT(tss != NULL);
-    tss->esp0 = (uint8_t *) thread_current() + PGSIZE;
+    *tss_esp0() = (uint8_t *) thread_current() + PGSIZE;
 }
 
@@ -0,0 +1,75 @@
+/*! \file usercopy.c
+ *
+ * Copying data between the kernel and user processes.
+ *
+ * Rather than checking that user memory is mapped before touching it, which
+ * costs a page table walk per page, these functions just copy.  A bad user
+ * address makes the copy fault, and the page fault handler sends the copy
+ * routine to recovery code that reports failure (see copy.S).  With
+ * virtual memory, a fault on a page that is merely not resident is handled
+ * as usual and the copy carries on.
+ */
+
+#include "userprog/usercopy.h"
+#include <debug.h>
+#include "threads/vaddr.h"
+
+/*! A user access in copy.S that may fault, and where to go if it
+    does. */
+struct fixup {
+    uintptr_t insn;             /*!< Address of the faulting instruction. */
+    uintptr_t recovery;         /*!< Address to resume at. */
+};
+
+/* In copy.S. */
+size_t usercopy(void *dst, const void *src, size_t size);
+int usercopy_str(char *dst, const char *src, size_t size);
+extern const struct fixup usercopy_fixups[], usercopy_fixups_end[];
+
+/*! Returns true if the SIZE bytes at UADDR lie entirely in user memory. */
+static inline bool is_user_range(const void *uaddr, size_t size) {
+    return (uintptr_t) uaddr <= (uintptr_t) PHYS_BASE
+           && size <= (uintptr_t) PHYS_BASE - (uintptr_t) uaddr;
+}
+
+/*! Copies SIZE bytes from user address USRC to kernel address DST.  Returns
+    false if any of them is not readable by the current process. */
+bool copy_from_user(void *dst, const void *usrc, size_t size) {
+    return is_user_range(usrc, size) && usercopy(dst, usrc, size) == 0;
+}
+
+/*! Copies SIZE bytes from kernel address SRC to user address UDST.  Returns
+    false if any of them is not writable by the current process. */
+bool copy_to_user(void *udst, const void *src, size_t size) {
+    return is_user_range(udst, size) && usercopy(udst, src, size) == 0;
+}
+
+/*! Copies the null-terminated string at user address USRC into DST, which
+    has room for SIZE bytes.  Returns the length of the string, or SIZE if
+    it is too long to fit, in which case DST is not null-terminated.
+    Returns -1 if the string is not readable by the current process. */
+int strncpy_from_user(char *dst, const char *usrc, size_t size) {
+    size_t room;
+    int length;
+
+    if ((uintptr_t) usrc >= (uintptr_t) PHYS_BASE)
+        return -1;
+
+    /* A string running into kernel memory is bad, not long. */
+    room = (uintptr_t) PHYS_BASE - (uintptr_t) usrc;
+    if (size <= room)
+        return usercopy_str(dst, usrc, size);
+    length = usercopy_str(dst, usrc, room);
+    return length == (int) room ? -1 : length;
+}
+
+/*! Returns the address at which to resume after a page fault at EIP in the
+    kernel, or 0 if EIP is not in one of the user copy routines. */
+uintptr_t usercopy_fixup(uintptr_t eip) {
+    const struct fixup *f;
+
+    for (f = usercopy_fixups; f < usercopy_fixups_end; f++)
+        if (f->insn == eip)
+            return f->recovery;
+    return 0;
+}
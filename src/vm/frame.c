@@ -0,0 +1,728 @@
+/*! \file frame.c
+ *
+ * Frame table.  Every frame handed out from the user pool is recorded here,
+ * so that when the pool runs dry a frame can be taken back from whichever
+ * pages map it.  Victims are chosen by the second-chance "clock" algorithm,
+ * using the accessed bits the CPU keeps in each page's PTE.
+ *
+ * Eviction works on clusters of up to EVICT_CLUSTER frames at a time.  The
+ * anonymous pages that have to go to swap are written to one contiguous run
+ * of swap slots, and all but one of the reclaimed frames go back to the user
+ * pool, so the next few allocations need no eviction at all.
+ *
+ * The frame table also serves as the page cache for file-backed pages.
+ * Frames holding file data are indexed by inode and offset, so that a second
+ * process mapping the same page of a file maps the frame that is already in
+ * memory instead of reading its own copy.  The rare frame that caches the
+ * same page as another but with a different number of bytes from the file,
+ * because the file grew in between or an executable segment ends in that
+ * page, is chained to the first one instead of being hashed itself, so that
+ * one lookup finds every frame holding a given page.  Such a frame is
+ * written back to its file, if it was modified, only when it is evicted or
+ * when the last page mapping it goes away.  File pages can also be read into
+ * the cache ahead of any fault by frame_prefetch(); such a frame has no
+ * pages until one faults on it.
+ *
+ * Anonymous frames are shared too, after fork: parent and child map the
+ * frame read-only until one of them writes to it, and that one then gets a
+ * private copy.  A shared anonymous frame that is evicted goes to a single
+ * swap slot that all of its pages refer to.
+ *
+ * The same copy-on-write protection lets a process hand a page to the
+ * kernel without copying it: a pipe writer lends its frame, and the frame
+ * stays pinned and unchanged until the pipe has been drained of it, even if
+ * the writer writes to the page again or exits in the meantime.
+ */
+
+#include "vm/frame.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/*! Maximum number of frames reclaimed by one eviction pass. */
+#define EVICT_CLUSTER 8
+
+static struct list frame_list;          /*!< Frames in clock order. */
+static struct list_elem *clock_hand;    /*!< Next frame the clock examines. */
+static struct hash page_cache;          /*!< File frames by inode, offset. */
+static unsigned write_gen;              /*!< Counts frame_inode_write(). */
+static struct lock frame_lock;          /*!< Protects all of the above. */
+
+/* Statistics. */
+static long long evict_cnt;             /*!< # of frames reclaimed. */
+static long long cache_hit_cnt;         /*!< # of file pages found cached. */
+static long long writeback_cnt;         /*!< # of file pages written back. */
+static long long cow_cnt;               /*!< # of frames copied on write. */
+static long long prefetch_cnt;          /*!< # of file pages prefetched. */
+static long long lent_cnt;              /*!< # of frames lent to the kernel. */
+
+static hash_hash_func cache_hash;
+static hash_less_func cache_less;
+
+static struct frame *frame_create(bool may_evict);
+static void frame_setup(struct frame *, void *kpage);
+static void frame_attach(struct frame *, struct page *);
+static struct frame *cache_find(struct inode *, off_t ofs);
+static struct frame *cache_lookup(struct inode *, off_t ofs,
+                                  size_t read_bytes);
+static void cache_write(struct frame *, const void *buffer, off_t size,
+                        off_t offset);
+static void cache_insert(struct frame *, struct inode *, off_t ofs,
+                         size_t read_bytes);
+static void frame_destroy(struct frame *);
+static void frame_unmap(struct frame *);
+static void cache_remove(struct frame *);
+static void *evict(void);
+static bool frame_accessed(struct frame *);
+static struct frame *clock_advance(void);
+static void clock_remove(struct frame *);
+
+/*! Initializes the frame table. */
+void frame_init(void) {
+    list_init(&frame_list);
+    clock_hand = list_end(&frame_list);
+    if (!hash_init(&page_cache, cache_hash, cache_less, NULL))
+        PANIC("page cache creation failed");
+    lock_init(&frame_lock);
+}
+
+/*! Allocates an anonymous frame for PAGE and returns it with PAGE->frame
+    pointing to it.  If the user pool is exhausted, other pages are evicted
+    to make room if MAY_EVICT is true; otherwise the allocation fails.  The
+    frame is pinned and its contents are undefined.  Returns a null pointer
+    if no frame could be obtained. */
+struct frame * frame_alloc(struct page *page, bool may_evict) {
+    struct frame *f;
+
+    lock_acquire(&frame_lock);
+    ASSERT(page->frame == NULL);
+    f = frame_create(may_evict);
+    if (f != NULL)
+        frame_attach(f, page);
+    lock_release(&frame_lock);
+
+    return f;
+}
+
+/*! Returns a pinned frame holding the READ_BYTES bytes of INODE at offset
+    OFS followed by zeros, and attaches PAGE to it.  The frame comes from
+    the page cache if it is already there, because some other page maps
+    that part of INODE or it was prefetched; otherwise it is allocated and
+    read from INODE.  Returns a null pointer if no frame could be obtained
+    or the read fails. */
+struct frame * frame_get_file(struct page *page, struct inode *inode,
+                              off_t ofs, size_t read_bytes) {
+    struct frame *f;
+
+    ASSERT(read_bytes <= PGSIZE);
+
+    lock_acquire(&frame_lock);
+    ASSERT(page->frame == NULL);
+
+    f = cache_lookup(inode, ofs, read_bytes);
+    if (f != NULL) {
+        f->pin_cnt++;
+        cache_hit_cnt++;
+    }
+    else {
+        /* Read the page while holding the frame lock, so that nobody can
+           find the frame in the page cache before it has been filled. */
+        f = frame_create(true);
+        if (f != NULL) {
+            if (inode_read_at(inode, f->kpage, read_bytes, ofs)
+                != (off_t) read_bytes) {
+                frame_destroy(f);
+                f = NULL;
+            }
+            else {
+                cache_insert(f, inode, ofs, read_bytes);
+            }
+        }
+    }
+    if (f != NULL)
+        frame_attach(f, page);
+    lock_release(&frame_lock);
+
+    return f;
+}
+
+/*! Like frame_get_file(), but only if the frame is already in the page
+    cache; never reads INODE.  Returns a null pointer if the page is not
+    cached. */
+struct frame * frame_find_file(struct page *page, struct inode *inode,
+                               off_t ofs, size_t read_bytes) {
+    struct frame *f;
+
+    lock_acquire(&frame_lock);
+    ASSERT(page->frame == NULL);
+
+    f = cache_lookup(inode, ofs, read_bytes);
+    if (f != NULL) {
+        f->pin_cnt++;
+        cache_hit_cnt++;
+        frame_attach(f, page);
+    }
+    lock_release(&frame_lock);
+
+    return f;
+}
+
+/*! Reads the READ_BYTES bytes of INODE at offset OFS into the page cache,
+    unless they are already there, so that a later fault on a page mapping
+    them needs no I/O.  Only takes a free frame, never evicts, and reads
+    without holding the frame lock.  The frame is left unpinned and
+    unmapped, so it is the first to go if memory runs short. */
+void frame_prefetch(struct inode *inode, off_t ofs, size_t read_bytes) {
+    struct frame *f;
+    void *kpage;
+    unsigned gen;
+
+    ASSERT(read_bytes <= PGSIZE);
+
+    lock_acquire(&frame_lock);
+    f = cache_lookup(inode, ofs, read_bytes);
+    gen = write_gen;
+    lock_release(&frame_lock);
+    if (f != NULL)
+        return;
+
+    kpage = palloc_get_page(PAL_USER);
+    if (kpage == NULL)
+        return;
+    f = malloc(sizeof *f);
+    if (f == NULL ||
+        inode_read_at(inode, kpage, read_bytes, ofs) != (off_t) read_bytes) {
+        free(f);
+        palloc_free_page(kpage);
+        return;
+    }
+
+    lock_acquire(&frame_lock);
+    if (cache_lookup(inode, ofs, read_bytes) != NULL || gen != write_gen) {
+        /* Somebody faulted it in while we were reading, or a write may
+           have made what we read stale. */
+        free(f);
+        palloc_free_page(kpage);
+    }
+    else {
+        frame_setup(f, kpage);
+        f->pin_cnt = 0;
+        cache_insert(f, inode, ofs, read_bytes);
+        prefetch_cnt++;
+    }
+    lock_release(&frame_lock);
+}
+
+/*! Brings the page cache up to date with a write of SIZE bytes from BUFFER
+    to INODE at OFFSET, which the file system has just performed, so that
+    mappings and prefetched pages of INODE never show stale data.  Called by
+    inode_write_at().  Only looks up the pages the write touches. */
+void frame_inode_write(struct inode *inode, const void *buffer, off_t size,
+                       off_t offset) {
+    off_t ofs;
+
+    /* The frame table writing back one of its own frames. */
+    if (lock_held_by_current_thread(&frame_lock))
+        return;
+
+    lock_acquire(&frame_lock);
+    write_gen++;
+    for (ofs = ROUND_DOWN(offset, PGSIZE); ofs < offset + size;
+         ofs += PGSIZE) {
+        struct frame *f = cache_find(inode, ofs);
+        struct list_elem *e;
+
+        if (f == NULL)
+            continue;
+        cache_write(f, buffer, size, offset);
+        for (e = list_begin(&f->aliases); e != list_end(&f->aliases);
+             e = list_next(e))
+            cache_write(list_entry(e, struct frame, alias_elem),
+                        buffer, size, offset);
+    }
+    lock_release(&frame_lock);
+}
+
+/*! Unmaps PAGE and detaches it from its frame, if it has one.  The frame is
+    released once no page maps it any more; a file frame is first written
+    back if any page modified it. */
+void frame_free(struct page *page) {
+    struct frame *f;
+
+    lock_acquire(&frame_lock);
+    f = page->frame;
+    if (f != NULL) {
+        if (pagedir_is_dirty(page->pagedir, page->upage))
+            f->dirty = true;
+        pagedir_clear_page(page->pagedir, page->upage);
+        list_remove(&page->frame_elem);
+        page->frame = NULL;
+        if (list_empty(&f->pages) && f->lend_cnt == 0)
+            frame_destroy(f);
+    }
+    lock_release(&frame_lock);
+}
+
+/*! Makes DST, a new anonymous page of another process, share the contents
+    of anonymous page SRC.  If SRC is resident, both pages are mapped to its
+    frame read-only, so that the first write to either one makes a copy; see
+    frame_cow().  DST also shares SRC's swap slot, if it has one.  Returns
+    false if memory allocation fails. */
+bool frame_share(struct page *src, struct page *dst) {
+    struct frame *f;
+    bool success = true;
+
+    lock_acquire(&frame_lock);
+    ASSERT(src->type == PAGE_ANON && dst->type == PAGE_ANON);
+    ASSERT(dst->frame == NULL && dst->swap_slot == SWAP_ERROR);
+
+    if (src->swap_slot != SWAP_ERROR) {
+        swap_dup(src->swap_slot);
+        dst->swap_slot = src->swap_slot;
+    }
+
+    f = src->frame;
+    if (f != NULL) {
+        if (pagedir_set_page(dst->pagedir, dst->upage, f->kpage, false)) {
+            pagedir_set_writable(src->pagedir, src->upage, false);
+            frame_attach(f, dst);
+        }
+        else {
+            success = false;
+        }
+    }
+    lock_release(&frame_lock);
+
+    return success;
+}
+
+/*! Handles a write to resident anonymous page P, which is mapped read-only
+    because its frame is or was shared with other processes.  If P is still
+    sharing the frame, it gets a private copy; otherwise it just becomes
+    writable again.  Returns false if no frame could be obtained for the
+    copy.  If P was evicted in the meantime, does nothing, since retrying
+    the write then faults the page back in.
+
+    If PIN is true, P's frame, private now, is also pinned, as by
+    frame_pin_page(); then P must not have been evicted, or false is
+    returned. */
+bool frame_cow(struct page *p, bool pin) {
+    struct frame *f, *copy;
+    bool success = true;
+
+    lock_acquire(&frame_lock);
+    ASSERT(p->type == PAGE_ANON && p->writable);
+
+    f = p->frame;
+    if (f == NULL && pin) {
+        success = false;
+    }
+    else if (f != NULL) {
+        if (list_size(&f->pages) == 1 && f->lend_cnt == 0) {
+            pagedir_set_writable(p->pagedir, p->upage, true);
+            if (pin)
+                f->pin_cnt++;
+        }
+        else {
+            /* Keep the original from being evicted while we copy it. */
+            f->pin_cnt++;
+            copy = frame_create(true);
+            f->pin_cnt--;
+
+            if (copy != NULL) {
+                memcpy(copy->kpage, f->kpage, PGSIZE);
+                pagedir_clear_page(p->pagedir, p->upage);
+                list_remove(&p->frame_elem);
+                p->frame = NULL;
+                frame_attach(copy, p);
+                pagedir_set_page(p->pagedir, p->upage, copy->kpage, true);
+
+                /* The copy matches no swap slot of its own. */
+                copy->dirty = true;
+                if (!pin)
+                    copy->pin_cnt--;
+                cow_cnt++;
+            }
+            else {
+                success = false;
+            }
+        }
+    }
+    lock_release(&frame_lock);
+
+    return success;
+}
+
+/*! Lends the frame holding resident anonymous page P to the kernel, which
+    may read it through its KPAGE until it calls frame_return().  The frame
+    is pinned for that long and P is mapped read-only, so that a write to P
+    gets a copy, as with a frame shared after fork, and the lent frame does
+    not change.  Returns the frame, or a null pointer if P is not
+    resident. */
+struct frame * frame_lend(struct page *p) {
+    struct frame *f;
+
+    lock_acquire(&frame_lock);
+    ASSERT(p->type == PAGE_ANON);
+
+    f = p->frame;
+    if (f != NULL) {
+        f->pin_cnt++;
+        f->lend_cnt++;
+        pagedir_set_writable(p->pagedir, p->upage, false);
+        lent_cnt++;
+    }
+    lock_release(&frame_lock);
+
+    return f;
+}
+
+/*! Gives back frame F, which frame_lend() returned, releasing it if no page
+    maps it any more. */
+void frame_return(struct frame *f) {
+    lock_acquire(&frame_lock);
+    ASSERT(f->lend_cnt > 0 && f->pin_cnt > 0);
+    f->pin_cnt--;
+    if (--f->lend_cnt == 0 && list_empty(&f->pages))
+        frame_destroy(f);
+    lock_release(&frame_lock);
+}
+
+/*! Pins frame F, protecting it from eviction. */
+void frame_pin(struct frame *f) {
+    lock_acquire(&frame_lock);
+    f->pin_cnt++;
+    lock_release(&frame_lock);
+}
+
+/*! Pins the frame holding page P and returns it, or returns a null pointer
+    if P is not resident. */
+struct frame * frame_pin_page(struct page *p) {
+    struct frame *f;
+
+    lock_acquire(&frame_lock);
+    f = p->frame;
+    if (f != NULL)
+        f->pin_cnt++;
+    lock_release(&frame_lock);
+
+    return f;
+}
+
+/*! Undoes one frame_pin() of F, or the pin on a newly obtained frame. */
+void frame_unpin(struct frame *f) {
+    lock_acquire(&frame_lock);
+    ASSERT(f->pin_cnt > 0);
+    f->pin_cnt--;
+    lock_release(&frame_lock);
+}
+
+/*! Prints frame table statistics. */
+void frame_print_stats(void) {
+    printf("Frames: %lld evicted, %lld page cache hits, "
+           "%lld written back, %lld copied on write, %lld prefetched, "
+           "%lld lent\n",
+           evict_cnt, cache_hit_cnt, writeback_cnt, cow_cnt, prefetch_cnt,
+           lent_cnt);
+}
+
+/*! Returns a new pinned frame with no pages, or a null pointer if that
+    fails.  If the user pool is exhausted, evicts other pages to make room
+    if MAY_EVICT is true.  The frame lock must be held. */
+static struct frame * frame_create(bool may_evict) {
+    struct frame *f = malloc(sizeof *f);
+    void *kpage;
+
+    if (f == NULL)
+        return NULL;
+
+    kpage = palloc_get_page(PAL_USER);
+    if (kpage == NULL && may_evict)
+        kpage = evict();
+    if (kpage == NULL) {
+        free(f);
+        return NULL;
+    }
+
+    frame_setup(f, kpage);
+    return f;
+}
+
+/*! Initializes F as a pinned anonymous frame for KPAGE with no pages and
+    puts it on the clock list.  The frame lock must be held. */
+static void frame_setup(struct frame *f, void *kpage) {
+    f->kpage = kpage;
+    list_init(&f->pages);
+    f->pin_cnt = 1;
+    f->dirty = false;
+    f->lend_cnt = 0;
+    f->inode = NULL;
+    list_push_back(&frame_list, &f->elem);
+}
+
+/*! Adds PAGE, which has no frame, to the pages mapping F.  The frame lock
+    must be held. */
+static void frame_attach(struct frame *f, struct page *page) {
+    ASSERT(page->frame == NULL);
+    list_push_back(&f->pages, &page->frame_elem);
+    page->frame = f;
+}
+
+/*! Releases frame F, which no page maps, writing it back to its file first
+    if it is a modified file frame.  The frame lock must be held. */
+static void frame_destroy(struct frame *f) {
+    ASSERT(list_empty(&f->pages));
+
+    if (f->inode != NULL)
+        cache_remove(f);
+    clock_remove(f);
+    palloc_free_page(f->kpage);
+    free(f);
+}
+
+/*! Clears every mapping of frame F, folding the pages' dirty bits into
+    F->dirty.  The pages stay on F's list. */
+static void frame_unmap(struct frame *f) {
+    struct list_elem *e;
+
+    for (e = list_begin(&f->pages); e != list_end(&f->pages);
+         e = list_next(e)) {
+        struct page *p = list_entry(e, struct page, frame_elem);
+        if (pagedir_is_dirty(p->pagedir, p->upage))
+            f->dirty = true;
+        pagedir_clear_page(p->pagedir, p->upage);
+    }
+}
+
+/*! Reclaims up to EVICT_CLUSTER frames and returns the kernel virtual address
+    of one of them, giving the rest back to the user pool.  Returns a null
+    pointer if every frame is pinned.  The frame lock must be held. */
+static void * evict(void) {
+    struct frame *victims[EVICT_CLUSTER];
+    struct frame *to_swap[EVICT_CLUSTER];
+    size_t victim_cnt = 0, swap_cnt = 0;
+    size_t steps, i;
+    void *kpage;
+
+    ASSERT(lock_held_by_current_thread(&frame_lock));
+
+    /* Sweep the clock.  A frame that was accessed since the last sweep gets
+       a second chance; two full revolutions are enough to find an unpinned
+       victim if there is one. */
+    for (steps = 2 * list_size(&frame_list);
+         steps > 0 && victim_cnt < EVICT_CLUSTER; steps--) {
+        struct frame *f = clock_advance();
+
+        if (f->pin_cnt > 0 || frame_accessed(f))
+            continue;
+
+        /* Unmap the victim right away so that nobody can modify it while
+           we write it out. */
+        clock_remove(f);
+        frame_unmap(f);
+        victims[victim_cnt++] = f;
+        if (f->inode == NULL && f->dirty)
+            to_swap[swap_cnt++] = f;
+    }
+    if (victim_cnt == 0)
+        return NULL;
+
+    /* Write the anonymous victims out to as few runs of swap slots as
+       possible, normally just one. */
+    for (i = 0; i < swap_cnt; ) {
+        size_t got, slot, j;
+
+        slot = swap_alloc(swap_cnt - i, &got);
+        if (slot == SWAP_ERROR)
+            PANIC("out of swap space");
+        for (j = 0; j < got; j++) {
+            struct frame *f = to_swap[i + j];
+            struct list_elem *e;
+
+            /* Every page sharing the frame shares the slot. */
+            swap_write(slot + j, f->kpage);
+            for (e = list_begin(&f->pages); e != list_end(&f->pages);
+                 e = list_next(e)) {
+                if (e != list_begin(&f->pages))
+                    swap_dup(slot + j);
+                page_set_swap(list_entry(e, struct page, frame_elem),
+                              slot + j);
+            }
+        }
+        i += got;
+    }
+
+    /* Detach the pages and release the frames, keeping the first frame's
+       memory for the caller.  Modified file frames go back to their files
+       here. */
+    kpage = victims[0]->kpage;
+    for (i = 0; i < victim_cnt; i++) {
+        struct frame *f = victims[i];
+
+        while (!list_empty(&f->pages)) {
+            struct list_elem *e = list_pop_front(&f->pages);
+            list_entry(e, struct page, frame_elem)->frame = NULL;
+        }
+        if (f->inode != NULL)
+            cache_remove(f);
+        if (i > 0)
+            palloc_free_page(f->kpage);
+        free(f);
+    }
+    evict_cnt += victim_cnt;
+    return kpage;
+}
+
+/*! Returns the frame in the page cache's hash table for the page of INODE
+    at offset OFS, whose ALIASES hold any other frames for that page, or a
+    null pointer if the page is not cached.  The frame lock must be
+    held. */
+static struct frame * cache_find(struct inode *inode, off_t ofs) {
+    struct frame key;
+    struct hash_elem *e;
+
+    key.inode = inode;
+    key.ofs = ofs;
+    e = hash_find(&page_cache, &key.cache_elem);
+    return e != NULL ? hash_entry(e, struct frame, cache_elem) : NULL;
+}
+
+/*! Returns the frame caching the READ_BYTES bytes of INODE at offset OFS,
+    or a null pointer if there is none.  The frame lock must be held. */
+static struct frame * cache_lookup(struct inode *inode, off_t ofs,
+                                   size_t read_bytes) {
+    struct frame *f = cache_find(inode, ofs);
+    struct list_elem *e;
+
+    if (f == NULL || f->read_bytes == read_bytes)
+        return f;
+    for (e = list_begin(&f->aliases); e != list_end(&f->aliases);
+         e = list_next(e)) {
+        struct frame *alias = list_entry(e, struct frame, alias_elem);
+        if (alias->read_bytes == read_bytes)
+            return alias;
+    }
+    return NULL;
+}
+
+/*! Copies the part of a write of SIZE bytes from BUFFER at OFFSET in F's
+    inode that falls within F's file data into F. */
+static void cache_write(struct frame *f, const void *buffer, off_t size,
+                        off_t offset) {
+    off_t start, end;
+
+    start = offset > f->ofs ? offset : f->ofs;
+    end = offset + size;
+    if (end > f->ofs + (off_t) f->read_bytes)
+        end = f->ofs + f->read_bytes;
+    if (start < end)
+        memcpy((uint8_t *) f->kpage + (start - f->ofs),
+               (const uint8_t *) buffer + (start - offset), end - start);
+}
+
+/*! Makes anonymous frame F, which has just been filled in, the page cache's
+    copy of the READ_BYTES bytes of INODE at offset OFS followed by zeros.
+    The frame lock must be held. */
+static void cache_insert(struct frame *f, struct inode *inode, off_t ofs,
+                         size_t read_bytes) {
+    struct hash_elem *e;
+
+    ASSERT(ofs % PGSIZE == 0);
+
+    memset((uint8_t *) f->kpage + read_bytes, 0, PGSIZE - read_bytes);
+    f->inode = inode_reopen(inode);
+    f->ofs = ofs;
+    f->read_bytes = read_bytes;
+    list_init(&f->aliases);
+    e = hash_insert(&page_cache, &f->cache_elem);
+    if (e != NULL)
+        list_push_back(&hash_entry(e, struct frame, cache_elem)->aliases,
+                       &f->alias_elem);
+}
+
+/*! Writes file frame F back to its inode if it was modified and drops it
+    from the page cache.  The frame lock must be held. */
+static void cache_remove(struct frame *f) {
+    if (f->dirty) {
+        inode_write_at(f->inode, f->kpage, f->read_bytes, f->ofs);
+        writeback_cnt++;
+    }
+    if (cache_find(f->inode, f->ofs) != f) {
+        list_remove(&f->alias_elem);
+    }
+    else {
+        /* Hand the page's other frames to the first of them. */
+        hash_delete(&page_cache, &f->cache_elem);
+        if (!list_empty(&f->aliases)) {
+            struct frame *next = list_entry(list_pop_front(&f->aliases),
+                                            struct frame, alias_elem);
+            while (!list_empty(&f->aliases))
+                list_push_back(&next->aliases, list_pop_front(&f->aliases));
+            hash_insert(&page_cache, &next->cache_elem);
+        }
+    }
+    inode_close(f->inode);
+}
+
+/*! Returns true if any page mapping F was accessed since the last call,
+    clearing the pages' accessed bits. */
+static bool frame_accessed(struct frame *f) {
+    struct list_elem *e;
+    bool accessed = false;
+
+    for (e = list_begin(&f->pages); e != list_end(&f->pages);
+         e = list_next(e)) {
+        struct page *p = list_entry(e, struct page, frame_elem);
+        if (pagedir_is_accessed(p->pagedir, p->upage)) {
+            pagedir_set_accessed(p->pagedir, p->upage, false);
+            accessed = true;
+        }
+    }
+    return accessed;
+}
+
+/*! Returns the frame under the clock hand and advances the hand, wrapping
+    around at the end of the list.  The frame list must not be empty. */
+static struct frame * clock_advance(void) {
+    struct frame *f;
+
+    ASSERT(!list_empty(&frame_list));
+    if (clock_hand == list_end(&frame_list))
+        clock_hand = list_begin(&frame_list);
+    f = list_entry(clock_hand, struct frame, elem);
+    clock_hand = list_next(clock_hand);
+    return f;
+}
+
+/*! Removes F from the clock list, keeping the clock hand valid. */
+static void clock_remove(struct frame *f) {
+    if (clock_hand == &f->elem)
+        clock_hand = list_next(clock_hand);
+    list_remove(&f->elem);
+}
+
+/*! Returns a hash value for the file frame containing E. */
+static unsigned cache_hash(const struct hash_elem *e, void *aux UNUSED) {
+    const struct frame *f = hash_entry(e, struct frame, cache_elem);
+    return hash_bytes(&f->inode, sizeof f->inode) ^ hash_int(f->ofs);
+}
+
+/*! Returns true if file frame A precedes file frame B. */
+static bool cache_less(const struct hash_elem *a, const struct hash_elem *b,
+                       void *aux UNUSED) {
+    const struct frame *fa = hash_entry(a, struct frame, cache_elem);
+    const struct frame *fb = hash_entry(b, struct frame, cache_elem);
+
+    if (fa->inode != fb->inode)
+        return fa->inode < fb->inode;
+    return fa->ofs < fb->ofs;
+}
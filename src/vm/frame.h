@@ -0,0 +1,65 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct inode;
+struct page;
+
+/*! A frame of physical memory from the user pool.
+
+    An anonymous frame holds a page of a single process, or of a process
+    and the children it forked, until one of them writes to it.  A file
+    frame caches one page of an inode and sits in the page cache, so every
+    process that maps that part of the file shares it; the pages mapping a
+    frame are kept on its PAGES list.
+
+    Frames are allocated pinned, so that they can be filled in before they
+    become candidates for eviction.  Unpinned frames sit on the clock list
+    in the order they were allocated.
+
+    A frame can also be lent to the kernel, which reads it through KPAGE
+    while the pages mapping it are write-protected; see frame_lend(). */
+struct frame {
+    void *kpage;                /*!< Kernel virtual address of the frame. */
+    struct list pages;          /*!< Pages mapping the frame. */
+    int pin_cnt;                /*!< Never evicted while nonzero. */
+    bool dirty;                 /*!< Written through a page since loaded. */
+    int lend_cnt;               /*!< Outstanding frame_lend() references. */
+
+    /*! File frames only. @{ */
+    struct inode *inode;        /*!< Backing inode, or NULL if anonymous. */
+    off_t ofs;                  /*!< Offset of the page within INODE. */
+    size_t read_bytes;          /*!< Bytes backed by INODE; rest is zeros. */
+    struct hash_elem cache_elem; /*!< Element in the page cache. */
+    struct list aliases;        /*!< Same page, other READ_BYTES. */
+    struct list_elem alias_elem; /*!< Element in another frame's ALIASES. */
+    /*! @} */
+
+    struct list_elem elem;      /*!< Element in the clock list. */
+};
+
+void frame_init(void);
+struct frame *frame_alloc(struct page *, bool may_evict);
+struct frame *frame_get_file(struct page *, struct inode *, off_t ofs,
+                             size_t read_bytes);
+struct frame *frame_find_file(struct page *, struct inode *, off_t ofs,
+                              size_t read_bytes);
+void frame_prefetch(struct inode *, off_t ofs, size_t read_bytes);
+void frame_inode_write(struct inode *, const void *buffer, off_t size,
+                       off_t offset);
+void frame_free(struct page *);
+bool frame_share(struct page *src, struct page *dst);
+bool frame_cow(struct page *, bool pin);
+struct frame *frame_lend(struct page *);
+void frame_return(struct frame *);
+void frame_pin(struct frame *);
+struct frame *frame_pin_page(struct page *);
+void frame_unpin(struct frame *);
+void frame_print_stats(void);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,178 @@
+/*! \file mmap.c
+ *
+ * Memory-mapped files.  A mapping is nothing more than a run of file pages
+ * in the supplemental page table; they are read in lazily by the page fault
+ * handler and come from the page cache in the frame table, so processes
+ * mapping the same file share its frames instead of each holding a copy.
+ * Modified pages reach the file when they are evicted or when the last page
+ * mapping them goes away.
+ */
+
+#include "vm/mmap.h"
+#include <debug.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+
+static struct mapping *mapping_create(struct file *, void *base);
+static struct mapping *mapping_lookup(mapid_t);
+static void mapping_release(struct mapping *, size_t page_cnt);
+
+/*! Maps the whole of FILE into the current process's address space starting
+    at ADDR.  The mapping uses its own handle on FILE, so it survives the
+    caller closing FILE.  Returns the new mapping's identifier, or MAP_FAILED
+    if FILE is empty or cannot be written, as a running executable cannot,
+    ADDR is not page-aligned, the region would overlap any page already in
+    use or extend beyond user space, or memory allocation fails.
+
+    A mapping is always writable, and its pages share the page cache's
+    frames.  Those may be the text of processes running FILE, which must
+    not change under them. */
+mapid_t mmap_map(struct file *file, void *addr) {
+    struct thread *t = process_current();
+    struct mapping *m;
+    off_t length = file_length(file);
+    mapid_t id = MAP_FAILED;
+    size_t i;
+
+    if (addr == NULL || pg_ofs(addr) != 0 || length == 0)
+        return MAP_FAILED;
+    if (inode_is_write_denied(file_get_inode(file)))
+        return MAP_FAILED;
+    if (!is_user_vaddr((uint8_t *) addr + length - 1) ||
+        (uint8_t *) addr + length < (uint8_t *) addr)
+        return MAP_FAILED;
+
+    page_table_lock();
+    for (i = 0; i < (size_t) length; i += PGSIZE)
+        if (page_lookup((uint8_t *) addr + i) != NULL ||
+            pagedir_get_page(t->pagedir, (uint8_t *) addr + i) != NULL)
+            goto done;
+
+    m = mapping_create(file, addr);
+    if (m != NULL) {
+        id = m->id = t->next_mapid++;
+        list_push_back(&t->mappings, &m->elem);
+    }
+
+done:
+    page_table_unlock();
+    return id;
+}
+
+/*! Gives the current process, which has just been forked from PARENT, the
+    same mappings as PARENT, under the same identifiers.  The files are
+    mapped shared, so the two processes see each other's writes.  Returns
+    false if memory allocation fails.  PARENT's page table lock must be
+    held. */
+bool mmap_dup(struct thread *parent) {
+    struct thread *t = thread_current();
+    struct list_elem *e;
+
+    for (e = list_begin(&parent->mappings); e != list_end(&parent->mappings);
+         e = list_next(e)) {
+        struct mapping *pm = list_entry(e, struct mapping, elem);
+        struct mapping *m = mapping_create(pm->file, pm->base);
+
+        if (m == NULL)
+            return false;
+        m->id = pm->id;
+        list_push_back(&t->mappings, &m->elem);
+    }
+    t->next_mapid = parent->next_mapid;
+    return true;
+}
+
+/*! Unmaps the current process's mapping ID, writing back the pages no other
+    process still maps.  Does nothing if there is no such mapping. */
+void mmap_unmap(mapid_t id) {
+    struct mapping *m;
+
+    page_table_lock();
+    m = mapping_lookup(id);
+    if (m != NULL) {
+        list_remove(&m->elem);
+        mapping_release(m, m->page_cnt);
+    }
+    page_table_unlock();
+}
+
+/*! Unmaps every mapping of the current process.  Called on process exit,
+    before its supplemental page table is destroyed. */
+void mmap_unmap_all(void) {
+    struct thread *t = process_current();
+
+    page_table_lock();
+    while (!list_empty(&t->mappings)) {
+        struct list_elem *e = list_pop_front(&t->mappings);
+        struct mapping *m = list_entry(e, struct mapping, elem);
+        mapping_release(m, m->page_cnt);
+    }
+    page_table_unlock();
+}
+
+/*! Maps all of FILE at BASE in the current process, through a new handle on
+    FILE, and returns the new mapping without an identifier.  Returns a null
+    pointer if memory allocation fails. */
+static struct mapping * mapping_create(struct file *file, void *base) {
+    struct mapping *m = malloc(sizeof *m);
+    off_t length = file_length(file);
+    size_t i;
+
+    if (m == NULL)
+        return NULL;
+    m->file = file_reopen(file);
+    if (m->file == NULL) {
+        free(m);
+        return NULL;
+    }
+    m->base = base;
+    m->page_cnt = DIV_ROUND_UP(length, PGSIZE);
+
+    for (i = 0; i < m->page_cnt; i++) {
+        off_t ofs = i * PGSIZE;
+        size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+        if (page_create_file((uint8_t *) base + ofs, true, m->file, ofs,
+                             read_bytes) == NULL) {
+            mapping_release(m, i);
+            return NULL;
+        }
+    }
+    return m;
+}
+
+/*! Returns the current process's mapping with identifier ID, or a null
+    pointer if there is none. */
+static struct mapping * mapping_lookup(mapid_t id) {
+    struct thread *t = process_current();
+    struct list_elem *e;
+
+    for (e = list_begin(&t->mappings); e != list_end(&t->mappings);
+         e = list_next(e)) {
+        struct mapping *m = list_entry(e, struct mapping, elem);
+        if (m->id == id)
+            return m;
+    }
+    return NULL;
+}
+
+/*! Removes the first PAGE_CNT pages of mapping M, then closes its file and
+    frees it.  M must not be on the mapping list. */
+static void mapping_release(struct mapping *m, size_t page_cnt) {
+    size_t i;
+
+    for (i = 0; i < page_cnt; i++) {
+        struct page *p = page_lookup((uint8_t *) m->base + i * PGSIZE);
+        ASSERT(p != NULL && p->type == PAGE_FILE);
+        page_remove(p);
+    }
+    file_close(m->file);
+    free(m);
+}
@@ -0,0 +1,398 @@
+/*! \file page.c
+ *
+ * Supplemental page table.  Records, for each user page of a process, where
+ * its contents live when it is not in a frame, so that the page fault
+ * handler can bring it back after the frame table has evicted it.
+ *
+ * Anonymous pages come back from swap.  File pages come back through the
+ * page cache in the frame table, which hands every process mapping the same
+ * part of a file the same frame.
+ *
+ * The threads of a process share its table.  Whoever looks a page up, or
+ * adds or removes pages, while other threads might be running must hold
+ * the table's lock (see page_table_lock()) until done with the page; the
+ * page fault handlers take it themselves.
+ */
+
+#include "vm/page.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/frame.h"
+#include "vm/prefetch.h"
+#include "vm/swap.h"
+
+/*! Number of pages in the aligned window around a faulting page that the
+    fault handler maps along with it, if that is cheap.  Values below 2
+    disable fault-around and read-ahead.  Set with the "-fault-around" kernel
+    command-line option. */
+size_t page_fault_around = 16;
+
+/* Statistics. */
+static long long fault_around_cnt;      /*!< # of pages mapped around faults. */
+static long long read_ahead_cnt;        /*!< # of pages queued to prefetch. */
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destroy;
+static bool page_map(struct page *, struct frame *, bool pin);
+static void fault_around(struct page *);
+static void read_ahead(struct page *);
+static struct page *page_insert(void *upage, bool writable,
+                                enum page_type);
+
+/*! Initializes supplemental page table PAGES.  Returns false if memory
+    allocation fails. */
+bool page_table_init(struct hash *pages) {
+    return hash_init(pages, page_hash, page_less, NULL);
+}
+
+/*! Destroys supplemental page table PAGES, releasing the frames and swap
+    slots held by its pages. */
+void page_table_destroy(struct hash *pages) {
+    hash_destroy(pages, page_destroy);
+}
+
+/*! Locks the current process's supplemental page table against its other
+    threads. */
+void page_table_lock(void) {
+    lock_acquire(&process_current()->pages_lock);
+}
+
+/*! Unlocks the current process's supplemental page table. */
+void page_table_unlock(void) {
+    lock_release(&process_current()->pages_lock);
+}
+
+/*! Adds a page at user virtual address UPAGE to the current process's
+    supplemental page table.  The page is not resident and reads as zeros
+    until written.  Returns the new page, or a null pointer if UPAGE is
+    already in use or memory allocation fails. */
+struct page * page_create(void *upage, bool writable) {
+    return page_insert(upage, writable, PAGE_ANON);
+}
+
+/*! Adds a page at user virtual address UPAGE to the current process's
+    supplemental page table that maps READ_BYTES bytes of FILE starting at
+    offset OFS, followed by zeros.  Writes to the page go back to FILE.  The
+    page is not resident.  FILE must stay open for as long as the page
+    exists.  Returns the new page, or a null pointer if UPAGE is already in
+    use or memory allocation fails. */
+struct page * page_create_file(void *upage, bool writable, struct file *file,
+                               off_t ofs, size_t read_bytes) {
+    struct page *p;
+
+    ASSERT(read_bytes <= PGSIZE);
+
+    p = page_insert(upage, writable, PAGE_FILE);
+    if (p != NULL) {
+        p->file = file;
+        p->file_ofs = ofs;
+        p->read_bytes = read_bytes;
+    }
+    return p;
+}
+
+/*! Removes page P from the current process's supplemental page table and
+    frees it, releasing its frame and swap slot.  A modified file page is
+    written back to its file once no other process maps it. */
+void page_remove(struct page *p) {
+    hash_delete(&process_current()->pages, &p->hash_elem);
+    page_destroy(&p->hash_elem, NULL);
+}
+
+/*! Returns the current process's page containing user virtual address ADDR,
+    or a null pointer if there is none. */
+struct page * page_lookup(const void *addr) {
+    struct thread *t = process_current();
+    struct page key;
+    struct hash_elem *e;
+
+    if (t->pagedir == NULL || !is_user_vaddr(addr))
+        return NULL;
+
+    key.upage = pg_round_down(addr);
+    e = hash_find(&t->pages, &key.hash_elem);
+    return e != NULL ? hash_entry(e, struct page, hash_elem) : NULL;
+}
+
+/*! Brings page P, which must not be resident, into a frame and maps it.  If
+    PIN is true, the frame stays pinned until page_unpin() is called.
+    Returns false if no frame could be obtained. */
+bool page_in(struct page *p, bool pin) {
+    struct frame *f;
+
+    if (p->type == PAGE_FILE) {
+        f = frame_get_file(p, file_get_inode(p->file), p->file_ofs,
+                           p->read_bytes);
+        if (f == NULL)
+            return false;
+    }
+    else {
+        f = frame_alloc(p, true);
+        if (f == NULL)
+            return false;
+
+        if (p->swap_slot != SWAP_ERROR)
+            swap_read(p->swap_slot, f->kpage);
+        else
+            memset(f->kpage, 0, PGSIZE);
+    }
+
+    return page_map(p, f, pin);
+}
+
+/*! Copies the supplemental page table of PARENT, which must not be running,
+    into the current process, which has just been forked from it.  Anonymous
+    pages are shared copy-on-write and executable text is remapped from the
+    current process's own handle on the executable.  Pages belonging to
+    memory-mapped files are left to mmap_dup().  Returns false if memory
+    allocation fails. */
+bool page_table_dup(struct thread *parent) {
+    struct thread *t = thread_current();
+    struct hash_iterator i;
+
+    hash_first(&i, &parent->pages);
+    while (hash_next(&i)) {
+        struct page *pp = hash_entry(hash_cur(&i), struct page, hash_elem);
+        struct page *p;
+
+        if (pp->type == PAGE_FILE) {
+            if (pp->file != parent->exec_file)
+                continue;
+            p = page_create_file(pp->upage, pp->writable, t->exec_file,
+                                 pp->file_ofs, pp->read_bytes);
+            if (p == NULL)
+                return false;
+        }
+        else {
+            p = page_insert(pp->upage, pp->writable, PAGE_ANON);
+            if (p == NULL || !frame_share(pp, p))
+                return false;
+        }
+    }
+    return true;
+}
+
+/*! Handles a write fault on a present page at FAULT_ADDR in the current
+    process, which is how a write to a copy-on-write page shows up.  Returns
+    false if the page is not one the process may write.  Takes the page
+    table lock. */
+bool page_write_fault(const void *fault_addr) {
+    struct page *p;
+    bool success = false;
+
+    page_table_lock();
+    p = page_lookup(fault_addr);
+    if (p != NULL && p->writable && p->type == PAGE_ANON)
+        success = frame_cow(p, false);
+    page_table_unlock();
+    return success;
+}
+
+/*! Brings page P in, if it is not resident, and pins its frame, which is
+    returned for a later frame_unpin().  Returns a null pointer if no frame
+    could be obtained. */
+struct frame * page_pin(struct page *p) {
+    struct frame *f = frame_pin_page(p);
+
+    if (f == NULL && page_in(p, true))
+        f = p->frame;
+    return f;
+}
+
+/*! Unpins resident page P. */
+void page_unpin(struct page *p) {
+    ASSERT(p->frame != NULL);
+    frame_unpin(p->frame);
+}
+
+/*! Handles a not-present page fault at FAULT_ADDR in the current process by
+    bringing in the page there, unless another thread of the process has
+    already done so.  Returns false if the address is not part of the
+    process's address space or the page could not be loaded.  Takes the
+    page table lock.
+
+    Also maps the neighbours of the page that can be had cheaply, and if the
+    process has been faulting its way forward through memory, starts reading
+    the file pages ahead of it in the background. */
+bool page_fault_in(const void *fault_addr) {
+    struct thread *t = process_current();
+    struct page *p;
+    uint8_t *last;
+
+    page_table_lock();
+    last = t->last_fault;
+    p = page_lookup(fault_addr);
+    if (p == NULL || (p->frame == NULL && !page_in(p, false))) {
+        page_table_unlock();
+        return false;
+    }
+
+    if (page_fault_around > 1) {
+        fault_around(p);
+
+        /* With fault-around, a process walking forward faults about once
+           per window. */
+        if ((uint8_t *) p->upage > last &&
+            (uint8_t *) p->upage <= last + page_fault_around * PGSIZE)
+            t->fault_run++;
+        else
+            t->fault_run = 0;
+        t->last_fault = p->upage;
+
+        if (t->fault_run > 0)
+            read_ahead(p);
+    }
+    page_table_unlock();
+    return true;
+}
+
+/*! Prints paging statistics. */
+void page_print_stats(void) {
+    printf("Paging: %lld pages mapped around faults, %lld read ahead\n",
+           fault_around_cnt, read_ahead_cnt);
+}
+
+/*! Records that evicted anonymous page P now lives in swap slot SLOT,
+    releasing the stale slot it held, if any.  Called by the frame table with
+    the frame lock held, after writing the page out. */
+void page_set_swap(struct page *p, size_t slot) {
+    ASSERT(p->type == PAGE_ANON && p->frame != NULL);
+
+    if (p->swap_slot != SWAP_ERROR)
+        swap_free(p->swap_slot);
+    p->swap_slot = slot;
+}
+
+/*! Maps page P to frame F, which was just obtained pinned for it, and
+    unpins F unless PIN is true.  Returns false if memory allocation fails,
+    releasing F. */
+static bool page_map(struct page *p, struct frame *f, bool pin) {
+    if (!pagedir_set_page(p->pagedir, p->upage, f->kpage, p->writable)) {
+        frame_unpin(f);
+        frame_free(p);
+        return false;
+    }
+
+    if (!pin)
+        frame_unpin(f);
+    return true;
+}
+
+/*! Returns the first page of the fault-around window containing UPAGE. */
+static uintptr_t window_start(const void *upage) {
+    uintptr_t pg = pg_no(upage);
+    return pg - pg % page_fault_around;
+}
+
+/*! Maps the non-resident pages in the fault-around window of P, which has
+    just been faulted in, that need no eviction and little or no I/O: file
+    pages that are already in the page cache, and anonymous pages that were
+    swapped out in the same run as P and so sit next to it on disk. */
+static void fault_around(struct page *p) {
+    uintptr_t first = window_start(p->upage);
+    uintptr_t pg;
+
+    for (pg = first; pg < first + page_fault_around; pg++) {
+        struct page *q = page_lookup((void *) (pg << PGBITS));
+        struct frame *f;
+
+        if (q == NULL || q->frame != NULL)
+            continue;
+
+        if (q->type == PAGE_FILE) {
+            f = frame_find_file(q, file_get_inode(q->file), q->file_ofs,
+                                q->read_bytes);
+        }
+        else if (p->type == PAGE_ANON && p->swap_slot != SWAP_ERROR &&
+                 q->swap_slot != SWAP_ERROR &&
+                 q->swap_slot - p->swap_slot == pg - pg_no(p->upage)) {
+            f = frame_alloc(q, false);
+            if (f != NULL)
+                swap_read(q->swap_slot, f->kpage);
+        }
+        else {
+            continue;
+        }
+
+        if (f != NULL && page_map(q, f, false))
+            fault_around_cnt++;
+    }
+}
+
+/*! Queues the file pages in the fault-around window after P's for reading
+    into the page cache. */
+static void read_ahead(struct page *p) {
+    uintptr_t first = window_start(p->upage) + page_fault_around;
+    uintptr_t pg;
+
+    for (pg = first; pg < first + page_fault_around; pg++) {
+        struct page *q = page_lookup((void *) (pg << PGBITS));
+
+        if (q != NULL && q->type == PAGE_FILE && q->frame == NULL) {
+            prefetch_file(file_get_inode(q->file), q->file_ofs,
+                          q->read_bytes);
+            read_ahead_cnt++;
+        }
+    }
+}
+
+/*! Adds a non-resident page of the given TYPE at UPAGE to the current
+    process's supplemental page table.  Returns the new page, or a null
+    pointer if UPAGE is already in use or memory allocation fails. */
+static struct page * page_insert(void *upage, bool writable,
+                                 enum page_type type) {
+    struct thread *t = process_current();
+    struct page *p;
+
+    ASSERT(pg_ofs(upage) == 0);
+    ASSERT(is_user_vaddr(upage));
+
+    p = malloc(sizeof *p);
+    if (p == NULL)
+        return NULL;
+
+    p->upage = upage;
+    p->pagedir = t->pagedir;
+    p->writable = writable;
+    p->type = type;
+    p->frame = NULL;
+    p->swap_slot = SWAP_ERROR;
+    p->file = NULL;
+    if (hash_insert(&t->pages, &p->hash_elem) != NULL) {
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+/*! Returns a hash value for the page containing E. */
+static unsigned page_hash(const struct hash_elem *e, void *aux UNUSED) {
+    const struct page *p = hash_entry(e, struct page, hash_elem);
+    return hash_bytes(&p->upage, sizeof p->upage);
+}
+
+/*! Returns true if page A precedes page B. */
+static bool page_less(const struct hash_elem *a, const struct hash_elem *b,
+                      void *aux UNUSED) {
+    const struct page *pa = hash_entry(a, struct page, hash_elem);
+    const struct page *pb = hash_entry(b, struct page, hash_elem);
+    return pa->upage < pb->upage;
+}
+
+/*! Releases the frame and swap slot of the page containing E and frees it. */
+static void page_destroy(struct hash_elem *e, void *aux UNUSED) {
+    struct page *p = hash_entry(e, struct page, hash_elem);
+
+    frame_free(p);
+    if (p->swap_slot != SWAP_ERROR)
+        swap_free(p->swap_slot);
+    free(p);
+}
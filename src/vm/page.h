@@ -0,0 +1,76 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct frame;
+struct thread;
+
+/*! Where a page's contents come from when it is not resident. */
+enum page_type {
+    PAGE_ANON,                  /*!< Private; swap, or zeros if never used. */
+    PAGE_FILE                   /*!< Shared with the file it is mapped from. */
+};
+
+/*! A page of user virtual memory.
+
+    Each process keeps one of these for every page it has mapped, resident
+    or not, in its supplemental page table (struct thread's `pages').
+
+    A non-resident anonymous page is either in swap (SWAP_SLOT is valid) or
+    has never been written and reads as zeros.  A resident anonymous page
+    may keep its swap slot after being read back in, as long as it stays
+    clean: evicting it again then costs no write.  After fork, a parent's
+    and child's anonymous pages share frames and swap slots until written.
+
+    A file page maps READ_BYTES bytes of FILE starting at FILE_OFS, followed
+    by zeros, through the page cache kept by the frame table. */
+struct page {
+    void *upage;                /*!< User virtual address. */
+    uint32_t *pagedir;          /*!< Owning page directory. */
+    bool writable;              /*!< Read/write (true) or read-only. */
+    enum page_type type;        /*!< Backing store. */
+    struct frame *frame;        /*!< Frame holding the page, or NULL. */
+    struct list_elem frame_elem; /*!< Element in the frame's page list. */
+
+    /*! PAGE_ANON only. */
+    size_t swap_slot;           /*!< Swap slot, or SWAP_ERROR if none. */
+
+    /*! PAGE_FILE only. @{ */
+    struct file *file;          /*!< Mapped file. */
+    off_t file_ofs;             /*!< Offset of the page within FILE. */
+    size_t read_bytes;          /*!< Bytes read from FILE; rest is zeros. */
+    /*! @} */
+
+    struct hash_elem hash_elem; /*!< Element in supplemental page table. */
+};
+
+extern size_t page_fault_around;
+
+bool page_table_init(struct hash *);
+void page_table_destroy(struct hash *);
+void page_table_lock(void);
+void page_table_unlock(void);
+bool page_table_dup(struct thread *parent);
+
+struct page *page_create(void *upage, bool writable);
+struct page *page_create_file(void *upage, bool writable, struct file *,
+                              off_t ofs, size_t read_bytes);
+void page_remove(struct page *);
+struct page *page_lookup(const void *addr);
+bool page_in(struct page *, bool pin);
+struct frame *page_pin(struct page *);
+void page_unpin(struct page *);
+bool page_fault_in(const void *fault_addr);
+bool page_write_fault(const void *fault_addr);
+
+void page_set_swap(struct page *, size_t slot);
+void page_print_stats(void);
+
+#endif /* vm/page.h */
@@ -0,0 +1,78 @@
+/*! \file prefetch.c
+ *
+ * Asynchronous read-ahead for file pages.  When the page fault handler sees
+ * a process fault its way sequentially through a file-backed region, it
+ * queues the pages ahead of it here, and a kernel thread reads them into the
+ * page cache while the process keeps running.  By the time the process gets
+ * there, the pages are in memory and fault-around maps them in bulk.
+ *
+ * Prefetching is only a hint: requests are dropped when the queue is full,
+ * and the reads themselves never evict anything.
+ */
+
+#include "vm/prefetch.h"
+#include <debug.h>
+#include "filesys/inode.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "vm/frame.h"
+
+/*! Maximum number of queued requests. */
+#define PREFETCH_QUEUE 64
+
+/*! A request to read one page of a file into the page cache. */
+struct prefetch_req {
+    struct inode *inode;        /*!< File, with a reference of our own. */
+    off_t ofs;                  /*!< Offset of the page within INODE. */
+    size_t read_bytes;          /*!< Bytes backed by INODE; rest is zeros. */
+};
+
+static struct prefetch_req queue[PREFETCH_QUEUE]; /*!< Circular queue. */
+static size_t queue_head;               /*!< Index of the oldest request. */
+static size_t queue_cnt;                /*!< Number of queued requests. */
+static struct lock queue_lock;          /*!< Protects the queue. */
+static struct condition queue_nonempty; /*!< Signaled on a new request. */
+
+static thread_func prefetch_thread NO_RETURN;
+
+/*! Starts the prefetch thread. */
+void prefetch_init(void) {
+    lock_init(&queue_lock);
+    cond_init(&queue_nonempty);
+    if (thread_create("prefetch", PRI_DEFAULT, prefetch_thread, NULL)
+        == TID_ERROR)
+        PANIC("could not start prefetch thread");
+}
+
+/*! Asks for the READ_BYTES bytes of INODE at offset OFS to be read into the
+    page cache in the background.  Does nothing if the queue is full. */
+void prefetch_file(struct inode *inode, off_t ofs, size_t read_bytes) {
+    lock_acquire(&queue_lock);
+    if (queue_cnt < PREFETCH_QUEUE) {
+        struct prefetch_req *r = &queue[(queue_head + queue_cnt++)
+                                        % PREFETCH_QUEUE];
+        r->inode = inode_reopen(inode);
+        r->ofs = ofs;
+        r->read_bytes = read_bytes;
+        cond_signal(&queue_nonempty, &queue_lock);
+    }
+    lock_release(&queue_lock);
+}
+
+/*! Carries out prefetch requests, oldest first. */
+static void prefetch_thread(void *aux UNUSED) {
+    for (;;) {
+        struct prefetch_req r;
+
+        lock_acquire(&queue_lock);
+        while (queue_cnt == 0)
+            cond_wait(&queue_nonempty, &queue_lock);
+        r = queue[queue_head];
+        queue_head = (queue_head + 1) % PREFETCH_QUEUE;
+        queue_cnt--;
+        lock_release(&queue_lock);
+
+        frame_prefetch(r.inode, r.ofs, r.read_bytes);
+        inode_close(r.inode);
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef VM_PREFETCH_H
+#define VM_PREFETCH_H
+
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct inode;
+
+void prefetch_init(void);
+void prefetch_file(struct inode *, off_t ofs, size_t read_bytes);
+
+#endif /* vm/prefetch.h */
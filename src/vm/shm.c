@@ -0,0 +1,280 @@
+/*! \file shm.c
+ *
+ * Shared memory segments.  A segment is a named run of zeroed frames that
+ * any number of processes map into their address spaces, each at an
+ * address of its choosing, so that what one process writes the others see
+ * at once, without going through the file system.
+ *
+ * A segment's frames are mapped directly into the page directories of the
+ * processes that attach it and are not part of any supplemental page table,
+ * so they are never evicted and never fault.  The segment counts its
+ * attachments, and it and its frames go away, along with its name, when
+ * the last one is detached.  A forked child inherits its parent's
+ * attachments.
+ */
+
+#include "vm/shm.h"
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+
+/*! A shared memory segment. */
+struct segment {
+    char name[SHM_NAME_MAX + 1]; /*!< Name, unique among segments. */
+    size_t page_cnt;            /*!< Number of pages. */
+    void **kpages;              /*!< Kernel addresses of its frames. */
+    int attach_cnt;             /*!< Number of attachments. */
+    struct list_elem elem;      /*!< Element in segment list. */
+};
+
+/*! A segment attached to a process. */
+struct attachment {
+    struct segment *seg;        /*!< Attached segment. */
+    void *base;                 /*!< User address of its first page. */
+    struct list_elem elem;      /*!< Element in the thread's list. */
+};
+
+static struct list segments;    /*!< All segments. */
+static struct lock shm_lock;    /*!< Protects SEGMENTS, attach counts, and
+                                     attachment lists. */
+
+static struct segment *segment_lookup(const char *name);
+static void segment_release(struct segment *);
+static bool attach(struct segment *, void *base);
+static void detach(struct attachment *);
+static bool range_free(void *base, size_t page_cnt);
+
+/*! Initializes the shared memory segment list. */
+void shm_init(void) {
+    list_init(&segments);
+    lock_init(&shm_lock);
+}
+
+/*! Creates a segment named NAME of SIZE bytes, rounded up to whole pages,
+    that reads as zeros, and attaches it to the current process at ADDR.
+    Returns false if a segment called NAME already exists, NAME is too
+    long, ADDR is not page-aligned or the pages from there on are not free,
+    or memory is short. */
+bool shm_create(const char *name, size_t size, void *addr) {
+    struct segment *seg;
+    size_t i;
+    bool success = false;
+
+    if (strlen(name) > SHM_NAME_MAX || size == 0)
+        return false;
+
+    lock_acquire(&shm_lock);
+    if (segment_lookup(name) != NULL)
+        goto done;
+
+    seg = malloc(sizeof *seg);
+    if (seg == NULL)
+        goto done;
+    strlcpy(seg->name, name, sizeof seg->name);
+    seg->page_cnt = DIV_ROUND_UP(size, PGSIZE);
+    seg->attach_cnt = 0;
+    seg->kpages = calloc(seg->page_cnt, sizeof *seg->kpages);
+    if (seg->kpages == NULL) {
+        free(seg);
+        goto done;
+    }
+    for (i = 0; i < seg->page_cnt; i++) {
+        seg->kpages[i] = palloc_get_page(PAL_USER | PAL_ZERO);
+        if (seg->kpages[i] == NULL)
+            break;
+    }
+
+    if (i == seg->page_cnt && attach(seg, addr)) {
+        list_push_back(&segments, &seg->elem);
+        success = true;
+    }
+    else {
+        segment_release(seg);
+    }
+
+done:
+    lock_release(&shm_lock);
+    return success;
+}
+
+/*! Attaches the segment named NAME to the current process at ADDR.
+    Returns the segment's size in bytes, or -1 if there is no such
+    segment, ADDR is not page-aligned or the pages it would occupy are not
+    free, or memory allocation fails. */
+int shm_attach(const char *name, void *addr) {
+    struct segment *seg;
+    int size = -1;
+
+    lock_acquire(&shm_lock);
+    seg = segment_lookup(name);
+    if (seg != NULL && attach(seg, addr))
+        size = seg->page_cnt * PGSIZE;
+    lock_release(&shm_lock);
+
+    return size;
+}
+
+/*! Detaches the segment the current process attached at ADDR, destroying
+    it if no other process has it attached.  Does nothing if no segment is
+    attached there. */
+void shm_detach(void *addr) {
+    struct thread *t = process_current();
+    struct list_elem *e;
+
+    lock_acquire(&shm_lock);
+    page_table_lock();
+    for (e = list_begin(&t->shm_attachments);
+         e != list_end(&t->shm_attachments); e = list_next(e)) {
+        struct attachment *a = list_entry(e, struct attachment, elem);
+        if (a->base == addr) {
+            detach(a);
+            break;
+        }
+    }
+    page_table_unlock();
+    lock_release(&shm_lock);
+}
+
+/*! Detaches every segment attached to the current process.  Called on
+    process exit, before its page directory is destroyed, which would
+    otherwise free the segments' frames. */
+void shm_detach_all(void) {
+    struct thread *t = process_current();
+
+    lock_acquire(&shm_lock);
+    page_table_lock();
+    while (!list_empty(&t->shm_attachments))
+        detach(list_entry(list_front(&t->shm_attachments),
+                          struct attachment, elem));
+    page_table_unlock();
+    lock_release(&shm_lock);
+}
+
+/*! Attaches to the current process, which has just been forked from
+    PARENT, each segment PARENT has attached, at the same address.  Returns
+    false if memory allocation fails. */
+bool shm_dup(struct thread *parent) {
+    struct list_elem *e;
+    bool success = true;
+
+    lock_acquire(&shm_lock);
+    for (e = list_begin(&parent->shm_attachments);
+         e != list_end(&parent->shm_attachments) && success;
+         e = list_next(e)) {
+        struct attachment *pa = list_entry(e, struct attachment, elem);
+        success = attach(pa->seg, pa->base);
+    }
+    lock_release(&shm_lock);
+
+    return success;
+}
+
+/*! Returns the segment named NAME, or a null pointer if there is none.
+    The shared memory lock must be held. */
+static struct segment * segment_lookup(const char *name) {
+    struct list_elem *e;
+
+    for (e = list_begin(&segments); e != list_end(&segments);
+         e = list_next(e)) {
+        struct segment *seg = list_entry(e, struct segment, elem);
+        if (!strcmp(seg->name, name))
+            return seg;
+    }
+    return NULL;
+}
+
+/*! Frees segment SEG, which must not be attached or on the segment list,
+    and its frames. */
+static void segment_release(struct segment *seg) {
+    size_t i;
+
+    for (i = 0; i < seg->page_cnt; i++)
+        if (seg->kpages[i] != NULL)
+            palloc_free_page(seg->kpages[i]);
+    free(seg->kpages);
+    free(seg);
+}
+
+/*! Maps segment SEG into the current process starting at BASE and records
+    the attachment.  Returns false if BASE is not page-aligned, any of the
+    pages there is in use, or memory allocation fails.  The shared memory
+    lock must be held. */
+static bool attach(struct segment *seg, void *base) {
+    struct thread *t = process_current();
+    struct attachment *a = NULL;
+    size_t i;
+
+    if (base == NULL || pg_ofs(base) != 0)
+        return false;
+
+    page_table_lock();
+    if (!range_free(base, seg->page_cnt))
+        goto fail;
+    a = malloc(sizeof *a);
+    if (a == NULL)
+        goto fail;
+    for (i = 0; i < seg->page_cnt; i++) {
+        if (!pagedir_set_page(t->pagedir, (uint8_t *) base + i * PGSIZE,
+                              seg->kpages[i], true)) {
+            while (i-- > 0)
+                pagedir_clear_page(t->pagedir, (uint8_t *) base + i * PGSIZE);
+            goto fail;
+        }
+    }
+
+    a->seg = seg;
+    a->base = base;
+    list_push_back(&t->shm_attachments, &a->elem);
+    seg->attach_cnt++;
+    page_table_unlock();
+    return true;
+
+fail:
+    page_table_unlock();
+    free(a);
+    return false;
+}
+
+/*! Unmaps attachment A from the current process and frees it, destroying
+    its segment if that was the last attachment.  The shared memory lock
+    and the page table lock must be held. */
+static void detach(struct attachment *a) {
+    struct thread *t = process_current();
+    struct segment *seg = a->seg;
+    size_t i;
+
+    for (i = 0; i < seg->page_cnt; i++)
+        pagedir_clear_page(t->pagedir, (uint8_t *) a->base + i * PGSIZE);
+    list_remove(&a->elem);
+    free(a);
+
+    if (--seg->attach_cnt == 0) {
+        list_remove(&seg->elem);
+        segment_release(seg);
+    }
+}
+
+/*! Returns true if the PAGE_CNT user pages starting at BASE lie within user
+    space and none of them is in use by the current process.  The page
+    table lock must be held. */
+static bool range_free(void *base, size_t page_cnt) {
+    struct thread *t = process_current();
+    uint8_t *end = (uint8_t *) base + page_cnt * PGSIZE;
+    uint8_t *upage;
+
+    if (end < (uint8_t *) base || !is_user_vaddr(end - 1))
+        return false;
+    for (upage = base; upage < end; upage += PGSIZE)
+        if (page_lookup(upage) != NULL ||
+            pagedir_get_page(t->pagedir, upage) != NULL)
+            return false;
+    return true;
+}
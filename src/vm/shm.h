@@ -0,0 +1,20 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct thread;
+
+/*! Maximum length of a shared memory segment's name. */
+#define SHM_NAME_MAX 14
+
+void shm_init(void);
+bool shm_create(const char *name, size_t size, void *addr);
+int shm_attach(const char *name, void *addr);
+void shm_detach(void *addr);
+void shm_detach_all(void);
+bool shm_dup(struct thread *parent);
+
+#endif /* vm/shm.h */
@@ -0,0 +1,139 @@
+/*! \file swap.c
+ *
+ * Swap space.  The block device playing the BLOCK_SWAP role is divided into
+ * page-sized slots, each SECTORS_PER_SLOT sectors long, and a bitmap tracks
+ * which slots are in use.
+ *
+ * Slots are handed out next-fit: each allocation starts scanning just past
+ * the end of the previous one, and the frame table asks for a whole run of
+ * slots when it evicts a cluster of pages.  Consecutive swap-outs therefore
+ * land on consecutive sectors, so the disk sees one long sequential write
+ * instead of a seek per page.
+ *
+ * A slot can be shared by several pages, for example by a parent and its
+ * forked child, so each one carries a reference count and goes back to the
+ * bitmap only when the last page using it lets go.
+ */
+
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/*! Number of sectors in one swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;       /*!< Swap device, if any. */
+static struct bitmap *swap_map;         /*!< One bit per slot, true=used. */
+static uint16_t *swap_refs;             /*!< Reference count of each slot. */
+static struct lock swap_lock;           /*!< Protects the above, swap_next. */
+static size_t swap_next;                /*!< Where the next scan starts. */
+
+/* Statistics. */
+static long long swap_out_cnt;          /*!< # of pages written to swap. */
+static long long swap_in_cnt;           /*!< # of pages read from swap. */
+static long long swap_run_cnt;          /*!< # of runs handed out. */
+
+/*! Initializes the swap space.  If there is no swap device, every
+    allocation fails. */
+void swap_init(void) {
+    size_t slot_cnt = 0;
+
+    lock_init(&swap_lock);
+    swap_device = block_get_role(BLOCK_SWAP);
+    if (swap_device != NULL)
+        slot_cnt = block_size(swap_device) / SECTORS_PER_SLOT;
+
+    swap_map = bitmap_create(slot_cnt);
+    swap_refs = calloc(slot_cnt > 0 ? slot_cnt : 1, sizeof *swap_refs);
+    if (swap_map == NULL || swap_refs == NULL)
+        PANIC("bitmap creation failed--swap device is too large");
+    swap_next = 0;
+}
+
+/*! Allocates a run of up to CNT consecutive free slots, preferring the slots
+    just past the previously allocated run.  Stores the length of the run
+    actually obtained, which is at least 1, into *GOT and returns the first
+    slot.  Each slot in the run starts out with one reference.  Returns
+    SWAP_ERROR if the swap device is full. */
+size_t swap_alloc(size_t cnt, size_t *got) {
+    size_t slot = BITMAP_ERROR;
+
+    ASSERT(cnt > 0);
+
+    lock_acquire(&swap_lock);
+    for (; cnt > 0; cnt--) {
+        slot = bitmap_scan_and_flip(swap_map, swap_next, cnt, false);
+        if (slot == BITMAP_ERROR && swap_next != 0)
+            slot = bitmap_scan_and_flip(swap_map, 0, cnt, false);
+        if (slot != BITMAP_ERROR)
+            break;
+    }
+    if (slot != BITMAP_ERROR) {
+        size_t i;
+
+        for (i = 0; i < cnt; i++)
+            swap_refs[slot + i] = 1;
+        swap_next = slot + cnt;
+        swap_run_cnt++;
+        *got = cnt;
+    }
+    lock_release(&swap_lock);
+
+    return slot != BITMAP_ERROR ? slot : SWAP_ERROR;
+}
+
+/*! Writes the page at KPAGE into swap slot SLOT. */
+void swap_write(size_t slot, const void *kpage) {
+    const uint8_t *p = kpage;
+    size_t i;
+
+    ASSERT(bitmap_test(swap_map, slot));
+    for (i = 0; i < SECTORS_PER_SLOT; i++)
+        block_write(swap_device, slot * SECTORS_PER_SLOT + i,
+                    p + i * BLOCK_SECTOR_SIZE);
+    swap_out_cnt++;
+}
+
+/*! Reads swap slot SLOT into the page at KPAGE. */
+void swap_read(size_t slot, void *kpage) {
+    uint8_t *p = kpage;
+    size_t i;
+
+    ASSERT(bitmap_test(swap_map, slot));
+    for (i = 0; i < SECTORS_PER_SLOT; i++)
+        block_read(swap_device, slot * SECTORS_PER_SLOT + i,
+                   p + i * BLOCK_SECTOR_SIZE);
+    swap_in_cnt++;
+}
+
+/*! Adds a reference to swap slot SLOT, for a page that shares the slot with
+    the page that already holds it. */
+void swap_dup(size_t slot) {
+    lock_acquire(&swap_lock);
+    ASSERT(bitmap_test(swap_map, slot));
+    ASSERT(swap_refs[slot] < UINT16_MAX);
+    swap_refs[slot]++;
+    lock_release(&swap_lock);
+}
+
+/*! Drops a reference to swap slot SLOT, making it available for reuse once
+    no page refers to it. */
+void swap_free(size_t slot) {
+    lock_acquire(&swap_lock);
+    ASSERT(bitmap_test(swap_map, slot));
+    ASSERT(swap_refs[slot] > 0);
+    if (--swap_refs[slot] == 0)
+        bitmap_reset(swap_map, slot);
+    lock_release(&swap_lock);
+}
+
+/*! Prints swap statistics. */
+void swap_print_stats(void) {
+    printf("Swap: %lld pages out in %lld runs, %lld pages in\n",
+           swap_out_cnt, swap_run_cnt, swap_in_cnt);
+}
@@ -0,0 +1,18 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+
+/*! Returned by swap_alloc() when no slot is available, and stored in
+    pages that have no swap slot. */
+#define SWAP_ERROR ((size_t) -1)
+
+void swap_init(void);
+size_t swap_alloc(size_t cnt, size_t *got);
+void swap_write(size_t slot, const void *kpage);
+void swap_read(size_t slot, void *kpage);
+void swap_dup(size_t slot);
+void swap_free(size_t slot);
+void swap_print_stats(void);
+
+#endif /* vm/swap.h */